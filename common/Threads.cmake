@@ -0,0 +1,6 @@
+find_package(Threads REQUIRED)
+if(NOT Threads_FOUND)
+    message(ERROR " Threads not found!")
+else()
+    list(APPEND COMMON_LIBS ${CMAKE_THREAD_LIBS_INIT})
+endif()
@@ -0,0 +1,3 @@
+#--- std::thread (used by OpenGP/util/parallel.h)
+find_package(Threads REQUIRED)
+list(APPEND LIBRARIES ${CMAKE_THREAD_LIBS_INIT})
@@ -48,10 +48,14 @@ public:
 
     void init_from_mesh(const SurfaceMesh &mesh) {
 
-        auto vpoints = mesh.get_vertex_property<Vec3>("v:point");
+        static const Property_key<Vec3> VPOINT("v:point");
+        static const Property_key<Vec3> VNORMAL("v:normal");
+        static const Property_key<Vec3> VCOLOR("v:color");
+
+        auto vpoints = mesh.get_vertex_property(VPOINT);
         set_vbo_raw<Vec3>("vposition", vpoints.data(), mesh.n_vertices());
 
-        auto vnormals = mesh.get_vertex_property<Vec3>("v:normal");
+        auto vnormals = mesh.get_vertex_property(VNORMAL);
         if (vnormals) {
             set_vbo_raw<Vec3>("vnormal", vnormals.data(), mesh.n_vertices());
         } else {
@@ -60,7 +64,7 @@ public:
             free(uninitialized_data);
         }
 
-        auto vcolor = mesh.get_vertex_property<Vec3>("v:color");
+        auto vcolor = mesh.get_vertex_property(VCOLOR);
         if (vcolor) {
             set_vbo_raw<Vec3>("vcolor", vcolor.data(), mesh.n_vertices());
         }
@@ -163,6 +167,20 @@ public:
 
     }
 
+    /// Draws \c count elements starting at element \c first, e.g. one of several
+    /// index sets sharing the vertex buffers
+    void draw(GLsizei count, GLsizei first) {
+
+        vao.bind();
+        triangles.bind();
+
+        glDrawElements(mode, count, GL_UNSIGNED_INT, (const GLvoid*) (first * sizeof(GLuint)));
+
+        triangles.unbind();
+        vao.unbind();
+
+    }
+
     void draw_instanced(GLsizei instances) {
 
         vao.bind();
@@ -205,6 +205,7 @@ using RGBA8Texture = Texture<GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE>;
 using RGB8Texture = Texture<GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE>;
 using RGB32FTexture = Texture<GL_RGB32F, GL_RGB, GL_FLOAT>;
 using R32FTexture = Texture<GL_R32F, GL_RED, GL_FLOAT>;
+using RGBA16FTexture = Texture<GL_RGBA16F, GL_RGBA, GL_FLOAT>;
 using D16Texture = Texture<GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT>;
 
 //=============================================================================
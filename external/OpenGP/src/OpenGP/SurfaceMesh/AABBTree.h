@@ -0,0 +1,244 @@
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License Version 2
+// as published by the Free Software Foundation.
+//
+// This file is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with OpenGP.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <OpenGP/types.h>
+#include <OpenGP/SurfaceMesh/SurfaceMesh.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Closest point \c closest to \c p on triangle (a,b,c), returns the squared distance.
+/// (Ericson, Real-Time Collision Detection, 5.1.5)
+inline Scalar ClosestPointTriangle(Vec3 p, Vec3 a, Vec3 b, Vec3 c, Vec3 & closest) {
+    // Check if P in vertex region outside A
+    Vec3 ab = b - a;
+    Vec3 ac = c - a;
+    Vec3 ap = p - a;
+    Scalar d1 = ab.dot(ap);
+    Scalar d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) {
+        closest = a;
+        return (p-closest).squaredNorm(); // barycentric coordinates (1,0,0)
+    }
+    // Check if P in vertex region outside B
+    Vec3 bp = p - b;
+    Scalar d3 = ab.dot(bp);
+    Scalar d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) {
+        closest = b;
+        return (p-closest).squaredNorm(); // barycentric coordinates (0,1,0)
+    }
+    // Check if P in edge region of AB, if so return projection of P onto AB
+    Scalar vc = d1*d4 - d3*d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        Scalar v = d1 / (d1 - d3);
+        closest = a + v * ab;
+        return (p - closest).squaredNorm(); // barycentric coordinates (1-v,v,0)
+    }
+    // Check if P in vertex region outside C
+    Vec3 cp = p - c;
+    Scalar d5 = ab.dot(cp);
+    Scalar d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) {
+        closest = c;
+        return (p-closest).squaredNorm(); // barycentric coordinates (0,0,1)
+    }
+    // Check if P in edge region of AC, if so return projection of P onto AC
+    Scalar vb = d5*d2 - d1*d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        Scalar w = d2 / (d2 - d6);
+        closest = a + w * ac;
+        return (p - closest).squaredNorm(); // barycentric coordinates (1-w,0,w)
+    }
+    // Check if P in edge region of BC, if so return projection of P onto BC
+    Scalar va = d3*d6 - d5*d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        Scalar w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        closest = b + w * (c - b);
+        return (p - closest).squaredNorm(); // barycentric coordinates (0,1-w,w)
+    }
+    // P inside face region. Compute Q through its barycentric coordinates (u,v,w)
+    Scalar denom = 1.0 / (va + vb + vc);
+    Scalar v = vb * denom;
+    Scalar w = vc * denom;
+    closest = a + ab * v + ac * w;
+    return (p - closest).squaredNorm(); // = u*a + v*b + w*c, u = va * denom = 1 - v - w
+}
+
+/// @brief Bounding volume hierarchy over the triangles of a SurfaceMesh for
+/// closest point queries (the CGAL-free counterpart of AABBSearcher).
+///
+/// The tree keeps its own copy of the triangle corners, so the mesh can be
+/// modified after build() (e.g. to project a remeshed surface back onto the
+/// original one). Queries are const and can run from many threads.
+///
+/// Usage:
+///
+///   AABBTree tree(mesh);
+///   Vec3 foot = tree.closest_point(query);
+///
+/// @note faces are assumed to be triangles, only the first three vertices are used
+class AABBTree{
+public:
+    typedef Eigen::AlignedBox<Scalar,3> Box;
+
+    AABBTree(){}
+    explicit AABBTree(const SurfaceMesh& mesh){ build(mesh); }
+
+    /// (re)builds the hierarchy on the current faces of \c mesh
+    void build(const SurfaceMesh& mesh){
+        nodes.clear();
+        corners.clear();
+        faces.clear();
+
+        ///--- bake triangles
+        std::vector<Vec3> triangles;
+        std::vector<SurfaceMesh::Face> triangle_faces;
+        triangles.reserve(3*mesh.n_faces());
+        triangle_faces.reserve(mesh.n_faces());
+        for(SurfaceMesh::Face f: mesh.faces()){
+            SurfaceMesh::Vertex_around_face_circulator vit = mesh.vertices(f);
+            triangles.push_back(mesh.position(*vit));
+            triangles.push_back(mesh.position(*(++vit)));
+            triangles.push_back(mesh.position(*(++vit)));
+            triangle_faces.push_back(f);
+        }
+        const int n = (int) triangle_faces.size();
+        if(n == 0) return;
+
+        std::vector<Vec3> centroids(n);
+        std::vector<int> order(n);
+        for(int i=0; i<n; i++){
+            centroids[i] = (triangles[3*i] + triangles[3*i+1] + triangles[3*i+2]) / 3;
+            order[i] = i;
+        }
+
+        ///--- median split hierarchy
+        nodes.reserve(2*(n/MAX_LEAF_SIZE+1));
+        build_node(triangles, centroids, order, 0, n);
+
+        ///--- corners stored in leaf order for coherent access
+        corners.resize(3*n);
+        faces.resize(n);
+        for(int i=0; i<n; i++){
+            for(int k=0; k<3; k++)
+                corners[3*i+k] = triangles[3*order[i]+k];
+            faces[i] = triangle_faces[order[i]];
+        }
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    /// Closest point to \c query on the triangles, optionally returns the face
+    /// it lies on and its (non squared) distance. NaN if the tree is empty.
+    Vec3 closest_point(const Vec3& query, SurfaceMesh::Face* face=NULL, Scalar* distance=NULL) const {
+        Vec3 p_best(nan(), nan(), nan());
+        Scalar d_best = std::numeric_limits<Scalar>::infinity();
+        int i_best = -1;
+
+        int stack[64];
+        int top = 0;
+        if(!nodes.empty()) stack[top++] = 0;
+        while(top > 0){
+            const Node& node = nodes[stack[--top]];
+            if(node.box.squaredExteriorDistance(query) >= d_best) continue;
+
+            if(node.count > 0){
+                for(int i=node.first; i<node.first+node.count; i++){
+                    Vec3 p;
+                    Scalar d = ClosestPointTriangle(query, corners[3*i], corners[3*i+1], corners[3*i+2], p);
+                    if(d < d_best){
+                        d_best = d;
+                        p_best = p;
+                        i_best = i;
+                    }
+                }
+            } else {
+                ///--- visit the nearer child first (pushed last)
+                Scalar d_left = nodes[node.left].box.squaredExteriorDistance(query);
+                Scalar d_right = nodes[node.right].box.squaredExteriorDistance(query);
+                int first = node.left, second = node.right;
+                if(d_right < d_left){ std::swap(first, second); std::swap(d_left, d_right); }
+                if(d_right < d_best) stack[top++] = second;
+                if(d_left < d_best) stack[top++] = first;
+            }
+        }
+
+        if(face) *face = (i_best >= 0) ? faces[i_best] : SurfaceMesh::Face();
+        if(distance) *distance = std::sqrt(d_best);
+        return p_best;
+    }
+
+private:
+    static const int MAX_LEAF_SIZE = 4;
+
+    struct Node{
+        Box box;
+        int first;  ///< first triangle (leaves)
+        int count;  ///< number of triangles, 0 for inner nodes
+        int left;   ///< children (inner nodes)
+        int right;
+    };
+
+    /// builds the node over order[begin,end), returns its index
+    int build_node(const std::vector<Vec3>& triangles, const std::vector<Vec3>& centroids, std::vector<int>& order, int begin, int end){
+        const int index = (int) nodes.size();
+        nodes.push_back(Node());
+
+        Box box, centroid_box;
+        for(int i=begin; i<end; i++){
+            for(int k=0; k<3; k++)
+                box.extend(triangles[3*order[i]+k]);
+            centroid_box.extend(centroids[order[i]]);
+        }
+        nodes[index].box = box;
+
+        if(end - begin <= MAX_LEAF_SIZE){
+            nodes[index].first = begin;
+            nodes[index].count = end - begin;
+            nodes[index].left = nodes[index].right = -1;
+            return index;
+        }
+
+        ///--- split at the median centroid along the longest axis
+        int axis;
+        centroid_box.sizes().maxCoeff(&axis);
+        const int mid = (begin + end) / 2;
+        std::nth_element(order.begin()+begin, order.begin()+mid, order.begin()+end, [&](int a, int b){
+            return centroids[a][axis] < centroids[b][axis];
+        });
+
+        const int left = build_node(triangles, centroids, order, begin, mid);
+        const int right = build_node(triangles, centroids, order, mid, end);
+        nodes[index].first = begin;
+        nodes[index].count = 0;
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+private:
+    std::vector<Node> nodes;                ///< nodes[0] is the root
+    std::vector<Vec3> corners;              ///< 3 corners per triangle, in leaf order
+    std::vector<SurfaceMesh::Face> faces;   ///< source face of each triangle
+};
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
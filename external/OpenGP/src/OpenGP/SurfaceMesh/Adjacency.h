@@ -0,0 +1,157 @@
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License Version 2
+// as published by the Free Software Foundation.
+//
+// This file is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with OpenGP.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <OpenGP/SurfaceMesh/SurfaceMesh.h>
+#include <OpenGP/util/parallel.h>
+#include <vector>
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Immutable snapshot of the connectivity of a SurfaceMesh in compressed row
+/// (CSR) form: vertex -> one-ring vertices, vertex -> incident faces and
+/// face -> vertices, each stored as one offset array plus one flat index array.
+///
+/// Rows are indexed with the mesh handles (deleted elements have empty rows)
+/// and keep the order of the corresponding circulators. Read-only traversals
+/// (smoothing, Laplacians, GPU uploads, ...) then only touch flat arrays and
+/// are safe to run from many threads.
+///
+/// The snapshot records SurfaceMesh::topology_revision(); any later edit of
+/// the connectivity makes it stale (is_valid() returns false) and update()
+/// rebuilds it only in that case.
+///
+/// Usage:
+///
+///   SurfaceMeshAdjacency adjacency(mesh);
+///   for (SurfaceMesh::Vertex v : mesh.vertices())
+///       for (SurfaceMesh::Vertex vv : adjacency.vertices(v))
+///           ...
+class SurfaceMeshAdjacency{
+public:
+    typedef SurfaceMesh::Vertex Vertex;
+    typedef SurfaceMesh::Face Face;
+
+    /// a row of the snapshot, usable in range-based for loops
+    template <class T>
+    class Row{
+    public:
+        Row(const T* begin, const T* end) : begin_(begin), end_(end) {}
+        const T* begin() const { return begin_; }
+        const T* end() const { return end_; }
+        unsigned int size() const { return (unsigned int) (end_ - begin_); }
+        const T& operator[](unsigned int i) const { return begin_[i]; }
+    private:
+        const T* begin_;
+        const T* end_;
+    };
+
+public:
+    SurfaceMeshAdjacency() : mesh_(NULL), revision_(0) {}
+    explicit SurfaceMeshAdjacency(const SurfaceMesh& mesh) : mesh_(NULL), revision_(0) { build(mesh); }
+
+    /// (re)builds all three tables from \c mesh
+    void build(const SurfaceMesh& mesh){
+        mesh_ = &mesh;
+        revision_ = mesh.topology_revision();
+
+        const int nv = mesh.vertices_size();
+        const int nf = mesh.faces_size();
+
+        build_rows(nv, vv_offsets_, vv_, [&mesh](int i, Vertex* out){
+            Vertex v(i);
+            unsigned int n = 0;
+            if (mesh.is_deleted(v) || mesh.is_isolated(v)) return n;
+            for (Vertex vv : mesh.vertices(v)) { if (out) out[n] = vv; ++n; }
+            return n;
+        });
+
+        build_rows(nv, vf_offsets_, vf_, [&mesh](int i, Face* out){
+            Vertex v(i);
+            unsigned int n = 0;
+            if (mesh.is_deleted(v) || mesh.is_isolated(v)) return n;
+            for (Face f : mesh.faces(v)) { if (out) out[n] = f; ++n; }
+            return n;
+        });
+
+        build_rows(nf, fv_offsets_, fv_, [&mesh](int i, Vertex* out){
+            Face f(i);
+            unsigned int n = 0;
+            if (mesh.is_deleted(f)) return n;
+            for (Vertex v : mesh.vertices(f)) { if (out) out[n] = v; ++n; }
+            return n;
+        });
+    }
+
+    /// rebuilds the snapshot if it does not describe the current connectivity of \c mesh.
+    /// returns whether a rebuild happened.
+    bool update(const SurfaceMesh& mesh){
+        if (mesh_ == &mesh && revision_ == mesh.topology_revision()) return false;
+        build(mesh);
+        return true;
+    }
+
+    /// false once the mesh the snapshot was built from has been edited
+    bool is_valid() const { return mesh_ && revision_ == mesh_->topology_revision(); }
+
+    /// one-ring neighbors of \c v
+    Row<Vertex> vertices(Vertex v) const { assert(is_valid()); return row(vv_offsets_, vv_, v.idx()); }
+    /// faces incident to \c v
+    Row<Face> faces(Vertex v) const { assert(is_valid()); return row(vf_offsets_, vf_, v.idx()); }
+    /// vertices of \c f
+    Row<Vertex> vertices(Face f) const { assert(is_valid()); return row(fv_offsets_, fv_, f.idx()); }
+
+    /// raw tables: row i of a table spans [offsets[i], offsets[i+1]) of the index array
+    const std::vector<unsigned int>& vertex_vertex_offsets() const { return vv_offsets_; }
+    const std::vector<Vertex>& vertex_vertex_indices() const { return vv_; }
+    const std::vector<unsigned int>& vertex_face_offsets() const { return vf_offsets_; }
+    const std::vector<Face>& vertex_face_indices() const { return vf_; }
+    const std::vector<unsigned int>& face_vertex_offsets() const { return fv_offsets_; }
+    const std::vector<Vertex>& face_vertex_indices() const { return fv_; }
+
+private:
+    template <class T>
+    static Row<T> row(const std::vector<unsigned int>& offsets, const std::vector<T>& indices, int i){
+        assert(i >= 0 && i+1 < (int) offsets.size());
+        const T* data = indices.empty() ? NULL : &indices[0];
+        return Row<T>(data + offsets[i], data + offsets[i+1]);
+    }
+
+    /// two passes: count row sizes in parallel, prefix sum, fill rows in parallel.
+    /// \c fill(i, out) returns the size of row i and writes it to \c out unless NULL.
+    template <class T, class Fill>
+    static void build_rows(int n, std::vector<unsigned int>& offsets, std::vector<T>& indices, Fill fill){
+        offsets.assign(n+1, 0);
+        parallel_for(0, n, [&](int i){ offsets[i+1] = fill(i, (T*) NULL); });
+        for (int i=0; i<n; ++i)
+            offsets[i+1] += offsets[i];
+        indices.resize(offsets[n]);
+        if (indices.empty()) return;
+        parallel_for(0, n, [&](int i){ fill(i, indices.data() + offsets[i]); });
+    }
+
+private:
+    const SurfaceMesh* mesh_;
+    unsigned int revision_;
+    std::vector<unsigned int> vv_offsets_;
+    std::vector<Vertex>       vv_;
+    std::vector<unsigned int> vf_offsets_;
+    std::vector<Face>         vf_;
+    std::vector<unsigned int> fv_offsets_;
+    std::vector<Vertex>       fv_;
+};
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
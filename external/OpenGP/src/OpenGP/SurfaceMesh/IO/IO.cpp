@@ -54,6 +54,10 @@ bool read_mesh(SurfaceMesh& mesh, const std::string& filename)
     {
         return read_stl(mesh, filename);
     }
+    else if (ext == "ply")
+    {
+        return read_ply(mesh, filename);
+    }
 
     // we didn't find a reader module
     return false;
@@ -63,6 +67,17 @@ bool read_mesh(SurfaceMesh& mesh, const std::string& filename)
 //-----------------------------------------------------------------------------
 
 
+bool read_mesh(SurfaceMesh& mesh, const std::string& filename, Space_filling_curve curve)
+{
+    if (!read_mesh(mesh, filename)) return false;
+    reorder_spatially(mesh, curve);
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 bool write_mesh(const SurfaceMesh& mesh, const std::string& filename)
 {
     // extract file extension
@@ -81,6 +96,10 @@ bool write_mesh(const SurfaceMesh& mesh, const std::string& filename)
     {
         return write_obj(mesh, filename);
     }
+    else if(ext=="ply")
+    {
+        return write_ply(mesh, filename);
+    }
 
     // we didn't find a writer module
     return false;
@@ -12,7 +12,9 @@
 
 #pragma once
 #include <OpenGP/SurfaceMesh/SurfaceMesh.h>
+#include <OpenGP/SurfaceMesh/Reorder.h>
 #include <string>
+#include <vector>
 
 //=============================================================================
 namespace OpenGP {
@@ -22,11 +24,35 @@ HEADERONLY_INLINE bool read_mesh(SurfaceMesh& mesh, const std::string& filename)
 HEADERONLY_INLINE bool read_off(SurfaceMesh& mesh, const std::string& filename);
 HEADERONLY_INLINE bool read_obj(SurfaceMesh& mesh, const std::string& filename);
 HEADERONLY_INLINE bool read_stl(SurfaceMesh& mesh, const std::string& filename);
+HEADERONLY_INLINE bool read_ply(SurfaceMesh& mesh, const std::string& filename);
 HEADERONLY_INLINE bool write_mesh(const SurfaceMesh& mesh, const std::string& filename);
 HEADERONLY_INLINE bool write_off(const SurfaceMesh& mesh, const std::string& filename);
 HEADERONLY_INLINE bool write_obj(const SurfaceMesh& mesh, const std::string& filename);
+HEADERONLY_INLINE bool write_ply(const SurfaceMesh& mesh, const std::string& filename);
+
+/// read_mesh() then reorders the elements along \c curve for memory locality (\sa reorder_spatially)
+HEADERONLY_INLINE bool read_mesh(SurfaceMesh& mesh, const std::string& filename, Space_filling_curve curve);
+
+/// Outcome of welding a triangle soup into a SurfaceMesh
+struct Weld_report
+{
+    unsigned int n_vertices;     ///< vertices after welding
+    unsigned int n_degenerate;   ///< triangles dropped because two of their corners were welded
+    unsigned int n_nonmanifold;  ///< triangles the halfedge structure could not accept
+};
+
+/// Builds \c mesh from a triangle soup (\c corners holds 3 consecutive points per
+/// triangle), welding corners through a spatial hash. With \c tolerance 0 only
+/// identical points are welded, otherwise points falling in the same grid cell of
+/// size \c tolerance share one vertex, and so do neighboring cells whose first
+/// points are closer than \c tolerance. Vertices keep the order of their first
+/// corner. Hashing runs in parallel, the connectivity is built in one pass with
+/// SurfaceMesh::add_faces.
+HEADERONLY_INLINE Weld_report weld_triangle_soup(SurfaceMesh& mesh, const std::vector<Vec3>& corners, Scalar tolerance = 0);
+
+/// read_stl() welding with \c tolerance, \c report (if given) receives the weld statistics
+HEADERONLY_INLINE bool read_stl(SurfaceMesh& mesh, const std::string& filename, Scalar tolerance, Weld_report* report = NULL);
 
-/// Private helper function
 template <typename T> void read(FILE* in, T& t)
 {
     size_t n_items(0);
@@ -42,6 +68,7 @@ template <typename T> void read(FILE* in, T& t)
     #include "IO.cpp"
     #include "IO_obj.cpp"
     #include "IO_off.cpp"
+    #include "IO_ply.cpp"
     #include "IO_poly.cpp"
     #include "IO_stl.cpp"
 #endif
@@ -14,171 +14,196 @@
 
 #include <OpenGP/SurfaceMesh/SurfaceMesh.h>
 #include <OpenGP/SurfaceMesh/IO/IO.h>
+#include <OpenGP/util/mapped_file.h>
 #include <cstdio>
+#include <cstdlib>
+#include <cctype>
 
 //=============================================================================
 namespace OpenGP {
 //=============================================================================
 
+/// Tokenizer helpers for read_obj, they never read past \c end
+/// (a memory mapped file is not null terminated)
+namespace obj_tokens {
+
+HEADERONLY_INLINE const char* skip_blanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+HEADERONLY_INLINE const char* skip_token(const char* p, const char* end) {
+    while (p < end && !isspace((unsigned char) *p)) ++p;
+    return p;
+}
+
+HEADERONLY_INLINE const char* next_line(const char* p, const char* end) {
+    while (p < end && *p != '\n') ++p;
+    return (p < end) ? p+1 : end;
+}
+
+/// true if \c p points at \c keyword followed by a blank
+HEADERONLY_INLINE bool is_keyword(const char* p, const char* end, const char* keyword) {
+    for (; *keyword; ++keyword, ++p)
+        if (p >= end || *p != *keyword) return false;
+    return (p < end) && (*p == ' ' || *p == '\t');
+}
+
+/// parses one float, conversion is the same as sscanf("%f")
+HEADERONLY_INLINE bool read_float(const char*& p, const char* end, float& x) {
+    p = skip_blanks(p, end);
+    char token[64];
+    size_t n = 0;
+    while (p < end && n < sizeof(token)-1 && !isspace((unsigned char) *p)) token[n++] = *p++;
+    p = skip_token(p, end);
+    token[n] = '\0';
+    char* token_end;
+    x = strtof(token, &token_end);
+    return token_end != token;
+}
+
+/// parses one (possibly negative) integer
+HEADERONLY_INLINE bool read_int(const char*& p, const char* end, long& i) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    if (p >= end || !isdigit((unsigned char) *p)) return false;
+    long value = 0;
+    while (p < end && isdigit((unsigned char) *p)) value = 10*value + (*p++ - '0');
+    i = negative ? -value : value;
+    return true;
+}
+
+/// OBJ indices are 1-based, negative ones are relative to the current element count
+HEADERONLY_INLINE long resolve_index(long i, size_t count) {
+    return (i < 0) ? (long) count + i : i - 1;
+}
+
+} // namespace obj_tokens
+
 bool read_obj(SurfaceMesh& mesh, const std::string& filename) {
-    char s[200];
-    float  x, y, z;
-    std::vector<SurfaceMesh::Vertex>  vertices;
-    std::vector<Vec3> all_tex_coords;   //individual texture coordinates
-    std::vector<int> halfedge_tex_idx; //texture coordinates sorted for halfedges
+    using namespace obj_tokens;
+    std::vector<Vec3> points;
+    std::vector<Vec3> normals;
+    std::vector<Vec3> all_tex_coords;          //individual texture coordinates
+    std::vector<unsigned int> valences;        //number of vertices of each face
+    std::vector<SurfaceMesh::Vertex> corners;  //vertices of all faces, one after the other
+    std::vector<long> corner_tex_idx;          //texture coordinate of each corner (-1 if none)
     SurfaceMesh::Halfedge_property <Vec3> tex_coords = mesh.halfedge_property<Vec3>("h:texcoord");
     bool with_tex_coord=false;
 
     // clear mesh
     mesh.clear();
 
-    // open file (in ASCII mode)
-    FILE* in = fopen(filename.c_str(), "r");
-    if (!in) return false;
-
-    // clear line once
-    memset(&s, 0, 200);
-
-    // pre-parse to find out the number of vertices
-    {
-        uint vnormal_counter = 0; // number of vertex normals parsed
-        while (in && !feof(in) && fgets(s, 200, in)) {
-            if (s[0] == '#' || isspace(s[0])) continue; // comment
-            else if (strncmp(s, "v ", 2) == 0) { if (sscanf(s, "v %f %f %f", &x, &y, &z)) mesh.add_vertex(Vec3(0,0,0)); }
-            else if (strncmp(s, "vn ", 3) == 0) { if (sscanf(s, "vn %f %f %f", &x, &y, &z)) vnormal_counter++; }
-            else continue;
-        }
+    // map the whole file, it is parsed in a single pass
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* p = file.data();
+    const char* end = p + file.size();
 
-        // If we have read any vertex normals, it must match the number of vertices
-        // and in this case allocate memory for normals
-        if (vnormal_counter!=0){
-            assert(vnormal_counter==mesh.n_vertices());
-            mesh.add_vertex_property<Vec3>("v:normal");
-        }
-
-        // Start from the beginning again
-        in = freopen(filename.c_str(),"r",in);
-    }
-
-    // parse line by line (currently only supports vertex positions & faces
-    uint vpoint_counter = 0;  //< number of vertex positions parsed
-    uint vnormal_counter = 0; //< number of vertex normals parsed
-    auto vpoints = mesh.get_vertex_property<Vec3>("v:point");
-    auto vnormals = mesh.get_vertex_property<Vec3>("v:normal");
-    while (in && !feof(in) && fgets(s, 200, in)) {
-        // comment
-        if (s[0] == '#' || isspace(s[0])) continue;
+    // parse line by line (currently only supports vertex positions, normals, texture coordinates & faces)
+    for (; p < end; p = next_line(p, end)) {
+        p = skip_blanks(p, end);
+        if (p >= end) break;
 
         // vertex
-        else if (strncmp(s, "v ", 2) == 0) {
-            if (sscanf(s, "v %f %f %f", &x, &y, &z)) {
-                vpoints[ SurfaceMesh::Vertex(vpoint_counter++) ] = Vec3(x,y,z);
-                // mesh.add_vertex(Vec3(x,y,z));
+        if (is_keyword(p, end, "v")) {
+            p += 1;
+            float x=0, y=0, z=0;
+            if (read_float(p, end, x)) {
+                if (read_float(p, end, y)) read_float(p, end, z);
+                points.push_back(Vec3(x,y,z));
             }
         }
+
         // normal
-        else if (strncmp(s, "vn ", 3) == 0) {
-            int n_read = sscanf(s, "vn %f %f %f", &x, &y, &z);
-            assert((n_read==0) || (n_read==3));
-            if (n_read) {
+        else if (is_keyword(p, end, "vn")) {
+            p += 2;
+            float x=0, y=0, z=0;
+            if (read_float(p, end, x)) {
+                bool complete = read_float(p, end, y) && read_float(p, end, z);
+                assert(complete); (void) complete;
                 // note: problematic as it can be either a vertex property when interpolated or a halfedge property for hard edges
-                assert(vnormal_counter<mesh.n_vertices());
-                vnormals[ SurfaceMesh::Vertex(vnormal_counter) ] = Vec3(x,y,z);
-                vnormal_counter++;
+                normals.push_back(Vec3(x,y,z));
             }
         }
 
         // texture coordinate
-        else if (strncmp(s, "vt ", 3) == 0) {
-            if (sscanf(s, "vt %f %f", &x, &y)) {
-                z=1;
-                all_tex_coords.push_back(Vec3(x,y,z));
+        else if (is_keyword(p, end, "vt")) {
+            p += 2;
+            float x=0, y=0;
+            if (read_float(p, end, x)) {
+                read_float(p, end, y);
+                all_tex_coords.push_back(Vec3(x,y,1));
             }
         }
 
-        // face
-        else if (strncmp(s, "f ", 2) == 0) {
-            int component(0), nV(0);
-            bool endOfVertex(false);
-            char* p0, *p1(s+1);
-
-            vertices.clear();
-            halfedge_tex_idx.clear();
-
-            // skip white-spaces
-            while (*p1==' ') ++p1;
-
-            while (p1) {
-                p0 = p1;
-
-                // overwrite next separator
-
-                // skip '/', '\n', ' ', '\0', '\r' <-- don't forget Windows
-                while (*p1!='/' && *p1!='\r' && *p1!='\n' && *p1!=' ' && *p1!='\0') ++p1;
-
-                // detect end of vertex
-                if (*p1 != '/') {
-                    endOfVertex = true;
-                }
-
-                // replace separator by '\0'
-                if (*p1 != '\0') {
-                    *p1 = '\0';
-                    p1++; // point to next token
-                }
-
-                // detect end of line and break
-                if (*p1 == '\0' || *p1 == '\n') {
-                    p1 = 0;
-                }
-
-                // read next vertex component
-                if (*p0 != '\0') {
-                    switch (component) {
-                        case 0: { // vertex
-                            vertices.push_back( SurfaceMesh::Vertex(atoi(p0) - 1) );
-                            break;
-                        }
-                        case 1: { // texture coord
-                            int idx = atoi(p0)-1;
-                            halfedge_tex_idx.push_back(idx);
-                            with_tex_coord=true;
-                            break;
-                        }
-                        case 2: // normal
-                            break;
-                    }
+        // face: "v", "v/t", "v//n" or "v/t/n" per corner
+        else if (is_keyword(p, end, "f")) {
+            p += 1;
+            unsigned int n = 0;
+            while (true) {
+                p = skip_blanks(p, end);
+                if (p >= end || isspace((unsigned char) *p) || *p == '#') break;
+
+                long v, t = 0, unused;
+                if (!read_int(p, end, v)) { p = skip_token(p, end); continue; }
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (read_int(p, end, t)) with_tex_coord = true;
+                    if (p < end && *p == '/') { ++p; read_int(p, end, unused); }
                 }
+                p = skip_token(p, end);
 
-                ++component;
-
-                if (endOfVertex) {
-                    component = 0;
-                    nV++;
-                    endOfVertex = false;
-                }
+                corners.push_back(SurfaceMesh::Vertex((int) resolve_index(v, points.size())));
+                corner_tex_idx.push_back(t ? resolve_index(t, all_tex_coords.size()) : -1);
+                ++n;
             }
+            valences.push_back(n);
+        }
+    }
+    file.close();
+
+    // faces may only reference existing vertices
+    for (size_t i=0; i<corners.size(); ++i)
+        if (corners[i].idx() < 0 || corners[i].idx() >= (int) points.size()) return false;
+
+    // vertices
+    mesh.reserve(points.size(), corners.size()/2, valences.size());
+    for (size_t i=0; i<points.size(); ++i)
+        mesh.add_vertex(points[i]);
+
+    // If we have read any vertex normals, it must match the number of vertices
+    if (!normals.empty()) {
+        assert(normals.size()==points.size());
+        if (normals.size()==points.size()) {
+            auto vnormals = mesh.vertex_property<Vec3>("v:normal");
+            for (size_t i=0; i<normals.size(); ++i)
+                vnormals[ SurfaceMesh::Vertex(i) ] = normals[i];
+        }
+    }
 
-            SurfaceMesh::Face f=mesh.add_face(vertices);
-
+    // faces
+    std::vector<SurfaceMesh::Face> faces;
+    mesh.add_faces(valences, corners, with_tex_coord ? &faces : NULL);
 
-            // add texture coordinates
-            if (with_tex_coord) {
-                SurfaceMesh::Halfedge_around_face_circulator h_fit = mesh.halfedges(f);
-                SurfaceMesh::Halfedge_around_face_circulator h_end = h_fit;
-                unsigned v_idx =0;
-                do {
-                    tex_coords[*h_fit]=all_tex_coords.at(halfedge_tex_idx.at(v_idx));
-                    ++v_idx;
-                    ++h_fit;
-                } while (h_fit!=h_end);
-            }
+    // add texture coordinates
+    if (with_tex_coord) {
+        size_t offset = 0;
+        for (size_t i=0; i<faces.size(); offset += valences[i], ++i) {
+            if (!faces[i].is_valid()) continue;
+            SurfaceMesh::Halfedge_around_face_circulator h_fit = mesh.halfedges(faces[i]);
+            SurfaceMesh::Halfedge_around_face_circulator h_end = h_fit;
+            size_t v_idx = offset;
+            do {
+                long t = corner_tex_idx[v_idx];
+                if (t >= 0 && t < (long) all_tex_coords.size())
+                    tex_coords[*h_fit] = all_tex_coords[t];
+                ++v_idx;
+                ++h_fit;
+            } while (h_fit!=h_end);
         }
-        // clear line
-        memset(&s, 0, 200);
     }
 
-    fclose(in);
     return true;
 }
 
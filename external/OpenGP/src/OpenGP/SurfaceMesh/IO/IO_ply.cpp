@@ -0,0 +1,661 @@
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License Version 2
+// as published by the Free Software Foundation.
+//
+// This file is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with OpenGP.  If not, see <http://www.gnu.org/licenses/>.
+
+//== INCLUDES =================================================================
+
+#include <OpenGP/SurfaceMesh/SurfaceMesh.h>
+#include <OpenGP/SurfaceMesh/IO/IO.h>
+#include <OpenGP/util/mapped_file.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Helpers for the (binary) PLY reader/writer
+namespace ply_format {
+
+enum Type { INVALID, INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+
+struct Ply_property {
+    std::string name;
+    Type type;        ///< value type (list entries for lists)
+    Type count_type;  ///< type of the list length, INVALID for scalars
+    size_t offset;    ///< byte offset inside a fixed-size record
+};
+
+struct Ply_element {
+    std::string name;
+    size_t count;
+    std::vector<Ply_property> properties;
+
+    /// records without list properties all have the same size
+    bool fixed_size() const {
+        for (size_t i=0; i<properties.size(); ++i)
+            if (properties[i].count_type != INVALID) return false;
+        return true;
+    }
+    /// index of property \c name, -1 if absent
+    int find(const std::string& name) const {
+        for (size_t i=0; i<properties.size(); ++i)
+            if (properties[i].name == name) return (int) i;
+        return -1;
+    }
+};
+
+HEADERONLY_INLINE Type type_from_name(const std::string& n) {
+    if (n == "char"   || n == "int8")    return INT8;
+    if (n == "uchar"  || n == "uint8")   return UINT8;
+    if (n == "short"  || n == "int16")   return INT16;
+    if (n == "ushort" || n == "uint16")  return UINT16;
+    if (n == "int"    || n == "int32")   return INT32;
+    if (n == "uint"   || n == "uint32")  return UINT32;
+    if (n == "float"  || n == "float32") return FLOAT32;
+    if (n == "double" || n == "float64") return FLOAT64;
+    return INVALID;
+}
+
+HEADERONLY_INLINE size_t type_size(Type t) {
+    switch (t) {
+        case INT8: case UINT8:   return 1;
+        case INT16: case UINT16: return 2;
+        case INT32: case UINT32: case FLOAT32: return 4;
+        case FLOAT64: return 8;
+        default: return 0;
+    }
+}
+
+HEADERONLY_INLINE const char* type_name(Type t) {
+    switch (t) {
+        case INT8:    return "char";
+        case UINT8:   return "uchar";
+        case INT16:   return "short";
+        case UINT16:  return "ushort";
+        case INT32:   return "int";
+        case UINT32:  return "uint";
+        case FLOAT32: return "float";
+        case FLOAT64: return "double";
+        default:      return "";
+    }
+}
+
+HEADERONLY_INLINE bool host_is_little_endian() {
+    const uint16_t one = 1;
+    return *(const uint8_t*) &one == 1;
+}
+
+/// copies \c n bytes, reversing their order if \c swap
+HEADERONLY_INLINE void copy_bytes(void* dst, const void* src, size_t n, bool swap) {
+    if (!swap) { memcpy(dst, src, n); return; }
+    const char* s = (const char*) src;
+    char* d = (char*) dst;
+    for (size_t i=0; i<n; ++i) d[i] = s[n-1-i];
+}
+
+/// copies the \c n values of type \c t at \c src, reversing the bytes of each if \c swap
+HEADERONLY_INLINE void copy_values(void* dst, const void* src, size_t n, Type t, bool swap) {
+    const size_t size = type_size(t);
+    if (!swap) { memcpy(dst, src, n*size); return; }
+    for (size_t k=0; k<n; ++k)
+        copy_bytes((char*) dst + k*size, (const char*) src + k*size, size, true);
+}
+
+/// PLY type of the components of Vec3 (float unless OpenGP is built with double Scalar)
+HEADERONLY_INLINE Type scalar_type() {
+    return (sizeof(Scalar) == 4) ? FLOAT32 : FLOAT64;
+}
+
+/// reads one value of type \c t stored at \c p
+HEADERONLY_INLINE double read_value(const char* p, Type t, bool swap) {
+    union { int8_t i8; uint8_t u8; int16_t i16; uint16_t u16; int32_t i32; uint32_t u32; float f32; double f64; } v;
+    copy_bytes(&v, p, type_size(t), swap);
+    switch (t) {
+        case INT8:    return v.i8;
+        case UINT8:   return v.u8;
+        case INT16:   return v.i16;
+        case UINT16:  return v.u16;
+        case INT32:   return v.i32;
+        case UINT32:  return v.u32;
+        case FLOAT32: return v.f32;
+        case FLOAT64: return v.f64;
+        default:      return 0;
+    }
+}
+
+/// advances \c p over one record of \c element, NULL if it would overrun \c end.
+/// if \c list is a valid property index its entries are appended to \c values,
+/// if \c columns is given the bytes of every scalar property i are appended to (*columns)[i] as stored.
+HEADERONLY_INLINE const char* read_record(const char* p, const char* end, const Ply_element& element, bool swap, int list,
+                                          std::vector<double>* values, std::vector< std::vector<char> >* columns = NULL) {
+    for (size_t i=0; i<element.properties.size(); ++i) {
+        const Ply_property& prop = element.properties[i];
+        if (prop.count_type == INVALID) {
+            if (p + type_size(prop.type) > end) return NULL;
+            if (columns) (*columns)[i].insert((*columns)[i].end(), p, p + type_size(prop.type));
+            p += type_size(prop.type);
+            continue;
+        }
+        const size_t count_size = type_size(prop.count_type);
+        if (p + count_size > end) return NULL;
+        const size_t n = (size_t) read_value(p, prop.count_type, swap);
+        p += count_size;
+        const size_t value_size = type_size(prop.type);
+        if (p + n*value_size > end) return NULL;
+        if ((int) i == list && values)
+            for (size_t k=0; k<n; ++k)
+                values->push_back(read_value(p + k*value_size, prop.type, swap));
+        p += n*value_size;
+    }
+    return p;
+}
+
+/// PLY name of the mesh property \c name ("v:quality" -> "quality"), empty if it has whitespace
+HEADERONLY_INLINE std::string ply_name(const std::string& name) {
+    const std::string n = (name.size() > 2 && name[1] == ':') ? name.substr(2) : name;
+    for (size_t i=0; i<n.size(); ++i)
+        if (isspace((unsigned char) n[i])) return std::string();
+    return n;
+}
+
+/// the vertex or face property \c name of type \c T, selected by the handle type
+template <class T> SurfaceMesh::Vertex_property<T> get_property(const SurfaceMesh& mesh, SurfaceMesh::Vertex, const std::string& name) {
+    return mesh.get_vertex_property<T>(name);
+}
+template <class T> SurfaceMesh::Face_property<T> get_property(const SurfaceMesh& mesh, SurfaceMesh::Face, const std::string& name) {
+    return mesh.get_face_property<T>(name);
+}
+
+/// the vertex or face property \c name of type \c T, added if needed (invalid if taken by another type)
+template <class T> SurfaceMesh::Vertex_property<T> add_property(SurfaceMesh& mesh, SurfaceMesh::Vertex, const std::string& name) {
+    return mesh.get_vertex_property<T>(name) ? mesh.get_vertex_property<T>(name) : mesh.add_vertex_property<T>(name);
+}
+template <class T> SurfaceMesh::Face_property<T> add_property(SurfaceMesh& mesh, SurfaceMesh::Face, const std::string& name) {
+    return mesh.get_face_property<T>(name) ? mesh.get_face_property<T>(name) : mesh.add_face_property<T>(name);
+}
+
+/// A mesh property stored as PLY properties: one for a scalar, three for a Vec3.
+/// The components of element i are the bytes values() + i*size(), in host order.
+struct Ply_attribute {
+    std::vector<std::string> names;     ///< PLY name of every component
+    Type type;                          ///< of every component
+    const char* data;                   ///< the property array, NULL if converted
+    std::vector<char> converted;        ///< the values if not stored as in the mesh (colors)
+
+    size_t size() const { return names.size() * type_size(type); }
+    const char* values() const { return data ? data : (converted.empty() ? NULL : &converted[0]); }
+};
+
+/// appends the scalar property \c name to \c attributes if it is of type \c T
+template <class T, class Handle>
+bool add_scalar_attribute(const SurfaceMesh& mesh, const std::string& name, Type type, std::vector<Ply_attribute>& attributes) {
+    const auto property = get_property<T>(mesh, Handle(), name);
+    if (!property) return false;
+    Ply_attribute attribute;
+    attribute.names.push_back(ply_name(name));
+    attribute.type = type;
+    attribute.data = (const char*) property.data();
+    attributes.push_back(attribute);
+    return true;
+}
+
+/// appends the Vec3 property \c name to \c attributes: "normal" as nx,ny,nz, "color"
+/// as uchar red,green,blue (from [0,1]), anything else as name_x,name_y,name_z
+template <class Handle>
+bool add_vec3_attribute(const SurfaceMesh& mesh, const std::string& name, size_t n, std::vector<Ply_attribute>& attributes) {
+    const auto property = get_property<Vec3>(mesh, Handle(), name);
+    if (!property) return false;
+    const std::string base = ply_name(name);
+    Ply_attribute attribute;
+    attribute.type = scalar_type();
+    attribute.data = (const char*) property.data();
+    if (base == "normal") {
+        attribute.names = {"nx", "ny", "nz"};
+    } else if (base == "color") {
+        attribute.names = {"red", "green", "blue"};
+        attribute.type = UINT8;
+        attribute.data = NULL;
+        attribute.converted.resize(3*n);
+        for (size_t i=0; i<n; ++i)
+            for (int k=0; k<3; ++k)
+                attribute.converted[3*i+k] = (char) (uint8_t) std::floor(std::min(std::max((double) property[Handle((int) i)][k], 0.0), 1.0) * 255.0 + 0.5);
+    } else {
+        attribute.names = {base + "_x", base + "_y", base + "_z"};
+    }
+    attributes.push_back(attribute);
+    return true;
+}
+
+/// the properties of the \c n_elements vertices (Handle = Vertex) or faces of \c mesh
+/// whose type PLY can store, except those whose PLY names would clash with \c used
+template <class Handle>
+std::vector<Ply_attribute> collect_attributes(const SurfaceMesh& mesh, const std::vector<std::string>& properties,
+                                              size_t n_elements, std::vector<std::string> used) {
+    std::vector<Ply_attribute> attributes;
+    for (size_t p=0; p<properties.size(); ++p) {
+        const std::string& name = properties[p];
+        if (name == "v:point" || ply_name(name).empty()) continue;
+        const size_t n = attributes.size();
+        add_vec3_attribute<Handle>(mesh, name, n_elements, attributes)
+            || add_scalar_attribute<float, Handle>(mesh, name, FLOAT32, attributes)
+            || add_scalar_attribute<double, Handle>(mesh, name, FLOAT64, attributes)
+            || add_scalar_attribute<int, Handle>(mesh, name, INT32, attributes)
+            || add_scalar_attribute<unsigned int, Handle>(mesh, name, UINT32, attributes)
+            || add_scalar_attribute<short, Handle>(mesh, name, INT16, attributes)
+            || add_scalar_attribute<unsigned short, Handle>(mesh, name, UINT16, attributes)
+            || add_scalar_attribute<signed char, Handle>(mesh, name, INT8, attributes)
+            || add_scalar_attribute<char, Handle>(mesh, name, INT8, attributes)
+            || add_scalar_attribute<unsigned char, Handle>(mesh, name, UINT8, attributes);
+        if (attributes.size() == n) continue; ///< connectivity, flags, ...
+
+        // PLY names must be unique within an element
+        const std::vector<std::string>& names = attributes.back().names;
+        bool clash = false;
+        for (size_t k=0; k<names.size(); ++k)
+            clash = clash || std::find(used.begin(), used.end(), names[k]) != used.end();
+        if (clash) attributes.pop_back();
+        else used.insert(used.end(), names.begin(), names.end());
+    }
+    return attributes;
+}
+
+/// Where the scalar properties of an element are: value k of record i is stored
+/// at base[k] + i*stride[k], in the byte order of the file
+struct Ply_columns {
+    std::vector<const char*> base;
+    std::vector<size_t> stride;
+    bool swap;
+    const char* at(size_t k, size_t i) const { return base[k] + i*stride[k]; }
+};
+
+/// copies column k to the property \c name of type \c T (the type stored in the
+/// file) of element handles[i], \c identity if handles[i] is element i for every i
+template <class T, class Handle>
+void assign_scalar(SurfaceMesh& mesh, const std::string& name, const Ply_columns& columns, size_t k,
+                   const std::vector<Handle>& handles, bool identity) {
+    auto property = add_property<T>(mesh, Handle(), name);
+    if (!property || handles.empty()) return;
+    T* values = (T*) property.data();
+    if (identity && !columns.swap && columns.stride[k] == sizeof(T)) {
+        memcpy((void*) values, columns.base[k], handles.size()*sizeof(T));
+        return;
+    }
+    for (size_t i=0; i<handles.size(); ++i)
+        if (handles[i].is_valid())
+            copy_bytes(values + handles[i].idx(), columns.at(k, i), sizeof(T), columns.swap);
+}
+
+/// Creates the mesh properties (named \c prefix + PLY name) of the scalar
+/// properties of \c element that are not \c used, record i is the element handles[i].
+/// Values are copied as stored when the property keeps the type of the file.
+/// nx,ny,nz become "normal", red,green,blue "color" (integers scaled to [0,1])
+/// and a_x,a_y,a_z the Vec3 "a".
+template <class Handle>
+void read_attributes(SurfaceMesh& mesh, const Ply_element& element, std::vector<bool> used,
+                     const Ply_columns& columns, const std::vector<Handle>& handles, const std::string& prefix) {
+    const std::vector<Ply_property>& props = element.properties;
+    for (size_t k=0; k<props.size(); ++k)
+        used[k] = used[k] || props[k].count_type != INVALID;
+    bool identity = true;
+    for (size_t i=0; i<handles.size() && identity; ++i)
+        identity = (handles[i].idx() == (int) i);
+
+    // Vec3 triplets
+    for (size_t k=0; k<props.size(); ++k) {
+        if (used[k]) continue;
+        const std::string& name = props[k].name;
+        std::string base, components[3];
+        if (name == "nx") { base = "normal"; components[0] = "nx"; components[1] = "ny"; components[2] = "nz"; }
+        else if (name == "red") { base = "color"; components[0] = "red"; components[1] = "green"; components[2] = "blue"; }
+        else if (name.size() > 2 && name.compare(name.size()-2, 2, "_x") == 0) {
+            base = name.substr(0, name.size()-2);
+            components[0] = name; components[1] = base + "_y"; components[2] = base + "_z";
+        }
+        else continue;
+        const int c[3] = {(int) k, element.find(components[1]), element.find(components[2])};
+        if (c[1] < 0 || c[2] < 0 || used[c[1]] || used[c[2]]) continue;
+        auto property = add_property<Vec3>(mesh, Handle(), prefix + base);
+        if (!property) continue;
+        used[c[0]] = used[c[1]] = used[c[2]] = true;
+        if (handles.empty()) continue;
+        const bool integer = (props[k].type != FLOAT32 && props[k].type != FLOAT64);
+        const double scale = (base == "color" && integer) ? 1.0 / double((uint64_t(1) << (8*type_size(props[k].type))) - 1) : 1.0;
+        bool native = true;
+        for (int j=0; j<3; ++j)
+            native = native && props[c[j]].type == scalar_type();
+        Vec3* values = (Vec3*) property.data();
+        for (size_t i=0; i<handles.size(); ++i) {
+            if (!handles[i].is_valid()) continue;
+            Vec3& v = values[handles[i].idx()];
+            for (int j=0; j<3; ++j) {
+                if (native) copy_bytes(&v[j], columns.at(c[j], i), sizeof(Scalar), columns.swap);
+                else v[j] = (Scalar) (scale * read_value(columns.at(c[j], i), props[c[j]].type, columns.swap));
+            }
+        }
+    }
+
+    // scalars keep their type
+    for (size_t k=0; k<props.size(); ++k) {
+        if (used[k]) continue;
+        const std::string name = prefix + props[k].name;
+        switch (props[k].type) {
+            case INT8:    assign_scalar<signed char>(mesh, name, columns, k, handles, identity); break;
+            case UINT8:   assign_scalar<unsigned char>(mesh, name, columns, k, handles, identity); break;
+            case INT16:   assign_scalar<short>(mesh, name, columns, k, handles, identity); break;
+            case UINT16:  assign_scalar<unsigned short>(mesh, name, columns, k, handles, identity); break;
+            case INT32:   assign_scalar<int>(mesh, name, columns, k, handles, identity); break;
+            case UINT32:  assign_scalar<unsigned int>(mesh, name, columns, k, handles, identity); break;
+            case FLOAT32: assign_scalar<float>(mesh, name, columns, k, handles, identity); break;
+            case FLOAT64: assign_scalar<double>(mesh, name, columns, k, handles, identity); break;
+            default: break;
+        }
+    }
+}
+
+} // namespace ply_format
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Reads a binary PLY. Besides x,y,z and the face vertex indices every scalar
+/// property of the vertex and face elements becomes a vertex ("v:name") or face
+/// ("f:name") property of the same type; nx,ny,nz are read as "normal",
+/// red,green,blue as "color" in [0,1] and name_x,name_y,name_z as the Vec3
+/// "name". List properties other than the indices and other elements are skipped.
+bool read_ply(SurfaceMesh& mesh, const std::string& filename) {
+    using namespace ply_format;
+
+    // clear mesh
+    mesh.clear();
+
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // header
+    const char* header_end = NULL;
+    for (const char* p = begin; p + 10 <= end; ++p) {
+        if (*p == 'e' && strncmp(p, "end_header", 10) == 0 && (p == begin || p[-1] == '\n')) {
+            header_end = p + 10;
+            while (header_end < end && *header_end != '\n') ++header_end;
+            if (header_end < end) ++header_end;
+            break;
+        }
+    }
+    if (!header_end || file.size() < 3 || strncmp(begin, "ply", 3) != 0) return false;
+
+    std::vector<Ply_element> elements;
+    std::string format;
+    std::istringstream header(std::string(begin, header_end));
+    std::string line;
+    while (std::getline(header, line)) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "format") {
+            tokens >> format;
+        } else if (keyword == "element") {
+            Ply_element element;
+            tokens >> element.name >> element.count;
+            elements.push_back(element);
+        } else if (keyword == "property" && !elements.empty()) {
+            Ply_property prop;
+            std::string type;
+            tokens >> type;
+            if (type == "list") {
+                std::string count_type;
+                tokens >> count_type >> type;
+                prop.count_type = type_from_name(count_type);
+                if (prop.count_type == INVALID) return false;
+            } else {
+                prop.count_type = INVALID;
+            }
+            prop.type = type_from_name(type);
+            if (prop.type == INVALID) return false;
+            tokens >> prop.name;
+            std::vector<Ply_property>& props = elements.back().properties;
+            prop.offset = props.empty() ? 0 : props.back().offset + type_size(props.back().type);
+            props.push_back(prop);
+        }
+    }
+
+    // only the binary encodings are supported
+    bool file_is_little_endian;
+    if (format == "binary_little_endian") file_is_little_endian = true;
+    else if (format == "binary_big_endian") file_is_little_endian = false;
+    else return false;
+    const bool swap = (file_is_little_endian != host_is_little_endian());
+
+    // body, elements come in header order
+    std::vector<unsigned int> valences;
+    std::vector<SurfaceMesh::Vertex> corners;
+    std::vector<double> values;
+    Ply_element face_element;
+    std::vector< std::vector<char> > face_columns;      ///< scalar face properties as stored
+    const char* p = header_end;
+    for (size_t e=0; e<elements.size(); ++e) {
+        const Ply_element& element = elements[e];
+
+        // vertices
+        if (element.name == "vertex" && mesh.n_vertices() == 0) {
+            if (element.properties.empty() || !element.fixed_size()) return false;
+            const Ply_property& last = element.properties.back();
+            const size_t record_size = last.offset + type_size(last.type);
+            const size_t nv = element.count;
+            if (p + nv*record_size > end) return false;
+
+            const int x = element.find("x"), y = element.find("y"), z = element.find("z");
+            if (x < 0 || y < 0 || z < 0) return false;
+
+            mesh.vprops_.resize(nv);
+            Vec3* points = (Vec3*) mesh.vpoint_.data();
+
+            // the common layout (float x,y,z and nothing else) is copied as is
+            const Ply_property& px = element.properties[x];
+            const Ply_property& py = element.properties[y];
+            const Ply_property& pz = element.properties[z];
+            const bool packed = (px.type == scalar_type() && py.type == px.type && pz.type == px.type &&
+                                 py.offset == px.offset + sizeof(Scalar) && pz.offset == py.offset + sizeof(Scalar));
+            if (packed && record_size == sizeof(Vec3) && !swap) {
+                memcpy((void*) points, p, nv*sizeof(Vec3));
+            } else if (packed) {
+                for (size_t i=0; i<nv; ++i)
+                    copy_values(points + i, p + i*record_size + px.offset, 3, px.type, swap);
+            } else {
+                for (size_t i=0; i<nv; ++i) {
+                    const char* r = p + i*record_size;
+                    points[i] = Vec3(read_value(r+px.offset, px.type, swap),
+                                     read_value(r+py.offset, py.type, swap),
+                                     read_value(r+pz.offset, pz.type, swap));
+                }
+            }
+
+            // every other property (normals, colors, ...) becomes a vertex property
+            if (element.properties.size() > 3) {
+                std::vector<bool> used(element.properties.size(), false);
+                used[x] = used[y] = used[z] = true;
+                Ply_columns columns;
+                columns.swap = swap;
+                for (size_t k=0; k<element.properties.size(); ++k) {
+                    columns.base.push_back(p + element.properties[k].offset);
+                    columns.stride.push_back(record_size);
+                }
+                std::vector<SurfaceMesh::Vertex> handles(nv);
+                for (size_t i=0; i<nv; ++i) handles[i] = SurfaceMesh::Vertex((int) i);
+                read_attributes(mesh, element, used, columns, handles, "v:");
+            }
+
+            p += nv*record_size;
+        }
+
+        // faces, their scalar properties become face properties once the faces exist
+        else if (element.name == "face" && valences.empty()) {
+            int list = element.find("vertex_indices");
+            if (list < 0) list = element.find("vertex_index");
+            if (list < 0 || element.properties[list].count_type == INVALID) return false;
+            face_element = element;
+            face_columns.resize(element.properties.size());
+            valences.reserve(element.count);
+            corners.reserve(3*element.count);
+            for (size_t i=0; i<element.count; ++i) {
+                values.clear();
+                p = read_record(p, end, element, swap, list, &values, &face_columns);
+                if (!p) return false;
+                valences.push_back((unsigned int) values.size());
+                for (size_t k=0; k<values.size(); ++k)
+                    corners.push_back(SurfaceMesh::Vertex((int) values[k]));
+            }
+        }
+
+        // anything else is skipped
+        else {
+            for (size_t i=0; i<element.count; ++i) {
+                p = read_record(p, end, element, swap, -1, NULL);
+                if (!p) return false;
+            }
+        }
+    }
+
+    // faces may only reference existing vertices
+    for (size_t i=0; i<corners.size(); ++i)
+        if (corners[i].idx() < 0 || corners[i].idx() >= (int) mesh.n_vertices()) return false;
+
+    std::vector<SurfaceMesh::Face> faces;
+    mesh.add_faces(valences, corners, &faces);
+    Ply_columns columns;
+    columns.swap = swap;
+    for (size_t k=0; k<face_columns.size(); ++k) {
+        columns.base.push_back(face_columns[k].empty() ? NULL : &face_columns[k][0]);
+        columns.stride.push_back(type_size(face_element.properties[k].type));
+    }
+    read_attributes(mesh, face_element, std::vector<bool>(face_element.properties.size(), false), columns, faces, "f:");
+
+    // the vertices were added by resizing the containers directly
+    mesh.topology_changed();
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Writes a binary PLY, the inverse of read_ply: the vertex and face properties
+/// of arithmetic or Vec3 type are written along with the positions and indices.
+/// Deleted elements are skipped, the faces index the vertices as written.
+bool write_ply(const SurfaceMesh& mesh, const std::string& filename) {
+    using namespace ply_format;
+
+    FILE* out = fopen(filename.c_str(), "wb");
+    if (!out)
+        return false;
+
+    SurfaceMesh::Vertex_property<Vec3> points = mesh.get_vertex_property<Vec3>("v:point");
+    const bool swap = !host_is_little_endian();
+
+    // every vertex and face property PLY can store is written after the positions/indices
+    const std::vector<Ply_attribute> vattributes =
+            collect_attributes<SurfaceMesh::Vertex>(mesh, mesh.vertex_properties(), mesh.vertices_size(), {"x", "y", "z"});
+    const std::vector<Ply_attribute> fattributes =
+            collect_attributes<SurfaceMesh::Face>(mesh, mesh.face_properties(), mesh.faces_size(), {"vertex_indices"});
+
+    // vertices are numbered in the order they are written, which skips deleted ones
+    std::vector<int32_t> index(mesh.vertices_size(), -1);
+    int32_t nv = 0, nf = 0;
+    unsigned int max_valence = 0;
+    for (SurfaceMesh::Vertex_iterator vit=mesh.vertices_begin(); vit!=mesh.vertices_end(); ++vit)
+        index[(*vit).idx()] = nv++;
+    for (SurfaceMesh::Face_iterator fit=mesh.faces_begin(); fit!=mesh.faces_end(); ++fit, ++nf)
+        max_valence = std::max(max_valence, mesh.valence(*fit));
+
+    // the list length is a uchar unless a face has 256 vertices or more
+    const Type count_type = (max_valence < 256) ? UINT8 : UINT32;
+    const size_t count_size = type_size(count_type);
+
+    // header
+    const char* scalar = type_name(scalar_type());
+    fprintf(out, "ply\nformat binary_little_endian 1.0\ncomment PLY export from SurfaceMesh\n");
+    fprintf(out, "element vertex %d\nproperty %s x\nproperty %s y\nproperty %s z\n", nv, scalar, scalar, scalar);
+    size_t vertex_size = sizeof(Vec3);
+    for (size_t a=0; a<vattributes.size(); ++a) {
+        for (size_t k=0; k<vattributes[a].names.size(); ++k)
+            fprintf(out, "property %s %s\n", type_name(vattributes[a].type), vattributes[a].names[k].c_str());
+        vertex_size += vattributes[a].size();
+    }
+    fprintf(out, "element face %d\nproperty list %s int vertex_indices\n", nf, type_name(count_type));
+    size_t face_size = 0;
+    for (size_t a=0; a<fattributes.size(); ++a) {
+        for (size_t k=0; k<fattributes[a].names.size(); ++k)
+            fprintf(out, "property %s %s\n", type_name(fattributes[a].type), fattributes[a].names[k].c_str());
+        face_size += fattributes[a].size();
+    }
+    fprintf(out, "end_header\n");
+
+    // vertices, positions alone are written straight from the property array.
+    // otherwise every record gathers the bytes of the element from each array
+    if (vattributes.empty() && !swap && (unsigned int) nv == mesh.vertices_size()) {
+        fwrite((const char*) points.data(), sizeof(Vec3), nv, out);
+    } else {
+        std::vector<char> buffer(nv * vertex_size);
+        char* r = buffer.empty() ? NULL : &buffer[0];
+        for (SurfaceMesh::Vertex_iterator vit=mesh.vertices_begin(); vit!=mesh.vertices_end(); ++vit) {
+            copy_values(r, &points[*vit], 3, scalar_type(), swap);
+            r += sizeof(Vec3);
+            for (size_t a=0; a<vattributes.size(); ++a) {
+                const size_t size = vattributes[a].size();
+                copy_values(r, vattributes[a].values() + (*vit).idx()*size, vattributes[a].names.size(), vattributes[a].type, swap);
+                r += size;
+            }
+        }
+        if (!buffer.empty()) fwrite(&buffer[0], 1, buffer.size(), out);
+    }
+
+    // faces, encoded in one buffer
+    std::vector<char> buffer;
+    buffer.reserve(nf * (count_size + 3*sizeof(int32_t) + face_size));
+    for (SurfaceMesh::Face_iterator fit=mesh.faces_begin(); fit!=mesh.faces_end(); ++fit) {
+        const uint32_t n = mesh.valence(*fit);
+        const size_t record = buffer.size();
+        buffer.resize(record + count_size + n*sizeof(int32_t) + face_size);
+        char* r = &buffer[record];
+        if (count_type == UINT8) *r = (char) (uint8_t) n;
+        else copy_values(r, &n, 1, UINT32, swap);
+        r += count_size;
+        SurfaceMesh::Vertex_around_face_circulator fvit=mesh.vertices(*fit), fvend=fvit;
+        do {
+            const int32_t idx = index[(*fvit).idx()];
+            assert(idx >= 0);
+            copy_values(r, &idx, 1, INT32, swap);
+            r += sizeof(int32_t);
+        } while (++fvit != fvend);
+        for (size_t a=0; a<fattributes.size(); ++a) {
+            const size_t size = fattributes[a].size();
+            copy_values(r, fattributes[a].values() + (*fit).idx()*size, fattributes[a].names.size(), fattributes[a].type, swap);
+            r += size;
+        }
+    }
+    if (!buffer.empty()) fwrite(&buffer[0], 1, buffer.size(), out);
+
+    fclose(out);
+    return true;
+}
+
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
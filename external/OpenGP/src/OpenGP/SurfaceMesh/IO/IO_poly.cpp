@@ -71,6 +71,9 @@ bool read_poly(SurfaceMesh& mesh, const std::string& filename)
     n_items = fread((char*)point.data(), sizeof(Vec3),                               nv, in);
     (void)n_items; //< unused warning
 
+    // the connectivity was read into the arrays directly
+    mesh.topology_changed();
+
     fclose(in);
     return true;
 }
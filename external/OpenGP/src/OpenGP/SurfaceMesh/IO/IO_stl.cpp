@@ -14,10 +14,15 @@
 
 #include <OpenGP/SurfaceMesh/SurfaceMesh.h>
 #include <OpenGP/SurfaceMesh/IO/IO.h>
+#include <OpenGP/util/mapped_file.h>
+#include <OpenGP/util/parallel.h>
 
+#include <atomic>
+#include <cmath>
 #include <cstdio>
-#include <cfloat>
-#include <map>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
 
 
 //== NAMESPACES ===============================================================
@@ -32,171 +37,250 @@ namespace OpenGP {
 //-----------------------------------------------------------------------------
 
 
-// helper class for STL reader
-class CmpVec{
-    typedef Vec3 Normal;
-    typedef Vec3 TextureCoordinate;
-public:
+/// Helpers for weld_triangle_soup
+namespace stl_weld {
 
-    CmpVec(float _eps=FLT_MIN) : eps_(_eps) {}
+/// integer key of a point: its bit pattern (exact welding) or its grid cell
+struct Cell
+{
+    int32_t x, y, z;
+    bool operator==(const Cell& other) const { return x == other.x && y == other.y && z == other.z; }
+};
 
-    bool operator()(const Vec3& v0, const Vec3& v1) const
-    {
-        if (fabs(v0[0] - v1[0]) <= eps_)
-        {
-            if (fabs(v0[1] - v1[1]) <= eps_)
-            {
-                return (v0[2] < v1[2] - eps_);
+HEADERONLY_INLINE int32_t bits(Scalar x) {
+    float f = float(x) + 0.0f; ///< -0 and +0 weld
+    int32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+HEADERONLY_INLINE int32_t cell_coordinate(Scalar x, Scalar inv_size) {
+    Scalar c = std::floor(x * inv_size);
+    c = std::max<Scalar>(-2147483647.0f, std::min<Scalar>(2147483647.0f, c));
+    return (c == c) ? int32_t(c) : 0;
+}
+
+HEADERONLY_INLINE uint32_t hash(const Cell& c) {
+    uint64_t h = uint64_t(uint32_t(c.x)) * 0x9E3779B97F4A7C15ull;
+    h ^= uint64_t(uint32_t(c.y)) * 0xC2B2AE3D27D4EB4Full;
+    h ^= uint64_t(uint32_t(c.z)) * 0x165667B19E3779F9ull;
+    return uint32_t(h ^ (h >> 29) ^ (h >> 47));
+}
+
+/// Lock-free open addressing table: cell -> smallest corner index in the cell
+class Table
+{
+public:
+    explicit Table(size_t n) {
+        size_t capacity = 16;
+        while (capacity < 2*n) capacity *= 2;
+        mask_ = capacity - 1;
+        slots_ = std::vector<std::atomic<int> >(capacity);
+        parallel_for(0, (int) capacity, [this](int i){ slots_[i].store(-1); });
+    }
+
+    /// inserts corner \c i (in cell \c c), \c cell(j) returns the cell of corner j
+    template <class CellOf>
+    void insert(int i, const Cell& c, CellOf cell) {
+        for (size_t s = hash(c) & mask_; ; s = (s+1) & mask_) {
+            int current = slots_[s].load();
+            while (current == -1 && !slots_[s].compare_exchange_weak(current, i)) {}
+            if (current == -1) return;
+            if (cell(current) == c) {
+                while (i < current && !slots_[s].compare_exchange_weak(current, i)) {}
+                return;
             }
-            else return (v0[1] < v1[1] - eps_);
         }
-        else return (v0[0] < v1[0] - eps_);
+    }
+
+    /// smallest corner index in cell \c c, -1 if the cell is empty
+    template <class CellOf>
+    int find(const Cell& c, CellOf cell) const {
+        for (size_t s = hash(c) & mask_; ; s = (s+1) & mask_) {
+            int current = slots_[s].load();
+            if (current == -1 || cell(current) == c) return current;
+        }
     }
 
 private:
-    float eps_;
+    std::vector<std::atomic<int> > slots_;
+    size_t mask_;
 };
 
+} // namespace stl_weld
+
 
 //-----------------------------------------------------------------------------
 
 
-bool read_stl(SurfaceMesh& mesh, const std::string& filename){
-    // typedef Vec3 Normal;
-    // typedef Vec3 TextureCoordinate;
+Weld_report weld_triangle_soup(SurfaceMesh& mesh, const std::vector<Vec3>& corners, Scalar tolerance)
+{
+    using namespace stl_weld;
+    const int n = (int) (corners.size() / 3 * 3);
+    const bool exact = !(tolerance > 0);
+    const Scalar inv_size = exact ? 0 : 1 / tolerance;
+
+    auto cell = [&](int i) {
+        const Vec3& p = corners[i];
+        Cell c;
+        if (exact) { c.x = bits(p[0]); c.y = bits(p[1]); c.z = bits(p[2]); }
+        else { c.x = cell_coordinate(p[0], inv_size); c.y = cell_coordinate(p[1], inv_size); c.z = cell_coordinate(p[2], inv_size); }
+        return c;
+    };
+
+    // every corner first maps to the smallest corner of its cell
+    Table table(n);
+    parallel_for(0, n, [&](int i){ table.insert(i, cell(i), cell); });
+    std::vector<int> representative(n);
+    parallel_for(0, n, [&](int i){ representative[i] = table.find(cell(i), cell); });
+
+    // cells whose first corners are within tolerance merge into the smallest one
+    if (!exact) {
+        std::vector<int> target(n);
+        const Scalar tolerance2 = tolerance * tolerance;
+        parallel_for(0, n, [&](int i){
+            target[i] = i;
+            if (representative[i] != i) return;
+            const Cell c = cell(i);
+            for (int dx=-1; dx<=1; ++dx) for (int dy=-1; dy<=1; ++dy) for (int dz=-1; dz<=1; ++dz) {
+                Cell neighbor = {c.x+dx, c.y+dy, c.z+dz};
+                int j = table.find(neighbor, cell);
+                if (j >= 0 && j < target[i] && (corners[j] - corners[i]).squaredNorm() <= tolerance2)
+                    target[i] = j;
+            }
+        });
+        // targets have smaller indices, one ascending pass resolves the chains
+        for (int i=0; i<n; ++i)
+            if (representative[i] == i) representative[i] = representative[target[i]];
+        parallel_for(0, n, [&](int i){ target[i] = representative[representative[i]]; });
+        representative.swap(target);
+    }
 
-    char                            line[100], *c;
-    unsigned int                    i, nT;
-    Vec3                            p;
-    SurfaceMesh::Vertex               v;
-    std::vector<SurfaceMesh::Vertex>  vertices(3);
-    size_t n_items(0);
+    // vertices in order of their first corner
+    Weld_report report = {0, 0, 0};
+    std::vector<SurfaceMesh::Vertex> vertex_of(n);
+    mesh.reserve(n/6 + 1, n/2, n/3);
+    for (int i=0; i<n; ++i) {
+        if (representative[i] == i) {
+            vertex_of[i] = mesh.add_vertex(corners[i]);
+            ++report.n_vertices;
+        }
+    }
 
-    CmpVec comp(FLT_MIN);
-    std::map<Vec3, SurfaceMesh::Vertex, CmpVec>            vMap(comp);
-    std::map<Vec3, SurfaceMesh::Vertex, CmpVec>::iterator  vMapIt;
+    // faces, dropping the ones degenerated by the welding
+    std::vector<unsigned int> valences;
+    std::vector<SurfaceMesh::Vertex> face_vertices;
+    valences.reserve(n/3);
+    face_vertices.reserve(n);
+    for (int t=0; t<n; t+=3) {
+        SurfaceMesh::Vertex a = vertex_of[representative[t]];
+        SurfaceMesh::Vertex b = vertex_of[representative[t+1]];
+        SurfaceMesh::Vertex c = vertex_of[representative[t+2]];
+        if (a == b || a == c || b == c) { ++report.n_degenerate; continue; }
+        valences.push_back(3);
+        face_vertices.push_back(a);
+        face_vertices.push_back(b);
+        face_vertices.push_back(c);
+    }
+    std::vector<int>().swap(representative);
+    std::vector<SurfaceMesh::Vertex>().swap(vertex_of);
 
-    // clear mesh
-    mesh.clear();
+    std::vector<SurfaceMesh::Face> faces;
+    mesh.add_faces(valences, face_vertices, &faces);
+    for (size_t i=0; i<faces.size(); ++i)
+        if (!faces[i].is_valid()) ++report.n_nonmanifold;
 
-    // open file (in ASCII mode)
-    FILE* in = fopen(filename.c_str(), "r");
-    if (!in) return false;
+    return report;
+}
 
 
-    // ASCII or binary STL?
-    c = fgets(line, 6, in);
-    assert(c != NULL);
-    const bool binary = ((strncmp(line, "SOLID", 5) != 0) &&
-                         (strncmp(line, "solid", 5) != 0));
+//-----------------------------------------------------------------------------
 
 
-    // parse binary STL
-    if (binary)
-    {
-        // re-open file in binary mode
-        fclose(in);
-        in = fopen(filename.c_str(), "rb");
-        if (!in) return false;
+bool read_stl(SurfaceMesh& mesh, const std::string& filename)
+{
+    return read_stl(mesh, filename, 0, NULL);
+}
 
-        // skip dummy header
-        n_items = fread(line, 1, 80, in);
-        assert(n_items > 0);
 
-        // read number of triangles
-        read(in, nT);
+//-----------------------------------------------------------------------------
 
-        // read triangles
-        while (nT)
-        {
+
+bool read_stl(SurfaceMesh& mesh, const std::string& filename, Scalar tolerance, Weld_report* report)
+{
+    std::vector<Vec3> corners;
+
+    // clear mesh
+    mesh.clear();
+
+    // map the whole file
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* data = file.data();
+    const size_t size = file.size();
+
+    // ASCII or binary STL? (binary files may start with "solid" too, their size tells)
+    uint32_t nT = 0;
+    if (size >= 84) memcpy(&nT, data+80, sizeof(nT));
+    const bool binary = (size >= 84 && size == 84 + 50*size_t(nT)) ||
+                        (size < 5) ||
+                        ((strncmp(data, "SOLID", 5) != 0) &&
+                         (strncmp(data, "solid", 5) != 0));
+
+
+    // parse binary STL: 80 bytes header, triangle count, 50 bytes per triangle
+    if (binary)
+    {
+        if (size < 84 + 50*size_t(nT)) return false;
+        corners.resize(3*size_t(nT));
+        parallel_for(0, (int) nT, [&](int t){
             // skip triangle normal
-            n_items = fread(line, 1, 12, in);
-            assert(n_items > 0);
-            // triangle's vertices
-            for (i=0; i<3; ++i)
+            const char* p = data + 84 + 50*size_t(t) + 12;
+            for (int i=0; i<3; ++i)
             {
-                read(in, p);
-
-                // has vector been referenced before?
-                if ((vMapIt=vMap.find(p)) == vMap.end())
-                {
-                    // No : add vertex and remember idx/vector mapping
-                    v = mesh.add_vertex((Vec3)p);
-                    vertices[i] = v;
-                    vMap[p] = v;
-                }
-                else
-                {
-                    // Yes : get index from map
-                    vertices[i] = vMapIt->second;
-                }
+                float xyz[3];
+                memcpy(xyz, p + 12*i, sizeof(xyz));
+                corners[3*t+i] = Vec3(xyz[0], xyz[1], xyz[2]);
             }
-
-            // Add face only if it is not degenerated
-            if ((vertices[0] != vertices[1]) &&
-                (vertices[0] != vertices[2]) &&
-                (vertices[1] != vertices[2]))
-                mesh.add_face(vertices);
-
-            n_items = fread(line, 1, 2, in);
-            assert(n_items > 0);
-            --nT;
-        }
+        });
     }
 
 
-    // parse ASCII STL
+    // parse ASCII STL: three "vertex x y z" lines after each "outer loop"
     else
     {
-        // parse line by line
-        while (in && !feof(in) && fgets(line, 100, in))
+        const char* end = data + size;
+        char line[100], *c;
+        for (const char* p = data; p < end; )
         {
+            // copy one line (null terminated, at most 99 characters)
+            size_t n = 0;
+            while (p < end && *p != '\n' && n < sizeof(line)-1) line[n++] = *p++;
+            while (p < end && *p != '\n') ++p;
+            if (p < end) ++p;
+            line[n] = '\0';
+
             // skip white-space
             for (c=line; isspace(*c) && *c!='\0'; ++c) {};
 
-            // face begins
-            if ((strncmp(c, "outer", 5) == 0) ||
-                (strncmp(c, "OUTER", 5) == 0))
+            if ((strncmp(c, "vertex", 6) == 0) ||
+                (strncmp(c, "VERTEX", 6) == 0))
             {
-                // read three vertices
-                for (i=0; i<3; ++i)
-                {
-                    // read line
-                    c = fgets(line, 100, in);
-                    assert(c != NULL);
-
-                    // skip white-space
-                    for (c=line; isspace(*c) && *c!='\0'; ++c) {};
-
-                    // read x, y, z
-                    sscanf(c+6, "%f %f %f", &p[0], &p[1], &p[2]);
-
-                    // has vector been referenced before?
-                    if ((vMapIt=vMap.find(p)) == vMap.end())
-                    {
-                        // No : add vertex and remember idx/vector mapping
-                        v = mesh.add_vertex((Vec3)p);
-                        vertices[i] = v;
-                        vMap[p] = v;
-                    }
-                    else
-                    {
-                        // Yes : get index from map
-                        vertices[i] = vMapIt->second;
-                    }
-                }
-
-                // Add face only if it is not degenerated
-                if ((vertices[0] != vertices[1]) &&
-                    (vertices[0] != vertices[2]) &&
-                    (vertices[1] != vertices[2]))
-                    mesh.add_face(vertices);
+                float x=0, y=0, z=0;
+                sscanf(c+6, "%f %f %f", &x, &y, &z);
+                corners.push_back(Vec3(x, y, z));
             }
         }
     }
+    file.close();
+
 
+    // weld and build the connectivity
+    Weld_report weld = weld_triangle_soup(mesh, corners, tolerance);
+    if (weld.n_nonmanifold > 0)
+        std::cerr << "[read_stl] " << weld.n_nonmanifold << " non-manifold triangles rejected" << std::endl;
+    if (report) *report = weld;
 
-    fclose(in);
     return true;
 }
 
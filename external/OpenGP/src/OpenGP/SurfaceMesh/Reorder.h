@@ -0,0 +1,155 @@
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License Version 2
+// as published by the Free Software Foundation.
+//
+// This file is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with OpenGP.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <OpenGP/SurfaceMesh/SurfaceMesh.h>
+#include <OpenGP/util/parallel.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Space filling curves used to order mesh elements
+enum Space_filling_curve
+{
+    NO_CURVE,       ///< keep the current order
+    MORTON_CURVE,   ///< Z-order, cheapest to evaluate
+    HILBERT_CURVE   ///< no jumps between consecutive cells, best locality
+};
+
+/// Position of the grid cell \c x (21 bits per coordinate) along \c curve
+inline uint64_t space_filling_curve_key(uint32_t x[3], Space_filling_curve curve){
+    const int BITS = 21;
+    if (curve == HILBERT_CURVE) {
+        ///--- coordinates to the "transposed" Hilbert index (Skilling, AIP Conf. Proc. 707, 2004)
+        for (uint32_t q = 1u << (BITS-1); q > 1; q >>= 1) {
+            const uint32_t p = q - 1;
+            for (int i = 0; i < 3; ++i) {
+                if (x[i] & q) {
+                    x[0] ^= p;
+                } else {
+                    const uint32_t t = (x[0] ^ x[i]) & p;
+                    x[0] ^= t;
+                    x[i] ^= t;
+                }
+            }
+        }
+        x[1] ^= x[0];
+        x[2] ^= x[1];
+        uint32_t t = 0;
+        for (uint32_t q = 1u << (BITS-1); q > 1; q >>= 1)
+            if (x[2] & q) t ^= q - 1;
+        for (int i = 0; i < 3; ++i) x[i] ^= t;
+    }
+    ///--- interleave the bits, most significant first
+    uint64_t key = 0;
+    for (int b = BITS-1; b >= 0; --b)
+        for (int i = 0; i < 3; ++i)
+            key = (key << 1) | ((x[i] >> b) & 1u);
+    return key;
+}
+
+/// Order of \c points along \c curve over their bounding box (ties keep the input order)
+inline std::vector<unsigned int> space_filling_curve_order(const std::vector<Vec3>& points, Space_filling_curve curve){
+    const int n = (int) points.size();
+    std::vector<unsigned int> order(n);
+    for (int i = 0; i < n; ++i) order[i] = i;
+    if (curve == NO_CURVE || n == 0) return order;
+
+    Eigen::AlignedBox<Scalar,3> box;
+    for (int i = 0; i < n; ++i) box.extend(points[i]);
+    Vec3 scale;
+    for (int k = 0; k < 3; ++k) scale[k] = ((1u << 21) - 1) / std::max(box.sizes()[k], Scalar(1e-20));
+
+    std::vector<uint64_t> keys(n);
+    parallel_for(0, n, [&](int i){
+        Vec3 c = (points[i] - box.min()).cwiseProduct(scale);
+        uint32_t x[3];
+        for (int k = 0; k < 3; ++k) x[k] = (uint32_t) std::min<Scalar>(std::max<Scalar>(c[k], 0), (1u << 21) - 1);
+        keys[i] = space_filling_curve_key(x, curve);
+    });
+    std::sort(order.begin(), order.end(), [&keys](unsigned int a, unsigned int b){
+        return (keys[a] != keys[b]) ? keys[a] < keys[b] : a < b;
+    });
+    return order;
+}
+
+/// Reorders the vertices (by position) and faces (by centroid) of \c mesh along
+/// \c curve, edges follow the first face they belong to. Neighboring elements
+/// then sit close in memory, which speeds up traversals of scanned or welded
+/// meshes and the vertex fetch of their GPU copies. All properties follow their
+/// elements, deleted elements are garbage collected first. \c map (if given)
+/// receives the new handle of every old one.
+/// \sa SurfaceMesh::permute
+inline void reorder_spatially(SurfaceMesh& mesh, Space_filling_curve curve = HILBERT_CURVE, SurfaceMesh::Handle_map* map = NULL){
+    typedef SurfaceMesh::Vertex Vertex;
+    typedef SurfaceMesh::Edge Edge;
+    typedef SurfaceMesh::Face Face;
+    if (curve == NO_CURVE) return;
+    SurfaceMesh::Handle_map collected;
+    mesh.garbage_collection(map ? &collected : NULL);
+
+    const int nv = mesh.vertices_size();
+    const int nf = mesh.faces_size();
+    const int ne = mesh.edges_size();
+
+    ///--- vertices by position
+    std::vector<Vec3> points(nv);
+    parallel_for(0, nv, [&](int i){ points[i] = mesh.position(Vertex(i)); });
+    std::vector<unsigned int> order = space_filling_curve_order(points, curve);
+    std::vector<Vertex> vertices(nv);
+    for (int i = 0; i < nv; ++i) vertices[i] = Vertex(order[i]);
+
+    ///--- faces by centroid
+    points.resize(nf);
+    parallel_for(0, nf, [&](int i){
+        Vec3 c(0,0,0);
+        unsigned int n = 0;
+        for (Vertex v : mesh.vertices(Face(i))) { c += mesh.position(v); ++n; }
+        points[i] = c / (Scalar) std::max(n, 1u);
+    });
+    order = space_filling_curve_order(points, curve);
+    std::vector<Face> faces(nf);
+    for (int i = 0; i < nf; ++i) faces[i] = Face(order[i]);
+
+    ///--- edges in order of first use by the (reordered) faces
+    std::vector<Edge> edges;
+    edges.reserve(ne);
+    std::vector<char> placed(ne, 0);
+    for (Face f : faces) {
+        for (SurfaceMesh::Halfedge h : mesh.halfedges(f)) {
+            const Edge e = mesh.edge(h);
+            if (!placed[e.idx()]) { placed[e.idx()] = 1; edges.push_back(e); }
+        }
+    }
+    for (int i = 0; i < ne; ++i)
+        if (!placed[i]) edges.push_back(Edge(i));
+
+    mesh.permute(vertices, edges, faces, map);
+
+    ///--- map handles from before the garbage collection
+    if (map) {
+        for (size_t i = 0; i < collected.vertices.size(); ++i)  collected.vertices[i]  = (*map)[collected.vertices[i]];
+        for (size_t i = 0; i < collected.halfedges.size(); ++i) collected.halfedges[i] = (*map)[collected.halfedges[i]];
+        for (size_t i = 0; i < collected.edges.size(); ++i)     collected.edges[i]     = (*map)[collected.edges[i]];
+        for (size_t i = 0; i < collected.faces.size(); ++i)     collected.faces[i]     = (*map)[collected.faces[i]];
+        std::swap(*map, collected);
+    }
+}
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
@@ -12,8 +12,15 @@
 
 #include "Loop.h"
 #include <OpenGP/MLogger.h>
+#include <OpenGP/util/parallel.h>
+#include <algorithm>
+#include <vector>
 
 void SurfaceMeshSubdivideLoop::exec(OpenGP::SurfaceMesh& mesh){
+    exec(mesh, 1);
+}
+
+void SurfaceMeshSubdivideLoop::refine_incremental(OpenGP::SurfaceMesh& mesh){
     /// TODO: other pre-conditions?
     CHECK(mesh.is_triangle_mesh());
 
@@ -23,12 +30,14 @@ void SurfaceMeshSubdivideLoop::exec(OpenGP::SurfaceMesh& mesh){
     int nf = mesh.n_faces();
     mesh.reserve(nv+ne, 2*ne+3*nf, 4*nf);
 
-    // get properties
-    VertexProperty<Point> points = mesh.vertex_property<Point>("v:point");
-    VertexProperty<Point> vpoint = mesh.add_vertex_property<Point>("loop:vpoint");
-    EdgeProperty<Point>   epoint = mesh.add_edge_property<Point>("loop:epoint");
-    VertexProperty<bool>  vfeature = mesh.get_vertex_property<bool>("v:feature");
-    EdgeProperty<bool>    efeature = mesh.get_edge_property<bool>("e:feature");
+    // get properties (once per level, the keys spare the search by name)
+    static const OpenGP::Property_key<Point> VPOINT("v:point"), LOOP_VPOINT("loop:vpoint"), LOOP_EPOINT("loop:epoint");
+    static const OpenGP::Property_key<bool>  VFEATURE("v:feature"), EFEATURE("e:feature");
+    VertexProperty<Point> points = mesh.vertex_property(VPOINT);
+    VertexProperty<Point> vpoint = mesh.add_vertex_property(LOOP_VPOINT);
+    EdgeProperty<Point>   epoint = mesh.add_edge_property(LOOP_EPOINT);
+    VertexProperty<bool>  vfeature = mesh.get_vertex_property(VFEATURE);
+    EdgeProperty<bool>    efeature = mesh.get_edge_property(EFEATURE);
 
     // compute vertex positions
     for(Vertex v: mesh.vertices()){
@@ -132,3 +141,337 @@ void SurfaceMeshSubdivideLoop::exec(OpenGP::SurfaceMesh& mesh){
     mesh.remove_vertex_property(vpoint);
     mesh.remove_edge_property(epoint);
 }
+
+//-----------------------------------------------------------------------------
+
+/// Triangle mesh in index form. Edge k of face f joins its corners k and k+1,
+/// the edge rows list the two end vertices and the (up to) two incident faces
+/// (-1 on the boundary), the vertex rows list the incident edges (CSR).
+struct SurfaceMeshSubdivideLoop::Level{
+    std::vector<Point> points;
+    std::vector<int> faces;                   ///< 3 vertices per face
+    std::vector<int> face_edges;              ///< 3 edges per face
+    std::vector<int> edges;                   ///< 2 vertices per edge
+    std::vector<int> edge_faces;              ///< 2 faces per edge
+    std::vector<int> vertex_edge_offsets;     ///< n_vertices()+1 offsets in vertex_edges
+    std::vector<int> vertex_edges;
+
+    int n_vertices() const { return (int) points.size(); }
+    int n_edges() const { return (int) edges.size() / 2; }
+    int n_faces() const { return (int) faces.size() / 3; }
+    bool is_boundary(int e) const { return edge_faces[2*e] < 0 || edge_faces[2*e+1] < 0; }
+    /// local index (0,1,2) of edge \c e in face \c f
+    int corner(int f, int e) const { return (face_edges[3*f] == e) ? 0 : (face_edges[3*f+1] == e) ? 1 : 2; }
+    /// the vertex of edge \c e that is not \c v
+    int other(int e, int v) const { return edges[2*e] + edges[2*e+1] - v; }
+    /// halfedge of edge \c e leaving \c v (halfedge 2e goes from edges[2e] to edges[2e+1])
+    int outgoing(int e, int v) const { return 2*e + ((edges[2*e] == v) ? 0 : 1); }
+    /// halfedge of the boundary edge \c e without face (opposite to the one inside the face)
+    int boundary_halfedge(int e) const {
+        const int f = (edge_faces[2*e] >= 0) ? edge_faces[2*e] : edge_faces[2*e+1];
+        return outgoing(e, faces[3*f + corner(f,e)]) ^ 1;
+    }
+};
+
+bool SurfaceMeshSubdivideLoop::has_fast_path(const OpenGP::SurfaceMesh& mesh){
+    if (mesh.n_vertices() != mesh.vertices_size() || mesh.n_edges() != mesh.edges_size() ||
+        mesh.n_faces() != mesh.faces_size()) return false; ///< deleted elements
+    static const OpenGP::Property_key<bool> VFEATURE("v:feature"), EFEATURE("e:feature");
+    if (mesh.get_vertex_property(VFEATURE)) return false;
+    if (mesh.get_edge_property(EFEATURE)) return false;
+    // assign() renumbers faces (4f+k), edges (2e+s) and halfedges; only the
+    // built-in properties are rebuilt and the normals recomputed by exec(),
+    // any other would be left scrambled
+    for (const std::string& name : mesh.halfedge_properties())
+        if (name != "h:connectivity") return false;
+    for (const std::string& name : mesh.edge_properties())
+        if (name != "e:deleted") return false;
+    for (const std::string& name : mesh.face_properties())
+        if (name != "f:connectivity" && name != "f:deleted" && name != "f:normal") return false;
+    for (Vertex v : mesh.vertices())
+        if (!mesh.is_manifold(v)) return false;
+    return true;
+}
+
+void SurfaceMeshSubdivideLoop::extract(const OpenGP::SurfaceMesh& mesh, Level& level){
+    const int nv = mesh.vertices_size();
+    const int ne = mesh.edges_size();
+    const int nf = mesh.faces_size();
+    VertexProperty<Point> points = mesh.get_vertex_property<Point>("v:point");
+
+    level.points.assign(points.data(), points.data() + nv);
+
+    level.edges.resize(2*ne);
+    level.edge_faces.resize(2*ne);
+    OpenGP::parallel_for(0, ne, [&](int e){
+        Halfedge h = mesh.halfedge(Edge(e), 0);
+        level.edges[2*e]   = mesh.from_vertex(h).idx();
+        level.edges[2*e+1] = mesh.to_vertex(h).idx();
+        level.edge_faces[2*e]   = mesh.face(h).idx();
+        level.edge_faces[2*e+1] = mesh.face(mesh.opposite_halfedge(h)).idx();
+    });
+
+    level.faces.resize(3*nf);
+    level.face_edges.resize(3*nf);
+    OpenGP::parallel_for(0, nf, [&](int f){
+        Halfedge h = mesh.halfedge(Face(f));
+        for (int k=0; k<3; ++k, h = mesh.next_halfedge(h)) {
+            level.faces[3*f+k] = mesh.from_vertex(h).idx();
+            level.face_edges[3*f+k] = mesh.edge(h).idx();
+        }
+    });
+
+    level.vertex_edge_offsets.assign(nv+1, 0);
+    OpenGP::parallel_for(0, nv, [&](int v){
+        level.vertex_edge_offsets[v+1] = mesh.is_isolated(Vertex(v)) ? 0 : mesh.valence(Vertex(v));
+    });
+    for (int v=0; v<nv; ++v)
+        level.vertex_edge_offsets[v+1] += level.vertex_edge_offsets[v];
+    level.vertex_edges.resize(level.vertex_edge_offsets[nv]);
+    OpenGP::parallel_for(0, nv, [&](int v){
+        int i = level.vertex_edge_offsets[v];
+        if (!mesh.is_isolated(Vertex(v)))
+            for (Halfedge h : mesh.halfedges(Vertex(v)))
+                level.vertex_edges[i++] = mesh.edge(h).idx();
+    });
+}
+
+void SurfaceMeshSubdivideLoop::refine(const Level& coarse, Level& fine){
+    const int nv = coarse.n_vertices();
+    const int ne = coarse.n_edges();
+    const int nf = coarse.n_faces();
+
+    // vertex v keeps its index, edge e gets the new vertex nv+e and is split into
+    // the edges 2e and 2e+1, face f gets the inner edges 2ne+3f+k (joining the
+    // points of its edges k and k+1) and is split into the faces 4f+k (corner k)
+    // and 4f+3 (center)
+    fine.points.resize(nv + ne);
+    fine.faces.resize(3*4*nf);
+    fine.face_edges.resize(3*4*nf);
+    fine.edges.resize(2*(2*ne + 3*nf));
+    fine.edge_faces.resize(2*(2*ne + 3*nf));
+
+    // compute vertex positions
+    OpenGP::parallel_for(0, nv, [&](int v){
+        const int begin = coarse.vertex_edge_offsets[v];
+        const int end = coarse.vertex_edge_offsets[v+1];
+        const Point& pv = coarse.points[v];
+
+        if ( /*isolated vertex?*/ begin == end) {
+            fine.points[v] = pv;
+            return;
+        }
+
+        bool boundary = false;
+        for (int i=begin; i<end && !boundary; ++i)
+            boundary = coarse.is_boundary(coarse.vertex_edges[i]);
+
+        if ( /*boundary vertex?*/ boundary) {
+            Point p = pv;
+            p *= 6.0;
+            for (int i=begin; i<end; ++i)
+                if (coarse.is_boundary(coarse.vertex_edges[i]))
+                    p += coarse.points[coarse.other(coarse.vertex_edges[i], v)];
+            p *= 0.125;
+            fine.points[v] = p;
+        }
+
+        // interior vertex
+        else {
+            Point p = Point::Zero();
+            Scalar inv_k = 1.0 / (end - begin);
+            for (int i=begin; i<end; ++i)
+                p += inv_k * coarse.points[coarse.other(coarse.vertex_edges[i], v)];
+            Scalar beta = (0.625 - pow(0.375 + 0.25*cos(2.0*M_PI*inv_k), 2.0));
+
+            fine.points[v] = pv*(Scalar)(1.0-beta) + beta*p;
+        }
+    });
+
+    // compute edge positions, split edges
+    OpenGP::parallel_for(0, ne, [&](int e){
+        const Point& a = coarse.points[coarse.edges[2*e]];
+        const Point& b = coarse.points[coarse.edges[2*e+1]];
+        if ( /*boundary edge?*/ coarse.is_boundary(e)) {
+            fine.points[nv+e] = (a + b) * Scalar(0.5);
+        }
+        else /*interior edge*/ {
+            const int f0 = coarse.edge_faces[2*e];
+            const int f1 = coarse.edge_faces[2*e+1];
+            Point p = a;
+            p += b;
+            p *= 3.0;
+            p += coarse.points[coarse.faces[3*f0 + (coarse.corner(f0,e)+2)%3]];
+            p += coarse.points[coarse.faces[3*f1 + (coarse.corner(f1,e)+2)%3]];
+            p *= 0.125;
+            fine.points[nv+e] = p;
+        }
+
+        // half 2e+s joins the end vertex s to the new vertex, it lies in the
+        // corner faces of that vertex
+        for (int s=0; s<2; ++s) {
+            const int v = coarse.edges[2*e+s];
+            fine.edges[2*(2*e+s)]   = v;
+            fine.edges[2*(2*e+s)+1] = nv+e;
+            for (int t=0; t<2; ++t) {
+                const int f = coarse.edge_faces[2*e+t];
+                int fine_face = -1;
+                if (f >= 0) {
+                    const int k = coarse.corner(f, e);
+                    fine_face = 4*f + ((coarse.faces[3*f+k] == v) ? k : (k+1)%3);
+                }
+                fine.edge_faces[2*(2*e+s)+t] = fine_face;
+            }
+        }
+    });
+
+    // split faces
+    OpenGP::parallel_for(0, nf, [&](int f){
+        int v[3], m[3], half[3][2], inner[3];
+        for (int k=0; k<3; ++k) {
+            const int e = coarse.face_edges[3*f+k];
+            v[k] = coarse.faces[3*f+k];
+            m[k] = nv + e;
+            half[k][0] = 2*e + ((coarse.edges[2*e] == v[k]) ? 0 : 1);  // half of edge k at corner k
+            half[k][1] = 2*e + ((coarse.edges[2*e] == v[k]) ? 1 : 0);  // half of edge k at corner k+1
+            inner[k] = 2*ne + 3*f + k;
+        }
+
+        for (int k=0; k<3; ++k) {
+            const int k1 = (k+1)%3, k2 = (k+2)%3;
+
+            // corner face (v_k, m_k, m_k+2)
+            const int fc = 4*f + k;
+            fine.faces[3*fc] = v[k];       fine.face_edges[3*fc]   = half[k][0];
+            fine.faces[3*fc+1] = m[k];     fine.face_edges[3*fc+1] = inner[k2];
+            fine.faces[3*fc+2] = m[k2];    fine.face_edges[3*fc+2] = half[k2][1];
+
+            // inner edge (m_k, m_k+1) between the center face and the corner face k+1
+            fine.edges[2*inner[k]]   = m[k];
+            fine.edges[2*inner[k]+1] = m[k1];
+            fine.edge_faces[2*inner[k]]   = 4*f + 3;
+            fine.edge_faces[2*inner[k]+1] = 4*f + k1;
+        }
+
+        // center face (m_0, m_1, m_2)
+        const int fc = 4*f + 3;
+        for (int k=0; k<3; ++k) {
+            fine.faces[3*fc+k] = m[k];
+            fine.face_edges[3*fc+k] = inner[k];
+        }
+    });
+
+    // incident edges: split halves for old vertices, two halves plus two inner
+    // edges per incident face for new vertices
+    fine.vertex_edge_offsets.resize(nv + ne + 1);
+    std::copy(coarse.vertex_edge_offsets.begin(), coarse.vertex_edge_offsets.end(), fine.vertex_edge_offsets.begin());
+    for (int e=0; e<ne; ++e)
+        fine.vertex_edge_offsets[nv+e+1] = fine.vertex_edge_offsets[nv+e] + (coarse.is_boundary(e) ? 4 : 6);
+    fine.vertex_edges.resize(fine.vertex_edge_offsets[nv+ne]);
+
+    OpenGP::parallel_for(0, nv, [&](int v){
+        for (int i=coarse.vertex_edge_offsets[v]; i<coarse.vertex_edge_offsets[v+1]; ++i) {
+            const int e = coarse.vertex_edges[i];
+            fine.vertex_edges[i] = 2*e + ((coarse.edges[2*e] == v) ? 0 : 1);
+        }
+    });
+    OpenGP::parallel_for(0, ne, [&](int e){
+        int i = fine.vertex_edge_offsets[nv+e];
+        fine.vertex_edges[i++] = 2*e;
+        fine.vertex_edges[i++] = 2*e+1;
+        for (int t=0; t<2; ++t) {
+            const int f = coarse.edge_faces[2*e+t];
+            if (f < 0) continue;
+            const int k = coarse.corner(f, e);
+            fine.vertex_edges[i++] = 2*ne + 3*f + k;
+            fine.vertex_edges[i++] = 2*ne + 3*f + (k+2)%3;
+        }
+    });
+}
+
+void SurfaceMeshSubdivideLoop::assign(const Level& level, OpenGP::SurfaceMesh& mesh){
+    typedef OpenGP::SurfaceMesh::Vertex_connectivity Vertex_connectivity;
+    typedef OpenGP::SurfaceMesh::Halfedge_connectivity Halfedge_connectivity;
+    typedef OpenGP::SurfaceMesh::Face_connectivity Face_connectivity;
+
+    const int nv = level.n_vertices();
+    const int ne = level.n_edges();
+    const int nf = level.n_faces();
+    mesh.resize(nv, ne, nf);
+
+    VertexProperty<Point> points = mesh.vertex_property<Point>("v:point");
+    VertexProperty<Vertex_connectivity> vconn = mesh.get_vertex_property<Vertex_connectivity>("v:connectivity");
+    OpenGP::SurfaceMesh::Halfedge_property<Halfedge_connectivity> hconn = mesh.get_halfedge_property<Halfedge_connectivity>("h:connectivity");
+    FaceProperty<Face_connectivity> fconn = mesh.get_face_property<Face_connectivity>("f:connectivity");
+
+    // halfedges inside faces
+    OpenGP::parallel_for(0, nf, [&](int f){
+        int h[3];
+        for (int k=0; k<3; ++k)
+            h[k] = level.outgoing(level.face_edges[3*f+k], level.faces[3*f+k]);
+        for (int k=0; k<3; ++k) {
+            Halfedge_connectivity& c = hconn[Halfedge(h[k])];
+            c.face_ = Face(f);
+            c.vertex_ = Vertex(level.faces[3*f + (k+1)%3]);
+            c.next_halfedge_ = Halfedge(h[(k+1)%3]);
+            c.prev_halfedge_ = Halfedge(h[(k+2)%3]);
+        }
+        fconn[Face(f)].halfedge_ = Halfedge(h[2]);
+    });
+
+    // outgoing halfedges: the boundary one for boundary vertices
+    OpenGP::parallel_for(0, nv, [&](int v){
+        points[Vertex(v)] = level.points[v];
+        Halfedge h;
+        for (int i=level.vertex_edge_offsets[v]; i<level.vertex_edge_offsets[v+1]; ++i) {
+            const int e = level.vertex_edges[i];
+            const int out = level.outgoing(e, v);
+            if (!h.is_valid()) h = Halfedge(out);
+            if (level.is_boundary(e) && level.boundary_halfedge(e) == out) { h = Halfedge(out); break; }
+        }
+        vconn[Vertex(v)].halfedge_ = h;
+    });
+
+    // boundary halfedges, linked along the boundary loops
+    OpenGP::parallel_for(0, ne, [&](int e){
+        if (!level.is_boundary(e)) return;
+        const int h = level.boundary_halfedge(e);
+        const int to = (h == 2*e) ? level.edges[2*e+1] : level.edges[2*e];
+        const Halfedge next = vconn[Vertex(to)].halfedge_;
+        Halfedge_connectivity& c = hconn[Halfedge(h)];
+        c.face_ = Face();
+        c.vertex_ = Vertex(to);
+        c.next_halfedge_ = next;
+        hconn[next].prev_halfedge_ = Halfedge(h);
+    });
+
+    // the connectivity was written into the arrays directly
+    mesh.topology_changed();
+}
+
+void SurfaceMeshSubdivideLoop::exec(OpenGP::SurfaceMesh& mesh, unsigned int n_levels){
+    CHECK(mesh.is_triangle_mesh());
+    if (n_levels == 0) return;
+
+    // derived from the points, recomputed at the end rather than carried over
+    static const OpenGP::Property_key<Normal> VNORMAL("v:normal"), FNORMAL("f:normal");
+    const bool vnormals = mesh.get_vertex_property(VNORMAL);
+    const bool fnormals = mesh.get_face_property(FNORMAL);
+
+    if (!has_fast_path(mesh)) {
+        for (unsigned int i=0; i<n_levels; ++i)
+            refine_incremental(mesh);
+    } else {
+        Level coarse, fine;
+        extract(mesh, coarse);
+        for (unsigned int i=0; i<n_levels; ++i) {
+            refine(coarse, fine);
+            std::swap(coarse, fine);
+        }
+        fine = Level(); ///< release memory before growing the mesh
+        assign(coarse, mesh);
+    }
+
+    if (fnormals) mesh.update_face_normals();
+    if (vnormals) mesh.update_vertex_normals();
+}
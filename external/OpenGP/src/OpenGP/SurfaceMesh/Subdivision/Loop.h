@@ -16,7 +16,32 @@
 
 class SurfaceMeshSubdivideLoop : public OpenGP::SurfaceMeshAlgorithm{
 public:
+    /// one level of Loop subdivision, honors "v:feature"/"e:feature" creases
+    /// \sa exec(OpenGP::SurfaceMesh&, unsigned int)
     static HEADERONLY_INLINE void exec(OpenGP::SurfaceMesh& mesh);
+
+    /// \c n_levels levels of Loop subdivision. Manifold triangle meshes (closed
+    /// or with boundary) without creases are refined in index form with the
+    /// points computed in parallel; the mesh connectivity is only rebuilt once
+    /// at the end. Other meshes, and meshes carrying halfedge, edge or face
+    /// properties (which the rebuild would not carry over), are refined one
+    /// level at a time by editing the mesh. Either way (and without deleted elements) vertex v keeps its index
+    /// and the point of edge e of the first level becomes vertex n_vertices()+e.
+    /// "v:normal" and "f:normal" are recomputed if the mesh has them.
+    static HEADERONLY_INLINE void exec(OpenGP::SurfaceMesh& mesh, unsigned int n_levels);
+
+    /// true if exec() refines \c mesh in index form, see above
+    static HEADERONLY_INLINE bool has_fast_path(const OpenGP::SurfaceMesh& mesh);
+
+private:
+    /// one level by insertion of edge vertices and face splits
+    static HEADERONLY_INLINE void refine_incremental(OpenGP::SurfaceMesh& mesh);
+
+    /// triangle mesh in index form (see Loop.cpp)
+    struct Level;
+    static HEADERONLY_INLINE void extract(const OpenGP::SurfaceMesh& mesh, Level& level);
+    static HEADERONLY_INLINE void refine(const Level& coarse, Level& fine);
+    static HEADERONLY_INLINE void assign(const Level& level, OpenGP::SurfaceMesh& mesh);
 };
 
 #ifdef HEADERONLY
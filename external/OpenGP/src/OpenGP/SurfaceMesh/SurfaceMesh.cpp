@@ -12,7 +12,10 @@
 
 #include <OpenGP/SurfaceMesh/SurfaceMesh.h>
 #include <OpenGP/SurfaceMesh/IO/IO.h>
+#include <OpenGP/util/parallel.h>
 #include <cmath>
+#include <stdint.h>
+#include <unordered_map>
 
 //== NAMESPACE ================================================================
 namespace OpenGP {
@@ -22,20 +25,33 @@ namespace OpenGP {
 
 
 SurfaceMesh::
-SurfaceMesh()
+SurfaceMesh() : SurfaceMesh(HEAP_STORAGE)
 {
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+SurfaceMesh::
+SurfaceMesh(Storage storage)
+{
+    init_storage(storage);
+
     // allocate standard properties
     // same list is used in operator=() and assign()
-    vconn_    = add_vertex_property<Vertex_connectivity>("v:connectivity");
-    hconn_    = add_halfedge_property<Halfedge_connectivity>("h:connectivity");
-    fconn_    = add_face_property<Face_connectivity>("f:connectivity");
-    vpoint_   = add_vertex_property<Vec3>("v:point");
-    vdeleted_ = add_vertex_property<bool>("v:deleted", false);
-    edeleted_ = add_edge_property<bool>("e:deleted", false);
-    fdeleted_ = add_face_property<bool>("f:deleted", false);
+    vconn_    = add_vertex_property(keys().vconn);
+    hconn_    = add_halfedge_property(keys().hconn);
+    fconn_    = add_face_property(keys().fconn);
+    vpoint_   = add_vertex_property(keys().vpoint);
+    vdeleted_ = add_vertex_property(keys().vdeleted, false);
+    edeleted_ = add_edge_property(keys().edeleted, false);
+    fdeleted_ = add_face_property(keys().fdeleted, false);
 
     deleted_vertices_ = deleted_edges_ = deleted_faces_ = 0;
     garbage_ = false;
+    garbage_threshold_ = 0.2f;
+    topology_revision_ = 0;
 }
 
 
@@ -51,6 +67,22 @@ SurfaceMesh::
 //-----------------------------------------------------------------------------
 
 
+void
+SurfaceMesh::
+init_storage(Storage storage)
+{
+    if (storage == ARENA_STORAGE)
+        arena_.reset(new Property_arena());
+    vprops_.set_arena(arena_.get());
+    hprops_.set_arena(arena_.get());
+    eprops_.set_arena(arena_.get());
+    fprops_.set_arena(arena_.get());
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 SurfaceMesh&
 SurfaceMesh::
 operator=(const SurfaceMesh& rhs)
@@ -64,23 +96,25 @@ operator=(const SurfaceMesh& rhs)
         fprops_ = rhs.fprops_;
 
         // property handles contain pointers, have to be reassigned
-        vconn_    = vertex_property<Vertex_connectivity>("v:connectivity");
-        hconn_    = halfedge_property<Halfedge_connectivity>("h:connectivity");
-        fconn_    = face_property<Face_connectivity>("f:connectivity");
-        vdeleted_ = vertex_property<bool>("v:deleted");
-        edeleted_ = edge_property<bool>("e:deleted");
-        fdeleted_ = face_property<bool>("f:deleted");
-        vpoint_   = vertex_property<Vec3>("v:point");
+        vconn_    = vertex_property(keys().vconn);
+        hconn_    = halfedge_property(keys().hconn);
+        fconn_    = face_property(keys().fconn);
+        vdeleted_ = vertex_property(keys().vdeleted);
+        edeleted_ = edge_property(keys().edeleted);
+        fdeleted_ = face_property(keys().fdeleted);
+        vpoint_   = vertex_property(keys().vpoint);
 
         // normals might be there, therefore use get_property
-        vnormal_  = get_vertex_property<Vec3>("v:normal");
-        fnormal_  = get_face_property<Vec3>("f:normal");
+        vnormal_  = get_vertex_property(keys().vnormal);
+        fnormal_  = get_face_property(keys().fnormal);
 
         // how many elements are deleted?
         deleted_vertices_ = rhs.deleted_vertices_;
         deleted_edges_    = rhs.deleted_edges_;
         deleted_faces_    = rhs.deleted_faces_;
         garbage_          = rhs.garbage_;
+        garbage_threshold_ = rhs.garbage_threshold_;
+        ++topology_revision_;
     }
 
     return *this;
@@ -103,17 +137,17 @@ assign(const SurfaceMesh& rhs)
         fprops_.clear();
 
         // allocate standard properties
-        vconn_    = add_vertex_property<Vertex_connectivity>("v:connectivity");
-        hconn_    = add_halfedge_property<Halfedge_connectivity>("h:connectivity");
-        fconn_    = add_face_property<Face_connectivity>("f:connectivity");
-        vpoint_   = add_vertex_property<Vec3>("v:point");
-        vdeleted_ = add_vertex_property<bool>("v:deleted", false);
-        edeleted_ = add_edge_property<bool>("e:deleted", false);
-        fdeleted_ = add_face_property<bool>("f:deleted", false);
+        vconn_    = add_vertex_property(keys().vconn);
+        hconn_    = add_halfedge_property(keys().hconn);
+        fconn_    = add_face_property(keys().fconn);
+        vpoint_   = add_vertex_property(keys().vpoint);
+        vdeleted_ = add_vertex_property(keys().vdeleted, false);
+        edeleted_ = add_edge_property(keys().edeleted, false);
+        fdeleted_ = add_face_property(keys().fdeleted, false);
 
         // normals might be there, therefore use get_property
-        vnormal_  = get_vertex_property<Vec3>("v:normal");
-        fnormal_  = get_face_property<Vec3>("f:normal");
+        vnormal_  = get_vertex_property(keys().vnormal);
+        fnormal_  = get_face_property(keys().fnormal);
 
         // copy properties from other mesh
         vconn_.array()     = rhs.vconn_.array();
@@ -135,6 +169,8 @@ assign(const SurfaceMesh& rhs)
         deleted_edges_    = rhs.deleted_edges_;
         deleted_faces_    = rhs.deleted_faces_;
         garbage_          = rhs.garbage_;
+        garbage_threshold_ = rhs.garbage_threshold_;
+        ++topology_revision_;
     }
 
     return *this;
@@ -182,6 +218,7 @@ clear()
 
     deleted_vertices_ = deleted_edges_ = deleted_faces_ = 0;
     garbage_ = false;
+    ++topology_revision_;
 }
 
 
@@ -218,6 +255,89 @@ reserve(unsigned int nvertices,
 //-----------------------------------------------------------------------------
 
 
+void
+SurfaceMesh::
+resize(unsigned int nvertices,
+       unsigned int nedges,
+       unsigned int nfaces )
+{
+    assert(!garbage_);
+    vprops_.resize(nvertices);
+    hprops_.resize(2*nedges);
+    eprops_.resize(nedges);
+    fprops_.resize(nfaces);
+    ++topology_revision_;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void
+SurfaceMesh::
+permute(const std::vector<Vertex>& vertices,
+        const std::vector<Edge>& edges,
+        const std::vector<Face>& faces,
+        Handle_map* map)
+{
+    assert(!garbage_);
+    const int nV(vertices_size()), nE(edges_size()), nH(halfedges_size()), nF(faces_size());
+    assert(vertices.empty() || (int) vertices.size() == nV);
+    assert(edges.empty()    || (int) edges.size()    == nE);
+    assert(faces.empty()    || (int) faces.size()    == nF);
+
+    // new -> old indices (identity for empty orders)
+    std::vector<unsigned int> vorder(nV), horder(nH), eorder(nE), forder(nF);
+    parallel_for(0, nV, [&](int i){ vorder[i] = vertices.empty() ? i : vertices[i].idx(); });
+    parallel_for(0, nE, [&](int i){
+        eorder[i] = edges.empty() ? i : edges[i].idx();
+        horder[2*i]   = 2*eorder[i];
+        horder[2*i+1] = 2*eorder[i]+1;
+    });
+    parallel_for(0, nF, [&](int i){ forder[i] = faces.empty() ? i : faces[i].idx(); });
+
+    // old -> new handles
+    Handle_map local_map;
+    Handle_map& m = map ? *map : local_map;
+    m.vertices.resize(nV);
+    m.halfedges.resize(nH);
+    m.edges.resize(nE);
+    m.faces.resize(nF);
+    parallel_for(0, nV, [&](int i){ m.vertices[vorder[i]] = Vertex(i); });
+    parallel_for(0, nH, [&](int i){ m.halfedges[horder[i]] = Halfedge(i); });
+    parallel_for(0, nE, [&](int i){ m.edges[eorder[i]] = Edge(i); });
+    parallel_for(0, nF, [&](int i){ m.faces[forder[i]] = Face(i); });
+
+    // move the elements of all properties
+    vprops_.permute(vorder);
+    hprops_.permute(horder);
+    eprops_.permute(eorder);
+    fprops_.permute(forder);
+
+    // remap the connectivity
+    parallel_for(0, nV, [&](int i){
+        Vertex_connectivity& c = vconn_[Vertex(i)];
+        c.halfedge_ = m[c.halfedge_];
+    });
+    parallel_for(0, nH, [&](int i){
+        Halfedge_connectivity& c = hconn_[Halfedge(i)];
+        c.face_          = m[c.face_];
+        c.vertex_        = m[c.vertex_];
+        c.next_halfedge_ = m[c.next_halfedge_];
+        c.prev_halfedge_ = m[c.prev_halfedge_];
+    });
+    parallel_for(0, nF, [&](int i){
+        Face_connectivity& c = fconn_[Face(i)];
+        c.halfedge_ = m[c.halfedge_];
+    });
+
+    ++topology_revision_;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 void
 SurfaceMesh::
 property_stats() const
@@ -243,6 +363,33 @@ property_stats() const
     props = face_properties();
     for (unsigned int i=0; i<props.size(); ++i)
         std::cout << "\t" << props[i] << std::endl;
+
+    Memory_usage usage = memory_usage();
+    std::cout << "memory (bytes): vertices " << usage.vertices
+              << ", halfedges " << usage.halfedges
+              << ", edges " << usage.edges
+              << ", faces " << usage.faces
+              << ", total " << usage.total();
+    if (arena_)
+        std::cout << " (arena reserved " << usage.arena_reserved << ")";
+    std::cout << std::endl;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+SurfaceMesh::Memory_usage
+SurfaceMesh::
+memory_usage() const
+{
+    Memory_usage usage;
+    usage.vertices  = vprops_.memory_usage();
+    usage.halfedges = hprops_.memory_usage();
+    usage.edges     = eprops_.memory_usage();
+    usage.faces     = fprops_.memory_usage();
+    usage.arena_reserved = arena_ ? arena_->reserved_bytes() : 0;
+    return usage;
 }
 
 
@@ -253,6 +400,7 @@ SurfaceMesh::Vertex
 SurfaceMesh::
 add_vertex(const Vec3& p)
 {
+    ++topology_revision_;
     Vertex v = new_vertex();
     vpoint_[v] = p;
     return v;
@@ -305,6 +453,7 @@ void
 SurfaceMesh::
 adjust_outgoing_halfedge(Vertex v)
 {
+    ++topology_revision_;
     Halfedge h  = halfedge(v);
     const Halfedge hh = h;
 
@@ -362,6 +511,7 @@ SurfaceMesh::Face
 SurfaceMesh::
 add_face(const std::vector<Vertex>& vertices)
 {
+    ++topology_revision_;
     const unsigned int n(vertices.size());
     assert (n > 2);
 
@@ -555,6 +705,170 @@ add_face(const std::vector<Vertex>& vertices)
 //-----------------------------------------------------------------------------
 
 
+void
+SurfaceMesh::
+add_faces(const std::vector<unsigned int>& valences,
+          const std::vector<Vertex>& vertices,
+          std::vector<Face>* faces)
+{
+    ++topology_revision_;
+    if (faces) faces->clear();
+
+    // fast path: build the whole connectivity at once
+    if (halfedges_size() == 0 && faces_size() == 0)
+    {
+        if (add_faces_bulk(valences, vertices, faces))
+            return;
+        if (faces) faces->clear();
+    }
+
+    // general path: one face at a time
+    std::vector<Vertex> face_vertices;
+    size_t offset = 0;
+    for (size_t i=0; i<valences.size(); offset += valences[i], ++i)
+    {
+        Face f;
+        if (valences[i] > 2)
+        {
+            face_vertices.assign(vertices.begin()+offset, vertices.begin()+offset+valences[i]);
+            f = add_face(face_vertices);
+        }
+        if (faces) faces->push_back(f);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool
+SurfaceMesh::
+add_faces_bulk(const std::vector<unsigned int>& valences,
+               const std::vector<Vertex>& vertices,
+               std::vector<Face>* faces)
+{
+    const unsigned int nv = vertices_size();
+    const size_t       nc = vertices.size();
+    std::vector<Halfedge>& halfedges = add_face_halfedges_;
+    std::vector<unsigned int> n_outgoing(nv, 0);
+
+    // (smaller vertex index, larger vertex index) -> edge index
+    std::unordered_map<uint64_t, int> edge_map;
+    edge_map.reserve(nc);
+    reserve(nv, nc/2 + nc/16, valences.size());
+    if (faces) faces->reserve(valences.size());
+
+    // create edges and faces, link halfedges inside faces
+    bool manifold = true;
+    size_t offset = 0;
+    for (size_t i=0; manifold && i<valences.size(); offset += valences[i], ++i)
+    {
+        const unsigned int n = valences[i];
+        if (n < 3)
+        {
+            if (faces) faces->push_back(Face());
+            continue;
+        }
+
+        Face f(new_face());
+        halfedges.resize(n);
+        for (unsigned int j=0, jj=1; j<n; ++j, ++jj, jj%=n)
+        {
+            const Vertex a = vertices[offset+j];
+            const Vertex b = vertices[offset+jj];
+            assert(is_valid(a) && is_valid(b));
+            if (a == b) { manifold = false; break; }
+
+            const uint64_t key = (a.idx() < b.idx())
+                    ? (uint64_t(a.idx()) << 32) | uint64_t(b.idx())
+                    : (uint64_t(b.idx()) << 32) | uint64_t(a.idx());
+            std::pair<std::unordered_map<uint64_t,int>::iterator, bool> it =
+                    edge_map.insert(std::make_pair(key, (int) edges_size()));
+
+            Halfedge h;
+            if (it.second)
+            {
+                h = new_edge(a, b);
+                ++n_outgoing[a.idx()];
+                ++n_outgoing[b.idx()];
+            }
+            else
+            {
+                h = halfedge(Edge(it.first->second), 0);
+                if (to_vertex(h) != b) h = opposite_halfedge(h);
+                if (!is_boundary(h)) { manifold = false; break; } // complex edge
+            }
+            set_face(h, f);
+            halfedges[j] = h;
+        }
+        if (!manifold) break;
+
+        for (unsigned int j=0, jj=1; j<n; ++j, ++jj, jj%=n)
+            set_next_halfedge(halfedges[j], halfedges[jj]);
+        set_halfedge(f, halfedges[n-1]);
+        if (faces) faces->push_back(f);
+    }
+
+    // outgoing halfedges: boundary ones first, at most one per vertex
+    const unsigned int nh = halfedges_size();
+    for (unsigned int i=0; manifold && i<nh; ++i)
+    {
+        Halfedge h(i);
+        if (!is_boundary(h)) continue;
+        Vertex v = from_vertex(h);
+        if (halfedge(v).is_valid()) manifold = false; // complex vertex
+        else set_halfedge(v, h);
+    }
+    for (unsigned int i=0; manifold && i<nh; ++i)
+    {
+        Halfedge h(i);
+        Vertex v = from_vertex(h);
+        if (!halfedge(v).is_valid()) set_halfedge(v, h);
+    }
+
+    // close boundary loops
+    for (unsigned int i=0; manifold && i<nh; ++i)
+    {
+        Halfedge h(i);
+        if (!is_boundary(h)) continue;
+        Halfedge next = halfedge(to_vertex(h));
+        if (!is_boundary(next)) manifold = false;
+        else set_next_halfedge(h, next);
+    }
+
+    // every vertex must be a single fan of faces
+    for (unsigned int i=0; manifold && i<nv; ++i)
+    {
+        Vertex v(i);
+        Halfedge h = halfedge(v);
+        if (!h.is_valid()) continue;
+        const Halfedge hh = h;
+        unsigned int count = 0;
+        do
+        {
+            h = cw_rotated_halfedge(h);
+            ++count;
+        }
+        while (h != hh && count <= n_outgoing[i]);
+        manifold = (count == n_outgoing[i]);
+    }
+
+    if (manifold)
+        return true;
+
+    // undo, the caller falls back to add_face()
+    hprops_.resize(0);
+    eprops_.resize(0);
+    fprops_.resize(0);
+    for (unsigned int i=0; i<nv; ++i)
+        set_halfedge(Vertex(i), Halfedge());
+    return false;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 unsigned int
 SurfaceMesh::
 valence(Vertex v) const
@@ -647,6 +961,7 @@ void
 SurfaceMesh::
 triangulate(Face f)
 {
+    ++topology_revision_;
     /*
      Split an arbitrary face into triangles by connecting
      each vertex of fh after its second to vh.
@@ -698,12 +1013,15 @@ SurfaceMesh::
 update_face_normals()
 {
     if (!fnormal_)
-        fnormal_ = face_property<Vec3>("f:normal");
-
-    Face_iterator fit, fend=faces_end();
+        fnormal_ = face_property(keys().fnormal);
 
-    for (fit=faces_begin(); fit!=fend; ++fit)
-        fnormal_[*fit] = compute_face_normal(*fit);
+    // faces are independent, each thread writes its own range
+    parallel_for(0, faces_size(), [this](int i)
+    {
+        const Face f(i);
+        if (!fdeleted_[f])
+            fnormal_[f] = compute_face_normal(f);
+    });
 }
 
 
@@ -756,12 +1074,107 @@ SurfaceMesh::
 update_vertex_normals()
 {
     if (!vnormal_)
-        vnormal_ = vertex_property<Vec3>("v:normal");
+        vnormal_ = vertex_property(keys().vnormal);
+
+    // 1. faces in parallel: the normal of every face and the angles of its
+    //    corners, from edge vectors computed once per face. the angle of the
+    //    corner at from_vertex(h) is stored at h; every halfedge belongs to one
+    //    face, so no two faces write the same slot. slots of boundary halfedges
+    //    are neither written nor read.
+    std::unique_ptr<Vec3[]>   face_normal(new Vec3[faces_size()]);
+    std::unique_ptr<Scalar[]> corner_angle(new Scalar[halfedges_size()]);
+    parallel_for(0, faces_size(), [&](int i)
+    {
+        const Face f(i);
+        if (fdeleted_[f]) return;
+
+        // edge vectors and lengths around the face, a triangle in all but rare cases
+        Vec3     edge_buffer[3];
+        Scalar   length_buffer[3];
+        Halfedge halfedge_buffer[3];
+        std::vector<Vec3>     polygon_edges;
+        std::vector<Scalar>   polygon_lengths;
+        std::vector<Halfedge> polygon_halfedges;
+        Vec3*     edges     = edge_buffer;
+        Scalar*   lengths   = length_buffer;
+        Halfedge* halfedges = halfedge_buffer;
+
+        const Halfedge hend = halfedge(f);
+        const bool triangle = (next_halfedge(next_halfedge(next_halfedge(hend))) == hend);
+        const unsigned int n = triangle ? 3 : valence(f);
+        if (!triangle)
+        {
+            polygon_edges.resize(n);
+            polygon_lengths.resize(n);
+            polygon_halfedges.resize(n);
+            edges = &polygon_edges[0];
+            lengths = &polygon_lengths[0];
+            halfedges = &polygon_halfedges[0];
+        }
+        Halfedge h = hend;
+        Vec3 p = vpoint_[from_vertex(h)];
+        for (unsigned int k=0; k<n; ++k, h = next_halfedge(h))
+        {
+            const Vec3& q = vpoint_[to_vertex(h)];
+            edges[k] = q - p;
+            lengths[k] = edges[k].norm();
+            halfedges[k] = h;
+            p = q;
+        }
+
+        // face normal, as compute_face_normal
+        Vec3 normal = edges[0].cross(edges[1]);
+        if (!triangle)
+        {
+            for (unsigned int k=2; k<n; ++k)
+                normal += edges[k-1].cross(edges[k]);
+            normal += edges[n-1].cross(edges[0]);
+        }
+        const Scalar area = normal.norm();
+        face_normal[i] = (area > std::numeric_limits<Scalar>::min()) ? Vec3(normal / area) : Vec3(0,0,0);
+
+        // corner k lies between the incoming edge k-1 and the outgoing edge k,
+        // its angle is 0 if one of them is degenerate
+        for (unsigned int k=0, kin=n-1; k<n; kin=k, ++k)
+        {
+            Scalar angle = 0;
+            const Scalar denom = lengths[kin] * lengths[k];
+            if (denom > std::numeric_limits<Scalar>::min())
+            {
+                Scalar cosine = -edges[kin].dot(edges[k]) / denom;
+                if      (cosine < -1.0) cosine = -1.0;
+                else if (cosine >  1.0) cosine =  1.0;
+                angle = acos(cosine);
+            }
+            corner_angle[halfedges[k].idx()] = angle;
+        }
+    });
 
-    Vertex_iterator vit, vend=vertices_end();
+    // 2. vertices in parallel: gather the angle-weighted normals of the faces
+    //    around each vertex. only reads, so no scatter/atomics; the summation
+    //    order per vertex is the serial one.
+    parallel_for(0, vertices_size(), [&](int i)
+    {
+        const Vertex v(i);
+        if (vdeleted_[v]) return;
 
-    for (vit=vertices_begin(); vit!=vend; ++vit)
-        vnormal_[*vit] = compute_vertex_normal(*vit);
+        Vec3 nn(0,0,0);
+        Halfedge h = halfedge(v);
+        if (h.is_valid())
+        {
+            const Halfedge hend = h;
+            do
+            {
+                const Face f = face(h);
+                if (f.is_valid())
+                    nn += corner_angle[h.idx()] * face_normal[f.idx()];
+                h = cw_rotated_halfedge(h);
+            }
+            while (h != hend);
+            nn.normalize();
+        }
+        vnormal_[v] = nn;
+    });
 }
 
 
@@ -845,6 +1258,7 @@ void
 SurfaceMesh::
 split(Face f, Vertex v)
 {
+    ++topology_revision_;
     /*
      Split an arbitrary face into triangles by connecting each vertex of fh to vh.
      - fh will remain valid (it will become one of the triangles)
@@ -899,6 +1313,7 @@ void
 SurfaceMesh::
 split(Edge e, Vertex v)
 {
+    ++topology_revision_;
     Halfedge h0 = halfedge(e, 0);
     Halfedge o0 = halfedge(e, 1);
 
@@ -1000,6 +1415,7 @@ SurfaceMesh::Halfedge
 SurfaceMesh::
 insert_vertex(Halfedge h0, Vertex v)
 {
+    ++topology_revision_;
     // before:
     //
     // v0      h0       v2
@@ -1057,6 +1473,7 @@ SurfaceMesh::Halfedge
 SurfaceMesh::
 insert_edge(Halfedge h0, Halfedge h1)
 {
+    ++topology_revision_;
     assert(face(h0) == face(h1));
     assert(face(h0).is_valid());
 
@@ -1128,6 +1545,7 @@ void
 SurfaceMesh::
 flip(Edge e)
 {
+    ++topology_revision_;
     // CAUTION : Flipping a halfedge may result in
     // a non-manifold mesh, hence check for yourself
     // whether this operation is allowed or not!
@@ -1248,6 +1666,7 @@ void
 SurfaceMesh::
 collapse(Halfedge h)
 {
+    ++topology_revision_;
     Halfedge h0 = h;
     Halfedge h1 = prev_halfedge(h0);
     Halfedge o0 = opposite_halfedge(h0);
@@ -1313,8 +1732,8 @@ remove_edge(Halfedge h)
 
 
     // delete stuff
-    if (!vdeleted_) vdeleted_ = vertex_property<bool>("v:deleted", false);
-    if (!edeleted_) edeleted_ = edge_property<bool>("e:deleted", false);
+    if (!vdeleted_) vdeleted_ = vertex_property(keys().vdeleted, false);
+    if (!edeleted_) edeleted_ = edge_property(keys().edeleted, false);
     vdeleted_[vo]      = true; ++deleted_vertices_;
     edeleted_[edge(h)] = true; ++deleted_edges_;
     garbage_ = true;
@@ -1366,8 +1785,8 @@ remove_loop(Halfedge h)
 
 
     // delete stuff
-    if (!edeleted_) edeleted_ = edge_property<bool>("e:deleted", false);
-    if (!fdeleted_) fdeleted_ = face_property<bool>("f:deleted", false);
+    if (!edeleted_) edeleted_ = edge_property(keys().edeleted, false);
+    if (!fdeleted_) fdeleted_ = face_property(keys().fdeleted, false);
     if (fh.is_valid()) { fdeleted_[fh] = true; ++deleted_faces_; }
     edeleted_[edge(h0)] = true; ++deleted_edges_;
     garbage_ = true;
@@ -1381,6 +1800,7 @@ void
 SurfaceMesh::
 delete_vertex(Vertex v)
 {
+    ++topology_revision_;
     if (vdeleted_[v])  return;
 
     // collect incident faces
@@ -1403,8 +1823,12 @@ delete_vertex(Vertex v)
     for (; fit != fend; ++fit)
         delete_face(*fit);
 
-    vdeleted_[v] = true;
-    deleted_vertices_++;
+    // delete_face already deleted v if it became isolated
+    if (!vdeleted_[v])
+    {
+        vdeleted_[v] = true;
+        deleted_vertices_++;
+    }
     garbage_ = true;
 }
 
@@ -1416,6 +1840,7 @@ void
 SurfaceMesh::
 delete_edge(Edge e)
 {
+    ++topology_revision_;
     if (edeleted_[e])  return;
 
     Face f0 = face(halfedge(e, 0));
@@ -1432,6 +1857,7 @@ void
 SurfaceMesh::
 delete_face(Face f)
 {
+    ++topology_revision_;
     if (fdeleted_[f])  return;
 
     // mark face deleted
@@ -1547,9 +1973,36 @@ delete_face(Face f)
 //-----------------------------------------------------------------------------
 
 
+float
+SurfaceMesh::
+garbage_ratio() const
+{
+    unsigned int n_stored  = vertices_size() + edges_size() + faces_size();
+    unsigned int n_deleted = deleted_vertices_ + deleted_edges_ + deleted_faces_;
+    return (n_stored > 0) ? float(n_deleted) / float(n_stored) : 0.0f;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool
+SurfaceMesh::
+garbage_collection_if_needed(Handle_map* map)
+{
+    if (!garbage_ || garbage_ratio() <= garbage_threshold_)
+        return false;
+    garbage_collection(map);
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 void
 SurfaceMesh::
-garbage_collection()
+garbage_collection(Handle_map* map)
 {
     int  i, i0, i1,
     nV(vertices_size()),
@@ -1563,9 +2016,9 @@ garbage_collection()
 
 
     // setup handle mapping
-    Vertex_property<Vertex>      vmap = add_vertex_property<Vertex>("v:garbage-collection");
-    Halfedge_property<Halfedge>  hmap = add_halfedge_property<Halfedge>("h:garbage-collection");
-    Face_property<Face>          fmap = add_face_property<Face>("f:garbage-collection");
+    Vertex_property<Vertex>      vmap = add_vertex_property(keys().vgarbage);
+    Halfedge_property<Halfedge>  hmap = add_halfedge_property(keys().hgarbage);
+    Face_property<Face>          fmap = add_face_property(keys().fgarbage);
     for (i=0; i<nV; ++i)
         vmap[Vertex(i)] = Vertex(i);
     for (i=0; i<nH; ++i)
@@ -1669,6 +2122,25 @@ garbage_collection()
     }
 
 
+    // the swapped handle maps give the old handle at each new index (new -> old);
+    // invert them into the old -> new maps of the caller. removed elements stay invalid
+    if (map)
+    {
+        map->vertices.assign(vertices_size(), Vertex());
+        map->halfedges.assign(halfedges_size(), Halfedge());
+        map->edges.assign(edges_size(), Edge());
+        map->faces.assign(faces_size(), Face());
+        for (i=0; i<nV; ++i)
+            map->vertices[vmap[Vertex(i)].idx()] = Vertex(i);
+        for (i=0; i<nH; ++i)
+            map->halfedges[hmap[Halfedge(i)].idx()] = Halfedge(i);
+        for (i=0; i<nE; ++i)
+            map->edges[hmap[Halfedge(2*i)].idx() / 2] = Edge(i);
+        for (i=0; i<nF; ++i)
+            map->faces[fmap[Face(i)].idx()] = Face(i);
+    }
+
+
     // remove handle maps
     remove_vertex_property(vmap);
     remove_halfedge_property(hmap);
@@ -1683,6 +2155,7 @@ garbage_collection()
 
     deleted_vertices_ = deleted_edges_ = deleted_faces_ = 0;
     garbage_ = false;
+    ++topology_revision_;
 }
 
 
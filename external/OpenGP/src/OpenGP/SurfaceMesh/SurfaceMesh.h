@@ -13,6 +13,7 @@
 #pragma once
 #include <OpenGP/types.h>
 #include <OpenGP/headeronly.h>
+#include <memory>
 #include <OpenGP/SurfaceMesh/internal/Global_properties.h>
 #include <OpenGP/SurfaceMesh/internal/properties.h>
 
@@ -862,14 +863,25 @@ public: //-------------------------------------------- constructor / destructor
     /// \name Construct, destruct, assignment
     //@{
 
+    /// where the property arrays (connectivity, points and custom properties) are allocated
+    enum Storage
+    {
+        HEAP_STORAGE,   ///< one heap buffer per array (default)
+        ARENA_STORAGE   ///< cache-aligned chunks of a per-mesh arena, released all at once with the mesh
+    };
+
     /// default constructor
     HEADERONLY_INLINE SurfaceMesh();
 
+    /// constructor choosing the storage of the property arrays
+    HEADERONLY_INLINE explicit SurfaceMesh(Storage storage);
+
     // destructor (is virtual, since we inherit from Geometry_representation)
     HEADERONLY_INLINE virtual ~SurfaceMesh();
 
-    /// copy constructor: copies \c rhs to \c *this. performs a deep copy of all properties.
-    SurfaceMesh(const SurfaceMesh& rhs) { operator=(rhs); }
+    /// copy constructor: copies \c rhs to \c *this. performs a deep copy of all properties,
+    /// the copy uses the same kind of storage as \c rhs.
+    SurfaceMesh(const SurfaceMesh& rhs) : topology_revision_(0) { init_storage(rhs.storage()); operator=(rhs); }
 
     /// assign \c rhs to \c *this. performs a deep copy of all properties.
     HEADERONLY_INLINE SurfaceMesh& operator=(const SurfaceMesh& rhs);
@@ -920,6 +932,16 @@ public: //----------------------------------------------- add new vertex / face
     /// \sa add_triangle, add_face
     HEADERONLY_INLINE Face add_quad(Vertex v1, Vertex v2, Vertex v3, Vertex v4);
 
+    /// add many faces at once (mainly used in file readers). face \c i has \c valences[i]
+    /// vertices, stored consecutively in \c vertices. on a mesh without faces the halfedge
+    /// connectivity is built in one pass with a hash table of edges; non-manifold input
+    /// falls back to add_face(). if \c faces is given it receives one handle per input
+    /// face (invalid for faces that could not be added).
+    /// \sa add_face
+    HEADERONLY_INLINE void add_faces(const std::vector<unsigned int>& valences,
+                                     const std::vector<Vertex>& vertices,
+                                     std::vector<Face>* faces = NULL);
+
     //@}
 
 
@@ -965,9 +987,96 @@ public: //--------------------------------------------------- memory management
                                    unsigned int nedges,
                                    unsigned int nfaces );
 
+    /// resize the vertex/edge/face containers of a mesh without deleted elements.
+    /// new elements get the default value of every property (i.e. no connectivity),
+    /// they are meant to be linked at once through the "v:connectivity",
+    /// "h:connectivity" and "f:connectivity" properties (e.g. by subdivision).
+    HEADERONLY_INLINE void resize(unsigned int nvertices,
+                                  unsigned int nedges,
+                                  unsigned int nfaces );
+
+
+    /// old -> new handles of a garbage collection. removed elements map to invalid handles.
+    struct Handle_map
+    {
+        std::vector<Vertex>    vertices;
+        std::vector<Halfedge>  halfedges;
+        std::vector<Edge>      edges;
+        std::vector<Face>      faces;
+
+        /// new handle of \c v (invalid if it was removed)
+        Vertex   operator[](Vertex v)   const { return v.is_valid() ? vertices[v.idx()]  : v; }
+        /// new handle of \c h (invalid if it was removed)
+        Halfedge operator[](Halfedge h) const { return h.is_valid() ? halfedges[h.idx()] : h; }
+        /// new handle of \c e (invalid if it was removed)
+        Edge     operator[](Edge e)     const { return e.is_valid() ? edges[e.idx()]     : e; }
+        /// new handle of \c f (invalid if it was removed)
+        Face     operator[](Face f)     const { return f.is_valid() ? faces[f.idx()]     : f; }
+
+        /// replaces the handles in \c handles by their new value, removed ones are dropped
+        template <class Handle> void apply(std::vector<Handle>& handles) const
+        {
+            size_t n = 0;
+            for (size_t i=0; i<handles.size(); ++i)
+            {
+                Handle h = (*this)[handles[i]];
+                if (h.is_valid()) handles[n++] = h;
+            }
+            handles.resize(n);
+        }
+
+        /// moves the entries of \c data (indexed by old vertex handles) to the new indices
+        template <class T> void apply_vertex_data(std::vector<T>& data) const   { permute(vertices, data); }
+        /// moves the entries of \c data (indexed by old halfedge handles) to the new indices
+        template <class T> void apply_halfedge_data(std::vector<T>& data) const { permute(halfedges, data); }
+        /// moves the entries of \c data (indexed by old edge handles) to the new indices
+        template <class T> void apply_edge_data(std::vector<T>& data) const     { permute(edges, data); }
+        /// moves the entries of \c data (indexed by old face handles) to the new indices
+        template <class T> void apply_face_data(std::vector<T>& data) const     { permute(faces, data); }
+
+    private:
+        template <class Handle, class T>
+        static void permute(const std::vector<Handle>& map, std::vector<T>& data)
+        {
+            assert(data.size() == map.size());
+            size_t n = 0;
+            for (size_t i=0; i<map.size(); ++i)
+                if (map[i].is_valid()) ++n;
+            std::vector<T> result(n);
+            for (size_t i=0; i<map.size(); ++i)
+                if (map[i].is_valid()) result[map[i].idx()] = data[i];
+            data.swap(result);
+        }
+    };
+
+    /// remove deleted vertices/edges/faces. all properties of the mesh are compacted,
+    /// \c map (if given) receives the new handle of every old one, e.g. to update
+    /// handles or arrays stored outside of the mesh.
+    HEADERONLY_INLINE void garbage_collection(Handle_map* map = NULL);
+
+    /// runs garbage_collection() only when the fraction of deleted elements exceeds
+    /// garbage_threshold(). handles (and \c map) are only touched in that case,
+    /// returns whether a collection happened.
+    HEADERONLY_INLINE bool garbage_collection_if_needed(Handle_map* map = NULL);
 
-    /// remove deleted vertices/edges/faces
-    HEADERONLY_INLINE void garbage_collection();
+    /// fraction of deleted elements among all stored vertices, edges and faces
+    HEADERONLY_INLINE float garbage_ratio() const;
+
+    /// fraction of deleted elements triggering garbage_collection_if_needed() (default 0.2)
+    float garbage_threshold() const { return garbage_threshold_; }
+
+    /// sets the fraction of deleted elements triggering garbage_collection_if_needed()
+    void set_garbage_threshold(float ratio) { garbage_threshold_ = ratio; }
+
+    /// reorder the elements of a mesh without deleted elements: vertex i becomes the
+    /// former vertex \c vertices[i] (same for edges, with their two halfedges, and faces).
+    /// an empty order keeps the current one. all properties are permuted and the
+    /// connectivity is remapped, \c map (if given) receives the new handle of every old one.
+    /// \sa reorder_spatially
+    HEADERONLY_INLINE void permute(const std::vector<Vertex>& vertices,
+                                   const std::vector<Edge>& edges,
+                                   const std::vector<Face>& faces,
+                                   Handle_map* map = NULL);
 
 
     /// returns whether vertex \c v is deleted
@@ -1017,6 +1126,17 @@ public: //--------------------------------------------------- memory management
         return (0 <= f.idx()) && (f.idx() < (int)faces_size());
     }
 
+    /// counter that changes whenever the connectivity is edited (elements added,
+    /// deleted or re-linked). used to detect stale connectivity snapshots.
+    /// every topological operation (add_face, split, collapse, delete_face,
+    /// garbage_collection, ...) increments it once; the low-level setters
+    /// below do not. \sa SurfaceMeshAdjacency
+    unsigned int topology_revision() const { return topology_revision_; }
+
+    /// marks the connectivity as edited, for code that re-links elements
+    /// through the low-level setters directly
+    void topology_changed() { ++topology_revision_; }
+
     //@}
 
 
@@ -1025,6 +1145,9 @@ public: //--------------------------------------------------- memory management
 public: //---------------------------------------------- low-level connectivity
 
     /// \name Low-level connectivity
+    /// The setters do not change topology_revision(): code that re-links elements
+    /// through them, or writes the connectivity arrays directly (the readers, the
+    /// Loop fast path), must call topology_changed() once it is done.
     //@{
 
     /// returns an outgoing halfedge of vertex \c v.
@@ -1299,6 +1422,37 @@ public: //--------------------------------------------------- property handling
     }
 
 
+    /// add/get/get-or-add through an interned key: same as the functions above,
+    /// but the property is found in constant time instead of by a name search.
+    /// \sa Property_key
+    template <class T> Vertex_property<T> add_vertex_property(const Property_key<T>& key, const T t=T())
+    { return Vertex_property<T>(vprops_.add(key, t)); }
+    template <class T> Halfedge_property<T> add_halfedge_property(const Property_key<T>& key, const T t=T())
+    { return Halfedge_property<T>(hprops_.add(key, t)); }
+    template <class T> Edge_property<T> add_edge_property(const Property_key<T>& key, const T t=T())
+    { return Edge_property<T>(eprops_.add(key, t)); }
+    template <class T> Face_property<T> add_face_property(const Property_key<T>& key, const T t=T())
+    { return Face_property<T>(fprops_.add(key, t)); }
+
+    template <class T> Vertex_property<T> get_vertex_property(const Property_key<T>& key) const
+    { return Vertex_property<T>(vprops_.get(key)); }
+    template <class T> Halfedge_property<T> get_halfedge_property(const Property_key<T>& key) const
+    { return Halfedge_property<T>(hprops_.get(key)); }
+    template <class T> Edge_property<T> get_edge_property(const Property_key<T>& key) const
+    { return Edge_property<T>(eprops_.get(key)); }
+    template <class T> Face_property<T> get_face_property(const Property_key<T>& key) const
+    { return Face_property<T>(fprops_.get(key)); }
+
+    template <class T> Vertex_property<T> vertex_property(const Property_key<T>& key, const T t=T())
+    { return Vertex_property<T>(vprops_.get_or_add(key, t)); }
+    template <class T> Halfedge_property<T> halfedge_property(const Property_key<T>& key, const T t=T())
+    { return Halfedge_property<T>(hprops_.get_or_add(key, t)); }
+    template <class T> Edge_property<T> edge_property(const Property_key<T>& key, const T t=T())
+    { return Edge_property<T>(eprops_.get_or_add(key, t)); }
+    template <class T> Face_property<T> face_property(const Property_key<T>& key, const T t=T())
+    { return Face_property<T>(fprops_.get_or_add(key, t)); }
+
+
     /// remove the vertex property \c p
     template <class T> void remove_vertex_property(Vertex_property<T>& p)
     {
@@ -1367,9 +1521,28 @@ public: //--------------------------------------------------- property handling
     {
         return fprops_.properties();
     }
-    /// prints the names of all properties
+    /// prints the names of all properties and the memory they use
     HEADERONLY_INLINE void property_stats() const;
 
+    /// storage of the property arrays
+    Storage storage() const { return arena_ ? ARENA_STORAGE : HEAP_STORAGE; }
+
+    /// bytes allocated by the property arrays of each kind of element (connectivity
+    /// included, unused capacity included)
+    struct Memory_usage
+    {
+        size_t vertices;
+        size_t halfedges;
+        size_t edges;
+        size_t faces;
+        size_t arena_reserved;  ///< bytes held by the arena, 0 with HEAP_STORAGE
+
+        size_t total() const { return vertices + halfedges + edges + faces; }
+    };
+
+    /// returns the memory used by the property arrays
+    HEADERONLY_INLINE Memory_usage memory_usage() const;
+
     //@}
 
 
@@ -1645,16 +1818,18 @@ public: //------------------------------------------ geometry-related functions
     /// position of a vertex
     Vec3& position(Vertex v) { return vpoint_[v]; }
 
-    /// vector of vertex positions
-    std::vector<Vec3>& points() { return vpoint_.vector(); }
+    /// vector of vertex positions, allocated from the storage of the mesh
+    Vertex_property<Vec3>::vector_type& points() { return vpoint_.vector(); }
 
-    /// compute face normals by calling compute_face_normal(Face) for each face.
+    /// compute face normals by calling compute_face_normal(Face) for each face (in parallel).
     HEADERONLY_INLINE void update_face_normals();
 
     /// compute normal vector of face \c f.
     HEADERONLY_INLINE Vec3 compute_face_normal(Face f) const;
 
-    /// compute vertex normals by calling compute_vertex_normal(Vertex) for each vertex.
+    /// compute angle-weighted vertex normals in two parallel passes: the normal
+    /// and corner angles of every face once, then a gather around every vertex.
+    /// matches compute_vertex_normal(Vertex) up to rounding on planar faces.
     HEADERONLY_INLINE void update_vertex_normals();
 
     /// compute normal vector of vertex \c v.
@@ -1711,6 +1886,12 @@ private: //--------------------------------------------------- helper functions
      if v is a boundary vertex. */
     HEADERONLY_INLINE void adjust_outgoing_halfedge(Vertex v);
 
+    /// Helper for add_faces: one-pass build on a mesh without edges/faces.
+    /// returns false (and leaves the mesh without edges/faces) on non-manifold input.
+    HEADERONLY_INLINE bool add_faces_bulk(const std::vector<unsigned int>& valences,
+                                          const std::vector<Vertex>& vertices,
+                                          std::vector<Face>* faces);
+
     /// Helper for halfedge collapse
     HEADERONLY_INLINE void remove_edge(Halfedge h);
 
@@ -1725,6 +1906,35 @@ private: //--------------------------------------------------- helper functions
 private: //------------------------------------------------------- private data
 
     HEADERONLY_INLINE friend bool read_poly(SurfaceMesh& mesh, const std::string& filename);
+    HEADERONLY_INLINE friend bool read_ply(SurfaceMesh& mesh, const std::string& filename);
+
+    /// selects the storage of the (still empty) property containers
+    HEADERONLY_INLINE void init_storage(Storage storage);
+
+    /// interned names of the standard properties, looked up on every copy
+    struct Standard_keys
+    {
+        Property_key<Vertex_connectivity>    vconn;
+        Property_key<Halfedge_connectivity>  hconn;
+        Property_key<Face_connectivity>      fconn;
+        Property_key<Vec3>                   vpoint;
+        Property_key<bool>                   vdeleted;
+        Property_key<bool>                   edeleted;
+        Property_key<bool>                   fdeleted;
+        Property_key<Vec3>                   vnormal;
+        Property_key<Vec3>                   fnormal;
+        Property_key<Vertex>                 vgarbage;
+        Property_key<Halfedge>               hgarbage;
+        Property_key<Face>                   fgarbage;
+
+        Standard_keys() : vconn("v:connectivity"), hconn("h:connectivity"), fconn("f:connectivity"),
+            vpoint("v:point"), vdeleted("v:deleted"), edeleted("e:deleted"), fdeleted("f:deleted"),
+            vnormal("v:normal"), fnormal("f:normal"), vgarbage("v:garbage-collection"),
+            hgarbage("h:garbage-collection"), fgarbage("f:garbage-collection") {}
+    };
+    static const Standard_keys& keys() { static const Standard_keys k; return k; }
+
+    std::unique_ptr<Property_arena> arena_;  ///< NULL with HEAP_STORAGE, outlives the containers
 
     Property_container vprops_;
     Property_container hprops_;
@@ -1747,6 +1957,8 @@ private: //------------------------------------------------------- private data
     unsigned int deleted_edges_;
     unsigned int deleted_faces_;
     bool garbage_;
+    float garbage_threshold_;
+    unsigned int topology_revision_;
 
     // helper data for add_face()
     typedef std::pair<Halfedge, Halfedge>  NextCacheEntry;
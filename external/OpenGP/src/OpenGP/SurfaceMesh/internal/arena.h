@@ -0,0 +1,259 @@
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License Version 2
+// as published by the Free Software Foundation.
+//
+// This file is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with OpenGP.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Bump allocator backing the property arrays of one mesh. Memory is carved
+/// out of a few large blocks, every allocation starts on a cache line and
+/// released chunks are recycled by size. Requests larger than half a block
+/// get a dedicated block that goes back to the system when released, so
+/// growing arrays do not pin their previous (smaller) buffers forever.
+///
+/// reserve() sizes a block for the arrays about to grow (SurfaceMesh::reserve(),
+/// copies), so the arrays of a large mesh share a block as well. Such a block
+/// counts its live chunks and goes back to the system once they are all
+/// released (e.g. when the arrays outgrow it or garbage_collection() shrinks them).
+///
+/// All memory is returned when the arena is destroyed.
+///
+/// @note not thread-safe: arrays of a mesh must not be resized concurrently
+class Property_arena
+{
+public:
+
+    static const size_t ALIGNMENT = 64;
+
+    explicit Property_arena(size_t block_size = 64*1024)
+        : block_size_(block_size), top_(NULL), end_(NULL), current_(NULL), used_(0), reserved_(0) {}
+
+    ~Property_arena()
+    {
+        for (size_t i=0; i<blocks_.size(); ++i)
+            ::operator delete(blocks_[i]);
+        for (std::unordered_map<char*, Block>::iterator it=large_.begin(); it!=large_.end(); ++it)
+            ::operator delete(it->second.base);
+        for (std::map<char*, Block>::iterator it=sized_.begin(); it!=sized_.end(); ++it)
+            ::operator delete(it->second.base);
+    }
+
+    /// bytes taken from the arena by allocate(bytes)
+    static size_t chunk_size(size_t bytes)
+    {
+        return round_up(std::max<size_t>(bytes, 1));
+    }
+
+    /// makes the next allocations of \c bytes in total (sum of their chunk_size())
+    /// come from one block, started for them if the current one is too small
+    void reserve(size_t bytes)
+    {
+        if (bytes == 0 || (top_ != NULL && top_ + bytes <= end_)) return;
+        start_block(std::max(bytes, block_size_), true);
+    }
+
+    /// returns \c bytes of storage aligned to ALIGNMENT
+    void* allocate(size_t bytes)
+    {
+        bytes = chunk_size(bytes);
+        used_ += bytes;
+
+        // large buffers live in a block of their own, unless reserved
+        if (bytes > block_size_/2 && (top_ == NULL || top_ + bytes > end_))
+        {
+            Block block = new_block(bytes);
+            large_[block.data] = block;
+            return block.data;
+        }
+
+        // recycle a chunk of the same size
+        std::unordered_map<size_t, std::vector<char*> >::iterator it = free_.find(bytes);
+        if (it != free_.end() && !it->second.empty())
+        {
+            char* p = it->second.back();
+            it->second.pop_back();
+            return p;
+        }
+
+        // bump
+        if (top_ == NULL || top_ + bytes > end_)
+            start_block(block_size_, false);
+        char* p = top_;
+        top_ += bytes;
+        if (current_) ++current_->live;
+        return p;
+    }
+
+    /// releases storage obtained from allocate(bytes)
+    void deallocate(void* ptr, size_t bytes)
+    {
+        if (ptr == NULL) return;
+        char* p = static_cast<char*>(ptr);
+        bytes = chunk_size(bytes);
+        used_ -= bytes;
+
+        std::unordered_map<char*, Block>::iterator it = large_.find(p);
+        if (it != large_.end())
+        {
+            reserved_ -= it->second.size;
+            ::operator delete(it->second.base);
+            large_.erase(it);
+            return;
+        }
+
+        // chunks of reserved blocks are counted, not recycled
+        std::map<char*, Block>::iterator sized = sized_.upper_bound(p);
+        if (sized != sized_.begin() && p < (--sized)->second.base + sized->second.size)
+        {
+            if (--sized->second.live > 0) return;
+            if (&sized->second == current_)
+                top_ = current_->data; ///< empty, start over
+            else
+                release(sized);
+            return;
+        }
+
+        if (current_ == NULL && p + bytes == top_)
+            top_ = p; ///< last allocation, roll back
+        else
+            free_[bytes].push_back(p);
+    }
+
+    /// bytes handed out and not yet released
+    size_t used_bytes() const { return used_; }
+
+    /// bytes obtained from the system (used, recycled and not yet used)
+    size_t reserved_bytes() const { return reserved_; }
+
+private:
+
+    struct Block
+    {
+        char*  base;  ///< as returned by operator new
+        char*  data;  ///< aligned start
+        size_t size;  ///< bytes obtained from the system
+        size_t live;  ///< chunks not yet released (reserved blocks only)
+    };
+
+    static size_t round_up(size_t bytes)
+    {
+        return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    Block new_block(size_t bytes)
+    {
+        Block block;
+        block.size = bytes + ALIGNMENT;
+        block.base = static_cast<char*>(::operator new(block.size));
+        block.data = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(block.base)));
+        block.live = 0;
+        reserved_ += block.size;
+        return block;
+    }
+
+    /// continues in a new block of \c bytes, a reserved one if \c sized
+    void start_block(size_t bytes, bool sized)
+    {
+        if (current_ && current_->live == 0)
+            release(sized_.find(current_->data));
+        Block block = new_block(bytes);
+        if (sized)
+            current_ = &(sized_[block.data] = block);
+        else
+        {
+            blocks_.push_back(block.base);
+            current_ = NULL;
+        }
+        top_ = block.data;
+        end_ = block.data + bytes;
+    }
+
+    /// returns a reserved block to the system
+    void release(std::map<char*, Block>::iterator it)
+    {
+        if (&it->second == current_)
+        {
+            current_ = NULL;
+            top_ = end_ = NULL;
+        }
+        reserved_ -= it->second.size;
+        ::operator delete(it->second.base);
+        sized_.erase(it);
+    }
+
+    Property_arena(const Property_arena&);
+    Property_arena& operator=(const Property_arena&);
+
+private:
+    size_t block_size_;
+    char*  top_;                                              ///< bump pointer in the current block
+    char*  end_;
+    Block* current_;                                          ///< current block if reserved, else NULL
+    size_t used_;
+    size_t reserved_;
+    std::vector<char*> blocks_;                               ///< shared blocks
+    std::unordered_map<char*, Block> large_;                  ///< dedicated blocks by aligned start
+    std::map<char*, Block> sized_;                            ///< reserved blocks by aligned start
+    std::unordered_map<size_t, std::vector<char*> > free_;    ///< recycled chunks by size
+};
+
+
+
+/// STL allocator drawing from a Property_arena, or from the heap if none is set
+template <class T>
+class Property_allocator
+{
+public:
+
+    typedef T value_type;
+
+    Property_allocator(Property_arena* arena = NULL) : arena_(arena) {}
+
+    template <class U>
+    Property_allocator(const Property_allocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n)
+    {
+        if (arena_) return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (arena_) arena_->deallocate(p, n * sizeof(T));
+        else ::operator delete(p);
+    }
+
+    Property_arena* arena() const { return arena_; }
+
+private:
+    Property_arena* arena_;
+};
+
+template <class T, class U>
+bool operator==(const Property_allocator<T>& a, const Property_allocator<U>& b) { return a.arena() == b.arena(); }
+
+template <class T, class U>
+bool operator!=(const Property_allocator<T>& a, const Property_allocator<U>& b) { return a.arena() != b.arena(); }
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
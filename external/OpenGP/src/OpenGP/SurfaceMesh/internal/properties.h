@@ -16,17 +16,161 @@
 #include <algorithm>
 #include <typeinfo>
 #include <iostream>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <OpenGP/SurfaceMesh/internal/arena.h>
 
 //=============================================================================
 namespace OpenGP {
 //=============================================================================
 
+/// Process-wide table of property names: every name is interned once into a
+/// small integer id, containers store their arrays in a table indexed by id.
+/// Lookups take no lock: the hash table is append-only, entries are published
+/// with release stores and a full table is replaced by a larger copy (the old
+/// ones are kept, a reader may still probe them). Only new names lock.
+/// \sa Property_key
+class Property_names
+{
+public:
+
+    /// returns the id of \c name, interns it on first use
+    static unsigned int intern(const std::string& name)
+    {
+        Property_names& names = instance();
+        int id = names.lookup(name);
+        if (id >= 0) return (unsigned int) id;
+        std::lock_guard<std::mutex> lock(names.mutex_);
+        id = names.lookup(name);
+        if (id >= 0) return (unsigned int) id;
+        return names.insert(name);
+    }
+
+    /// returns the id of \c name, or -1 if no property was ever named \c name
+    static int find(const std::string& name)
+    {
+        return instance().lookup(name);
+    }
+
+private:
+
+    struct Entry
+    {
+        std::string  name;
+        unsigned int id;
+    };
+
+    /// open addressing with linear probing, at most half full
+    struct Table
+    {
+        explicit Table(size_t capacity) : mask(capacity-1), slots(new std::atomic<const Entry*>[capacity])
+        {
+            for (size_t i=0; i<capacity; ++i) slots[i].store(NULL, std::memory_order_relaxed);
+        }
+        size_t mask;
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    };
+
+    Property_names()
+    {
+        tables_.push_back(std::unique_ptr<Table>(new Table(64)));
+        table_.store(tables_.back().get(), std::memory_order_release);
+    }
+
+    static Property_names& instance()
+    {
+        static Property_names names;
+        return names;
+    }
+
+    int lookup(const std::string& name) const
+    {
+        const Table* table = table_.load(std::memory_order_acquire);
+        for (size_t i = std::hash<std::string>()(name) & table->mask; ; i = (i+1) & table->mask)
+        {
+            const Entry* entry = table->slots[i].load(std::memory_order_acquire);
+            if (entry == NULL) return -1;
+            if (entry->name == name) return (int) entry->id;
+        }
+    }
+
+    static void place(Table* table, const Entry* entry)
+    {
+        size_t i = std::hash<std::string>()(entry->name) & table->mask;
+        while (table->slots[i].load(std::memory_order_relaxed) != NULL) i = (i+1) & table->mask;
+        table->slots[i].store(entry, std::memory_order_release);
+    }
+
+    // called with mutex_ held
+    unsigned int insert(const std::string& name)
+    {
+        Entry* entry = new Entry;
+        entry->name = name;
+        entry->id = (unsigned int) entries_.size();
+        entries_.push_back(std::unique_ptr<Entry>(entry));
+
+        Table* table = tables_.back().get();   ///< the published one
+        if (2*entries_.size() > table->mask+1) {
+            table = new Table(2*(table->mask+1));
+            tables_.push_back(std::unique_ptr<Table>(table));
+            for (size_t i=0; i<entries_.size(); ++i)
+                place(table, entries_[i].get());
+            table_.store(table, std::memory_order_release);
+        } else {
+            place(table, entry);
+        }
+        return entry->id;
+    }
+
+    std::mutex mutex_;                                ///< serializes insert()
+    std::atomic<const Table*> table_;                 ///< current table, read without lock
+    std::vector< std::unique_ptr<Table> > tables_;    ///< every table ever published
+    std::vector< std::unique_ptr<Entry> > entries_;   ///< by id
+};
+
+
+
+/// Interned, typed property name. Lookups through a key cost one table access
+/// instead of a search by name, keys are meant to be created once and cached
+/// by the code that queries properties repeatedly.
+///
+/// Usage:
+///
+///   static const Property_key<Vec3> VNORMAL("v:normal");
+///   SurfaceMesh::Vertex_property<Vec3> normals = mesh.get_vertex_property(VNORMAL);
+template <class T>
+class Property_key
+{
+public:
+
+    typedef T value_type;
+
+    explicit Property_key(const std::string& name) : name_(name), id_(Property_names::intern(name)) {}
+
+    /// name of the property
+    const std::string& name() const { return name_; }
+
+    /// interned id of the name
+    unsigned int id() const { return id_; }
+
+private:
+    std::string  name_;
+    unsigned int id_;
+};
+
+
+
+//== CLASS DEFINITION =========================================================
+
+
 class Base_property_array
 {
 public:
 
     /// Default constructor
-    Base_property_array(const std::string& name) : name_(name) {}
+    Base_property_array(const std::string& name) : name_(name), id_(Property_names::intern(name)) {}
 
     /// Destructor.
     virtual ~Base_property_array() {}
@@ -46,8 +190,17 @@ public:
     /// Let two elements swap their storage place.
     virtual void swap(size_t i0, size_t i1) = 0;
 
-    /// Return a deep copy of self.
-    virtual Base_property_array* clone () const = 0;
+    /// Reorder the elements: element i becomes the former element order[i].
+    virtual void permute(const std::vector<unsigned int>& order) = 0;
+
+    /// Return a deep copy of self, allocated from \c arena (heap if NULL).
+    virtual Base_property_array* clone (Property_arena* arena) const = 0;
+
+    /// Return the number of bytes allocated for the elements (including unused capacity).
+    virtual size_t memory_usage() const = 0;
+
+    /// Return the number of bytes n elements take.
+    virtual size_t bytes(size_t n) const = 0;
 
     /// Return the type_info of the property
     virtual const std::type_info& type() = 0;
@@ -55,10 +208,14 @@ public:
     /// Return the name of the property
     const std::string& name() const { return name_; }
 
+    /// Return the interned id of the name
+    unsigned int id() const { return id_; }
+
 
 protected:
 
     std::string name_;
+    unsigned int id_;
 };
 
 
@@ -66,17 +223,21 @@ protected:
 //== CLASS DEFINITION =========================================================
 
 
+/// Elements of a property, in a std::vector whose allocator draws from the
+/// Property_arena of the mesh, or from the heap if it has none: the storage is
+/// chosen when the array is created, element access does not depend on it.
 template <class T>
 class Property_array : public Base_property_array
 {
 public:
 
-    typedef T                                       value_type;
-    typedef std::vector<value_type>                 vector_type;
-    typedef typename vector_type::reference         reference;
-    typedef typename vector_type::const_reference   const_reference;
+    typedef T                                             value_type;
+    typedef std::vector<value_type, Property_allocator<T> > vector_type;
+    typedef typename vector_type::reference               reference;
+    typedef typename vector_type::const_reference         const_reference;
 
-    Property_array(const std::string& name, T t=T()) : Base_property_array(name), value_(t) {}
+    Property_array(const std::string& name, T t=T(), Property_arena* arena=NULL)
+        : Base_property_array(name), data_(Property_allocator<T>(arena)), value_(t) {}
 
 
 public: // virtual interface of Base_property_array
@@ -108,13 +269,33 @@ public: // virtual interface of Base_property_array
         data_[i1]=d;
     }
 
-    virtual Base_property_array* clone() const
+    virtual void permute(const std::vector<unsigned int>& order)
     {
-        Property_array<T>* p = new Property_array<T>(name_, value_);
-        p->data_ = data_;
+        assert(order.size() == data_.size());
+        vector_type permuted(data_.get_allocator());
+        permuted.reserve(order.size());
+        for (size_t i=0; i<order.size(); ++i)
+            permuted.push_back(data_[order[i]]);
+        data_.swap(permuted);
+    }
+
+    virtual Base_property_array* clone(Property_arena* arena) const
+    {
+        Property_array<T>* p = new Property_array<T>(name_, value_, arena);
+        p->data_.assign(data_.begin(), data_.end());
         return p;
     }
 
+    virtual size_t memory_usage() const
+    {
+        return data_.capacity() * sizeof(T);
+    }
+
+    virtual size_t bytes(size_t n) const
+    {
+        return n * sizeof(T);
+    }
+
     virtual const std::type_info& type() { return typeid(T); }
 
 
@@ -123,12 +304,12 @@ public:
     /// Get pointer to array (does not work for T==bool)
     const T* data() const
     {
-        return &data_[0];
+        return data_.data();
     }
 
 
-    /// Get reference to the underlying vector
-    std::vector<T>& vector()
+    /// Get reference to the underlying vector, with either storage
+    vector_type& vector()
     {
         return data_;
     }
@@ -144,12 +325,11 @@ public:
     /// Const access to the i'th element. No range check is performed!
     const_reference operator[](int _idx) const
     {
-        assert( size_t(_idx) < data_.size());
+        assert( size_t(_idx) < data_.size() );
         return data_[_idx];
     }
 
 
-
 private:
     vector_type data_;
     value_type  value_;
@@ -165,6 +345,22 @@ Property_array<bool>::data() const
     return NULL;
 }
 
+// bool properties are bit-packed
+template <>
+inline size_t
+Property_array<bool>::memory_usage() const
+{
+    return (data_.capacity() + 7) / 8;
+}
+
+// in 64 bit words
+template <>
+inline size_t
+Property_array<bool>::bytes(size_t n) const
+{
+    return (n + 63) / 64 * 8;
+}
+
 
 
 //== CLASS DEFINITION =========================================================
@@ -177,6 +373,7 @@ public:
 
     typedef typename Property_array<T>::reference reference;
     typedef typename Property_array<T>::const_reference const_reference;
+    typedef typename Property_array<T>::vector_type vector_type;
 
     friend class Property_container;
     friend class SurfaceMesh;
@@ -215,7 +412,7 @@ public:
     }
 
 
-    std::vector<T>& vector()
+    vector_type& vector()
     {
         assert(parray_ != NULL);
         return parray_->vector();
@@ -251,13 +448,13 @@ class Property_container
 public:
 
     // default constructor
-    Property_container() : size_(0) {}
+    Property_container() : size_(0), arena_(NULL) {}
 
     // destructor (deletes all property arrays)
     virtual ~Property_container() { clear(); }
 
     // copy constructor: performs deep copy of property arrays
-    Property_container(const Property_container& _rhs) { operator=(_rhs); }
+    Property_container(const Property_container& _rhs) : size_(0), arena_(NULL) { operator=(_rhs); }
 
     // assignment: performs deep copy of property arrays
     Property_container& operator=(const Property_container& _rhs)
@@ -267,8 +464,19 @@ public:
             clear();
             parrays_.resize(_rhs.n_properties());
             size_ = _rhs.size();
+            // one arena block for all the copies
+            if (arena_)
+            {
+                size_t bytes = 0;
+                for (unsigned int i=0; i<parrays_.size(); ++i)
+                    bytes += Property_arena::chunk_size(_rhs.parrays_[i]->bytes(size_));
+                arena_->reserve(bytes);
+            }
             for (unsigned int i=0; i<parrays_.size(); ++i)
-                parrays_[i] = _rhs.parrays_[i]->clone();
+            {
+                parrays_[i] = _rhs.parrays_[i]->clone(arena_);
+                set_slot(parrays_[i]->id(), parrays_[i]);
+            }
         }
         return *this;
     }
@@ -279,6 +487,25 @@ public:
     // returns the number of property arrays
     size_t n_properties() const { return parrays_.size(); }
 
+    // allocate the arrays added from now on from \c arena (heap if NULL), only while empty
+    void set_arena(Property_arena* arena)
+    {
+        assert(parrays_.empty());
+        arena_ = arena;
+    }
+
+    // returns the arena the arrays are allocated from (NULL for the heap)
+    Property_arena* arena() const { return arena_; }
+
+    // returns the number of bytes allocated for the elements of all arrays
+    size_t memory_usage() const
+    {
+        size_t bytes = 0;
+        for (unsigned int i=0; i<parrays_.size(); ++i)
+            bytes += parrays_[i]->memory_usage();
+        return bytes;
+    }
+
     // returns a vector of all property names
     std::vector<std::string> properties() const
     {
@@ -291,22 +518,26 @@ public:
 
     // add a property with name \c name and default value \c t
     template <class T> Property<T> add(const std::string& name, const T t=T())
+    {
+        return add(Property_key<T>(name), t);
+    }
+
+    // add a property with key \c key and default value \c t
+    template <class T> Property<T> add(const Property_key<T>& key, const T t=T())
     {
         // if a property with this name already exists, return an invalid property
-        for (unsigned int i=0; i<parrays_.size(); ++i)
+        if (slot(key.id()))
         {
-            if (parrays_[i]->name() == name)
-            {
-                std::cerr << "[Property_container] A property with name \""
-                          << name << "\" already exists. Returning invalid property.\n";
-                return Property<T>();
-            }
+            std::cerr << "[Property_container] A property with name \""
+                      << key.name() << "\" already exists. Returning invalid property.\n";
+            return Property<T>();
         }
 
         // otherwise add the property
-        Property_array<T>* p = new Property_array<T>(name, t);
+        Property_array<T>* p = new Property_array<T>(key.name(), t, arena_);
         p->resize(size_);
         parrays_.push_back(p);
+        set_slot(key.id(), p);
         return Property<T>(p);
     }
 
@@ -314,18 +545,29 @@ public:
     // get a property by its name. returns invalid property if it does not exist.
     template <class T> Property<T> get(const std::string& name) const
     {
-        for (unsigned int i=0; i<parrays_.size(); ++i)
-            if (parrays_[i]->name() == name)
-                return Property<T>(dynamic_cast<Property_array<T>*>(parrays_[i]));
-        return Property<T>();
+        int id = Property_names::find(name);
+        if (id < 0) return Property<T>();
+        return Property<T>(dynamic_cast<Property_array<T>*>(slot(id)));
+    }
+
+    // get a property by its key. returns invalid property if it does not exist.
+    template <class T> Property<T> get(const Property_key<T>& key) const
+    {
+        return Property<T>(dynamic_cast<Property_array<T>*>(slot(key.id())));
     }
 
 
     // returns a property if it exists, otherwise it creates it first.
     template <class T> Property<T> get_or_add(const std::string& name, const T t=T())
     {
-        Property<T> p = get<T>(name);
-        if (!p) p = add<T>(name, t);
+        return get_or_add(Property_key<T>(name), t);
+    }
+
+    // returns a property if it exists, otherwise it creates it first.
+    template <class T> Property<T> get_or_add(const Property_key<T>& key, const T t=T())
+    {
+        Property<T> p = get(key);
+        if (!p) p = add(key, t);
         return p;
     }
 
@@ -333,10 +575,9 @@ public:
     // get the type of property by its name. returns typeid(void) if it does not exist.
     const std::type_info& get_type(const std::string& name)
     {
-        for (unsigned int i=0; i<parrays_.size(); ++i)
-            if (parrays_[i]->name() == name)
-                return parrays_[i]->type();
-        return typeid(void);
+        int id = Property_names::find(name);
+        Base_property_array* p = (id < 0) ? NULL : slot(id);
+        return p ? p->type() : typeid(void);
     }
 
 
@@ -348,6 +589,7 @@ public:
         {
             if (*it == h.parray_)
             {
+                set_slot((*it)->id(), NULL);
                 delete *it;
                 parrays_.erase(it);
                 h.reset();
@@ -363,13 +605,23 @@ public:
         for (unsigned int i=0; i<parrays_.size(); ++i)
             delete parrays_[i];
         parrays_.clear();
+        slots_.clear();
         size_ = 0;
     }
 
 
-    // reserve memory for n entries in all arrays
+    // reserve memory for n entries in all arrays, from one arena block if the
+    // arrays are allocated from an arena
     void reserve(size_t n) const
     {
+        if (arena_)
+        {
+            size_t bytes = 0;
+            for (unsigned int i=0; i<parrays_.size(); ++i)
+                if (parrays_[i]->bytes(n) > parrays_[i]->memory_usage())
+                    bytes += Property_arena::chunk_size(parrays_[i]->bytes(n));
+            arena_->reserve(bytes);
+        }
         for (unsigned int i=0; i<parrays_.size(); ++i)
             parrays_[i]->reserve(n);
     }
@@ -404,10 +656,34 @@ public:
             parrays_[i]->swap(i0, i1);
     }
 
+    // reorder all arrays: element i becomes the former element order[i]
+    void permute(const std::vector<unsigned int>& order) const
+    {
+        for (unsigned int i=0; i<parrays_.size(); ++i)
+            parrays_[i]->permute(order);
+    }
+
+
+private:
+
+    // the array of the property with interned id \c id (NULL if none)
+    Base_property_array* slot(unsigned int id) const
+    {
+        return (id < slots_.size()) ? slots_[id] : NULL;
+    }
+
+    void set_slot(unsigned int id, Base_property_array* p)
+    {
+        if (id >= slots_.size()) slots_.resize(id+1, NULL);
+        slots_[id] = p;
+    }
+
 
 private:
     std::vector<Base_property_array*>  parrays_;
+    std::vector<Base_property_array*>  slots_;   ///< parrays_ indexed by interned id
     size_t  size_;
+    Property_arena* arena_;                     ///< storage of the arrays (NULL for the heap)
 };
 
 //=============================================================================
@@ -12,6 +12,10 @@
 
 #include "remesh.h"
 #include "OpenGP/SurfaceMesh/SurfaceMesh.h"
+#include "OpenGP/util/parallel.h"
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
 
 //=============================================================================
 namespace OpenGP {
@@ -54,8 +58,11 @@ static Scalar calc_dihedral_angle(SurfaceMesh & mesh, SurfaceMesh::Halfedge _heh
         return 0;
     }
 
-    auto normal = mesh.face_property<Vec3>("f:normal");
-    auto points = mesh.vertex_property<Vec3>("v:point");
+    // called once per edge, the keys spare the search by name
+    static const Property_key<Vec3> FNORMAL_KEY("f:normal");
+    static const Property_key<Vec3> VPOINT_KEY("v:point");
+    auto normal = mesh.face_property(FNORMAL_KEY);
+    auto points = mesh.vertex_property(VPOINT_KEY);
 
     const Vec3& n0 = normal[mesh.face(_heh)];
     const Vec3& n1 = normal[mesh.face(mesh.opposite_halfedge(_heh))];
@@ -182,62 +189,6 @@ static Scalar distPointTriangleSquared( const Vec3& _p,const Vec3& _v0,const Vec
     return (_nearestPoint - _p).squaredNorm();
 }
 
-inline Scalar ClosestPointTriangle(Vec3 p, Vec3 a, Vec3 b, Vec3 c, Vec3 & closest) {
-    // Check if P in vertex region outside A
-    Vec3 ab = b - a;
-    Vec3 ac = c - a;
-    Vec3 ap = p - a;
-    Scalar d1 = dot(ab, ap);
-    Scalar d2 = dot(ac, ap);
-    if (d1 <= 0 && d2 <= 0) {
-        closest = a;
-        return (p-closest).squaredNorm(); // barycentric coordinates (1,0,0)
-    }
-    // Check if P in vertex region outside B
-    Vec3 bp = p - b;
-    Scalar d3 = dot(ab, bp);
-    Scalar d4 = dot(ac, bp);
-    if (d3 >= 0 && d4 <= d3) {
-        closest = b;
-        return (p-closest).squaredNorm(); // barycentric coordinates (0,1,0)
-    }
-    // Check if P in edge region of AB, if so return projection of P onto AB
-    Scalar vc = d1*d4 - d3*d2;
-    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
-        Scalar v = d1 / (d1 - d3);
-        closest = a + v * ab;
-        return (p - closest).squaredNorm(); // barycentric coordinates (1-v,v,0)
-    }
-    // Check if P in vertex region outside C
-    Vec3 cp = p - c;
-    Scalar d5 = dot(ab, cp);
-    Scalar d6 = dot(ac, cp);
-    if (d6 >= 0 && d5 <= d6) {
-        closest = c;
-        return (p-closest).squaredNorm(); // barycentric coordinates (0,0,1)
-    }
-    // Check if P in edge region of AC, if so return projection of P onto AC
-    Scalar vb = d5*d2 - d1*d6;
-    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
-        Scalar w = d2 / (d2 - d6);
-        closest = a + w * ac;
-        return (p - closest).squaredNorm(); // barycentric coordinates (1-w,0,w)
-    }
-    // Check if P in edge region of BC, if so return projection of P onto BC
-    Scalar va = d3*d6 - d5*d4;
-    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
-        Scalar w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
-        closest = b + w * (c - b);
-        return (p - closest).squaredNorm(); // barycentric coordinates (0,1-w,w)
-    }
-    // P inside face region. Compute Q through its barycentric coordinates (u,v,w)
-    Scalar denom = 1.0 / (va + vb + vc);
-    Scalar v = vb * denom;
-    Scalar w = vc * denom;
-    closest = a + ab * v + ac * w;
-    return (p - closest).squaredNorm(); // = u*a + v*b + w*c, u = va * denom = 1 - v - w
-}
-
 inline static bool TestSphereTriangle(Point sphereCenter, Scalar sphereRadius, Point a, Point b, Point c, Point &p) {
     // Find point P on triangle ABC closest to sphere center
     ClosestPointTriangle(sphereCenter, a, b, c, p);
@@ -253,43 +204,210 @@ inline static bool TestSphereTriangle(Point sphereCenter, Scalar sphereRadius, P
     return TestSphereTriangle(sphereCenter, sphereRadius, a, b, c);
 }
 
+/// Picks a set of non-interfering operations among \c candidates. The region of
+/// a candidate (filled by region(e, vertices)) is the set of vertices its
+/// operation reads or modifies; a candidate is selected when it has the
+/// smallest priority key among all the candidates its region overlaps with,
+/// the others are deferred to a later batch. Keys are a hash of the edge index,
+/// so the selection does not depend on the number of threads and long chains
+/// of conflicting candidates are broken up in few batches.
+/// @note \c owner is scratch space (one entry per vertex, all set to UINT64_MAX)
+template <class Region>
+static void independent_set(const std::vector<SurfaceMesh::Edge>& candidates, Region region,
+                            std::vector<std::atomic<uint64_t> >& owner, std::vector<char>& selected,
+                            unsigned int n_threads) {
+    const int n = (int) candidates.size();
+    selected.assign(n, 0);
+
+    auto key = [&candidates](int i) {
+        uint32_t h = (uint32_t) candidates[i].idx();
+        h = (h ^ 61) ^ (h >> 16);
+        h *= 9;
+        h = h ^ (h >> 4);
+        h *= 0x27d4eb2d;
+        h = h ^ (h >> 15);
+        return ((uint64_t) h << 32) | (uint32_t) i;
+    };
+
+    ///--- every vertex remembers the smallest key touching it
+    parallel_for_chunks(0, n, [&](int b, int e, int) {
+        std::vector<SurfaceMesh::Vertex> vertices;
+        for (int i = b; i < e; ++i) {
+            const uint64_t k = key(i);
+            region(candidates[i], vertices);
+            for (SurfaceMesh::Vertex v : vertices) {
+                uint64_t current = owner[v.idx()].load();
+                while (k < current && !owner[v.idx()].compare_exchange_weak(current, k)) {}
+            }
+        }
+    }, 256, n_threads);
+
+    ///--- candidates owning their whole region are selected
+    parallel_for_chunks(0, n, [&](int b, int e, int) {
+        std::vector<SurfaceMesh::Vertex> vertices;
+        for (int i = b; i < e; ++i) {
+            const uint64_t k = key(i);
+            region(candidates[i], vertices);
+            bool owned = true;
+            for (SurfaceMesh::Vertex v : vertices)
+                owned = owned && (owner[v.idx()].load() == k);
+            selected[i] = owned;
+        }
+    }, 256, n_threads);
+
+    ///--- reset the scratch space
+    parallel_for_chunks(0, n, [&](int b, int e, int) {
+        std::vector<SurfaceMesh::Vertex> vertices;
+        for (int i = b; i < e; ++i) {
+            region(candidates[i], vertices);
+            for (SurfaceMesh::Vertex v : vertices)
+                owner[v.idx()].store(UINT64_MAX);
+        }
+    }, 256, n_threads);
+}
+
+/// Runs the operations proposed by \c evaluate in batches of independent sets:
+/// evaluate(e) (called concurrently on the current mesh) returns whether the
+/// operation on \c e should be applied, apply(e) performs it. With \c concurrent
+/// the operations of a batch are applied in parallel: their regions are
+/// disjoint, so apply must only write within its region (no shared counters,
+/// no topology_revision(), no allocation) and topology_changed() is called once
+/// per batch; otherwise they are applied serially, in edge order. Deferred
+/// operations are evaluated again on the updated mesh, rejected ones are
+/// dropped. Returns the number of applied operations.
+template <class Evaluate, class Region, class Apply>
+static int batched_edge_operations(SurfaceMesh& mesh, Evaluate evaluate, Region region, Apply apply,
+                                   bool concurrent, unsigned int n_threads) {
+    std::vector<SurfaceMesh::Edge> pending;
+    pending.reserve(mesh.n_edges());
+    for (SurfaceMesh::Edge e : mesh.edges())
+        pending.push_back(e);
+
+    std::vector<std::atomic<uint64_t> > owner(mesh.vertices_size());
+    parallel_for(0, (int) owner.size(), [&owner](int i) { owner[i].store(UINT64_MAX); }, 1024, n_threads);
+
+    std::vector<char> accepted, selected;
+    std::vector<SurfaceMesh::Edge> candidates, deferred, applied;
+    int n_applied = 0;
+    while (!pending.empty()) {
+        accepted.assign(pending.size(), 0);
+        parallel_for(0, (int) pending.size(), [&](int i) {
+            accepted[i] = !mesh.is_deleted(pending[i]) && evaluate(pending[i]);
+        }, 256, n_threads);
+
+        candidates.clear();
+        for (size_t i = 0; i < pending.size(); ++i)
+            if (accepted[i]) candidates.push_back(pending[i]);
+        if (candidates.empty()) break;
+
+        independent_set(candidates, region, owner, selected, n_threads);
+
+        deferred.clear();
+        applied.clear();
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (selected[i]) {
+                if (concurrent) applied.push_back(candidates[i]);
+                else apply(candidates[i]);
+                n_applied++;
+            } else {
+                deferred.push_back(candidates[i]);
+            }
+        }
+        if (concurrent) {
+            parallel_for(0, (int) applied.size(), [&](int i) { apply(applied[i]); }, 256, n_threads);
+            mesh.topology_changed();
+        }
+        pending.swap(deferred);
+    }
+    return n_applied;
+}
+
+/// SurfaceMesh::flip(e) through the low-level setters, without changing
+/// topology_revision(): flips of edges whose faces share no vertex can run
+/// concurrently, the caller then calls topology_changed()
+static void relink_flip(SurfaceMesh& mesh, SurfaceMesh::Edge e) {
+    assert(mesh.is_flip_ok(e));
+
+    const SurfaceMesh::Halfedge a0 = mesh.halfedge(e, 0);
+    const SurfaceMesh::Halfedge b0 = mesh.halfedge(e, 1);
+    const SurfaceMesh::Halfedge a1 = mesh.next_halfedge(a0);
+    const SurfaceMesh::Halfedge a2 = mesh.next_halfedge(a1);
+    const SurfaceMesh::Halfedge b1 = mesh.next_halfedge(b0);
+    const SurfaceMesh::Halfedge b2 = mesh.next_halfedge(b1);
+
+    const SurfaceMesh::Vertex va0 = mesh.to_vertex(a0);
+    const SurfaceMesh::Vertex va1 = mesh.to_vertex(a1);
+    const SurfaceMesh::Vertex vb0 = mesh.to_vertex(b0);
+    const SurfaceMesh::Vertex vb1 = mesh.to_vertex(b1);
+
+    const SurfaceMesh::Face fa = mesh.face(a0);
+    const SurfaceMesh::Face fb = mesh.face(b0);
+
+    mesh.set_vertex(a0, va1);
+    mesh.set_vertex(b0, vb1);
+
+    mesh.set_next_halfedge(a0, a2);
+    mesh.set_next_halfedge(a2, b1);
+    mesh.set_next_halfedge(b1, a0);
+
+    mesh.set_next_halfedge(b0, b2);
+    mesh.set_next_halfedge(b2, a1);
+    mesh.set_next_halfedge(a1, b0);
+
+    mesh.set_face(a1, fb);
+    mesh.set_face(b1, fa);
+
+    mesh.set_halfedge(fa, a0);
+    mesh.set_halfedge(fb, b0);
+
+    if (mesh.halfedge(va0) == b0)
+        mesh.set_halfedge(va0, a1);
+    if (mesh.halfedge(vb0) == a0)
+        mesh.set_halfedge(vb0, b1);
+}
+
 /// performs edge splits until all edges are shorter than the threshold
 void IsotropicRemesher::splitLongEdges(Scalar maxEdgeLength ) {
     *myout << __FUNCTION__ << std::endl;
 
     const Scalar maxEdgeLengthSqr = maxEdgeLength * maxEdgeLength;
 
-    SurfaceMesh::Edge_iterator e_it;
-    SurfaceMesh::Edge_iterator e_end = mesh->edges_end();
-
-    // iterate over all edges
+    // splits only shorten the split edge, so the long edges can be found upfront (in parallel)
+    const int n_edges = mesh->edges_size();
+    std::vector<char> is_long(n_edges, 0);
+    parallel_for(0, n_edges, [&](int i) {
+        SurfaceMesh::Edge e(i);
+        if (mesh->is_deleted(e)) return;
+        const SurfaceMesh::Halfedge hh = mesh->halfedge(e, 0);
+        is_long[i] = (points[mesh->to_vertex(hh)] - points[mesh->from_vertex(hh)]).squaredNorm() > maxEdgeLengthSqr;
+    }, 1024, num_threads);
+
+    // iterate over the long edges
     int n_splits = 0;
-    for (e_it = mesh->edges_begin(); e_it != e_end; ++e_it) {
-        const SurfaceMesh::Halfedge & hh = mesh->halfedge( *e_it, 0 );
+    for (int i = 0; i < n_edges; ++i) {
+        if (!is_long[i]) continue;
+        SurfaceMesh::Edge e(i);
+        const SurfaceMesh::Halfedge & hh = mesh->halfedge( e, 0 );
 
         const SurfaceMesh::Vertex & v0 = mesh->from_vertex(hh);
         const SurfaceMesh::Vertex & v1 = mesh->to_vertex(hh);
 
         Vec3 vec = points[v1] - points[v0];
 
-        // edge too long?
-        if ( vec.squaredNorm() > maxEdgeLengthSqr ) {
+        const Vec3 midPoint = points[v0] + ( 0.5 * vec );
 
-            const Vec3 midPoint = points[v0] + ( 0.5 * vec );
+        // split at midpoint
+        SurfaceMesh::Vertex vh = mesh->add_vertex( midPoint );
 
-            // split at midpoint
-            SurfaceMesh::Vertex vh = mesh->add_vertex( midPoint );
+        bool hadFeature = efeature[e];
 
-            bool hadFeature = efeature[*e_it];
+        mesh->split(e, vh);
+        n_splits++;
 
-            mesh->split(*e_it, vh);
-            n_splits++;
-
-            if ( hadFeature ) {
-                for(SurfaceMesh::Halfedge e: mesh->halfedges(vh)) {
-                    if ( mesh->to_vertex(e) == v0 || mesh->to_vertex(e) == v1 ) {
-                        efeature[mesh->edge(e)] = true;
-                    }
+        if ( hadFeature ) {
+            for(SurfaceMesh::Halfedge h: mesh->halfedges(vh)) {
+                if ( mesh->to_vertex(h) == v0 || mesh->to_vertex(h) == v1 ) {
+                    efeature[mesh->edge(h)] = true;
                 }
             }
         }
@@ -305,106 +423,100 @@ void IsotropicRemesher::collapseShortEdges(const Scalar _minEdgeLength, const Sc
     const Scalar _minEdgeLengthSqr = _minEdgeLength * _minEdgeLength;
     const Scalar _maxEdgeLengthSqr = _maxEdgeLength * _maxEdgeLength;
 
-    //add checked property
-    auto checked = mesh->edge_property< bool >("e:checked", false);
-
-    SurfaceMesh::Edge_iterator e_it;
-
-    bool finished = false;
+    auto evaluate = [&](SurfaceMesh::Edge e) {
+        const SurfaceMesh::Halfedge hh = mesh->halfedge(e,0);
 
-    int n_collapsed = 0;
-    while( !finished ) {
-        finished = true;
-        for (e_it = mesh->edges_begin(); e_it != mesh->edges_end() ; ++e_it) {
+        const SurfaceMesh::Vertex v0 = mesh->from_vertex(hh);
+        const SurfaceMesh::Vertex v1 = mesh->to_vertex(hh);
 
-            if ( checked[*e_it] )
-                continue;
+        const Scalar edgeLength = (points[v1] - points[v0]).squaredNorm();
 
-            checked[*e_it] = true;
+        // Keep originally short edges, if requested
+        if ( isKeepShortEdges && efeature[e] ) return false;
 
-            const SurfaceMesh::Halfedge & hh = mesh->halfedge(*e_it,0);
+        // edge too short but don't try to collapse edges that have length 0
+        if ( !(edgeLength < _minEdgeLengthSqr) || !(edgeLength > std::numeric_limits<Scalar>::epsilon()) ) return false;
 
-            const SurfaceMesh::Vertex & v0 = mesh->from_vertex(hh);
-            const SurfaceMesh::Vertex & v1 = mesh->to_vertex(hh);
-
-            const Vec3 vec = points[v1] - points[v0];
-
-            const Scalar edgeLength = vec.squaredNorm();
-
-            // Keep originally short edges, if requested
-            bool hadFeature = efeature[*e_it];
-            if ( isKeepShortEdges && hadFeature ) continue;
-
-            // edge too short but don't try to collapse edges that have length 0
-            if ( (edgeLength < _minEdgeLengthSqr) && (edgeLength > std::numeric_limits<Scalar>::epsilon()) ) {
-
-                //check if the collapse is ok
-                const Vec3 & B = points[v1];
-
-                bool collapse_ok = true;
-
-            for( SurfaceMesh::Halfedge hvit: mesh->halfedges(v0) ) {
-                    Scalar d = (B - points[ mesh->to_vertex(hvit) ]).squaredNorm();
+        //check if the collapse is ok
+        const Vec3 & B = points[v1];
+        for( SurfaceMesh::Halfedge hvit: mesh->halfedges(v0) ) {
+            Scalar d = (B - points[ mesh->to_vertex(hvit) ]).squaredNorm();
+            if ( d > _maxEdgeLengthSqr || mesh->is_boundary( mesh->edge( hvit ) ) || efeature[mesh->edge(hvit)] )
+                return false;
+        }
+        return mesh->is_collapse_ok(hh);
+    };
+
+    // a collapse reads and rewires the one-rings of both endpoints
+    auto region = [this](SurfaceMesh::Edge e, std::vector<SurfaceMesh::Vertex>& vertices) {
+        vertices.clear();
+        for (int i = 0; i < 2; ++i) {
+            SurfaceMesh::Vertex v = mesh->vertex(e, i);
+            vertices.push_back(v);
+            for (SurfaceMesh::Vertex vv : mesh->vertices(v))
+                vertices.push_back(vv);
+        }
+    };
 
-                    if ( d > _maxEdgeLengthSqr || mesh->is_boundary( mesh->edge( hvit ) ) || efeature[mesh->edge(hvit)] ) {
-                        collapse_ok = false;
-                        break;
-                    }
-                }
+    // serial: a collapse marks elements deleted, in bit-packed flags shared with
+    // the neighbouring elements, and updates the deleted counters of the mesh
+    auto apply = [this](SurfaceMesh::Edge e) { mesh->collapse(mesh->halfedge(e,0)); };
 
-                if( collapse_ok && mesh->is_collapse_ok(hh) ) {
-                    mesh->collapse( hh );
-                    n_collapsed++;
-                    finished = false;
-                }
-            }
-        }
-    }
+    int n_collapsed = batched_edge_operations(*mesh, evaluate, region, apply, false, num_threads);
 
     *myout << "    collapsed " << n_collapsed << " edges" << std::endl;
 
-    mesh->remove_edge_property(checked);
-    mesh->garbage_collection();
+    // the other phases skip deleted elements, compact only once they pile up
+    if (mesh->garbage_collection_if_needed())
+        *myout << "    garbage collected" << std::endl;
 }
 
 void IsotropicRemesher::equalizeValences(){
     *myout << __FUNCTION__ << std::endl;
 
-    SurfaceMesh::Edge_iterator e_it;
-    SurfaceMesh::Edge_iterator e_end = mesh->edges_end();
-
-    for (e_it = mesh->edges_begin(); e_it != e_end; ++e_it) {
-
-        if ( !mesh->is_flip_ok(*e_it) ) continue;
-        if ( efeature[*e_it] ) continue;
-
-        const SurfaceMesh::Halfedge & h0 = mesh->halfedge( *e_it, 0 );
-        const SurfaceMesh::Halfedge & h1 = mesh->halfedge( *e_it, 1 );
-
-        if (h0.is_valid() && h1.is_valid()) {
-            if (mesh->face(h0).is_valid() && mesh->face(h1).is_valid()) {
-                //get vertices of corresponding faces
-                const SurfaceMesh::Vertex & a = mesh->to_vertex(h0);
-                const SurfaceMesh::Vertex & b = mesh->to_vertex(h1);
-                const SurfaceMesh::Vertex & c = mesh->to_vertex(mesh->next_halfedge(h0));
-                const SurfaceMesh::Vertex & d = mesh->to_vertex(mesh->next_halfedge(h1));
-
-                const int deviation_pre =  abs((int)(mesh->valence(a) - targetValence(a)))
-                                           +abs((int)(mesh->valence(b) - targetValence(b)))
-                                           +abs((int)(mesh->valence(c) - targetValence(c)))
-                                           +abs((int)(mesh->valence(d) - targetValence(d)));
-                mesh->flip(*e_it);
-
-                const int deviation_post = abs((int)(mesh->valence(a) - targetValence(a)))
-                                           +abs((int)(mesh->valence(b) - targetValence(b)))
-                                           +abs((int)(mesh->valence(c) - targetValence(c)))
-                                           +abs((int)(mesh->valence(d) - targetValence(d)));
-
-                if (deviation_pre <= deviation_post)
-                    mesh->flip(*e_it);
-            }
-        }
-    }
+    // the valence deviation after the flip follows from the current valences:
+    // a and b lose an edge, c and d gain one
+    auto evaluate = [&](SurfaceMesh::Edge e) {
+        if ( !mesh->is_flip_ok(e) ) return false;
+        if ( efeature[e] ) return false;
+
+        const SurfaceMesh::Halfedge h0 = mesh->halfedge( e, 0 );
+        const SurfaceMesh::Halfedge h1 = mesh->halfedge( e, 1 );
+
+        //get vertices of corresponding faces
+        const SurfaceMesh::Vertex a = mesh->to_vertex(h0);
+        const SurfaceMesh::Vertex b = mesh->to_vertex(h1);
+        const SurfaceMesh::Vertex c = mesh->to_vertex(mesh->next_halfedge(h0));
+        const SurfaceMesh::Vertex d = mesh->to_vertex(mesh->next_halfedge(h1));
+
+        const int da = (int) mesh->valence(a) - targetValence(a);
+        const int db = (int) mesh->valence(b) - targetValence(b);
+        const int dc = (int) mesh->valence(c) - targetValence(c);
+        const int dd = (int) mesh->valence(d) - targetValence(d);
+
+        const int deviation_pre  = abs(da) + abs(db) + abs(dc) + abs(dd);
+        const int deviation_post = abs(da-1) + abs(db-1) + abs(dc+1) + abs(dd+1);
+        return deviation_post < deviation_pre;
+    };
+
+    // a flip reads and changes the valences of the vertices of its two faces
+    auto region = [this](SurfaceMesh::Edge e, std::vector<SurfaceMesh::Vertex>& vertices) {
+        const SurfaceMesh::Halfedge h0 = mesh->halfedge( e, 0 );
+        const SurfaceMesh::Halfedge h1 = mesh->halfedge( e, 1 );
+        vertices.clear();
+        vertices.push_back(mesh->to_vertex(h0));
+        vertices.push_back(mesh->to_vertex(h1));
+        vertices.push_back(mesh->to_vertex(mesh->next_halfedge(h0)));
+        vertices.push_back(mesh->to_vertex(mesh->next_halfedge(h1)));
+    };
+
+    // concurrent: a flip only re-links the halfedges of its two faces and the
+    // outgoing halfedges of their vertices
+    auto apply = [this](SurfaceMesh::Edge e) { relink_flip(*mesh, e); };
+
+    int n_flips = batched_edge_operations(*mesh, evaluate, region, apply, true, num_threads);
+
+    *myout << "    flipped " << n_flips << " edges" << std::endl;
 }
 
 ///returns 4 for boundary vertices and 6 otherwise
@@ -442,75 +554,51 @@ void IsotropicRemesher::tangentialRelaxation() {
     auto q = mesh->vertex_property<Vec3>("v:q");
     auto normal = mesh->vertex_property<Vec3>(VNORMAL);
 
-    SurfaceMesh::Vertex_iterator v_it;
-    SurfaceMesh::Vertex_iterator v_end = mesh->vertices_end();
+    // positions are double buffered: all barycenters are computed from the
+    // current points before any vertex moves, so both loops run in parallel
+    const int n_vertices = mesh->vertices_size();
+
+    // one-rings from the CSR snapshot, kept from the previous iteration when
+    // splits, collapses and flips left the connectivity untouched
+    adjacency.update(*mesh);
 
     //first compute barycenters
-    for (v_it = mesh->vertices_begin(); v_it != v_end; ++v_it) {
+    parallel_for(0, n_vertices, [&](int i) {
+        SurfaceMesh::Vertex v(i);
+        if (mesh->is_deleted(v)) return;
 
         Vec3 tmp(0,0,0);
         unsigned int N = 0;
 
-        for( SurfaceMesh::Halfedge hvit: mesh->halfedges(*v_it) ) {
-            tmp += points[ mesh->to_vertex(hvit) ];
+        for( SurfaceMesh::Vertex vv: adjacency.vertices(v) ) {
+            tmp += points[vv];
             N++;
         }
 
         if (N > 0)
             tmp /= (Scalar) N;
 
-        q[*v_it] = tmp;
-    }
+        q[v] = tmp;
+    }, 1024, num_threads);
 
     //move to new position
-    for (v_it = mesh->vertices_begin(); v_it != v_end; ++v_it) {
-        if ( !isBoundary(*v_it) && !isFeature(*v_it) ) {
+    parallel_for(0, n_vertices, [&](int i) {
+        SurfaceMesh::Vertex v(i);
+        if (mesh->is_deleted(v)) return;
+        if ( !isBoundary(v) && !isFeature(v) ) {
             if(reproject_on_tanget)
-                points[*v_it] = q[*v_it] + (dot(normal[*v_it], Vec3(points[*v_it] - q[*v_it]) ) * normal[*v_it]);
+                points[v] = q[v] + (dot(normal[v], Vec3(points[v] - q[v]) ) * normal[v]);
             else
-                points[*v_it] = q[*v_it];
+                points[v] = q[v];
         }
-    }
+    }, 1024, num_threads);
 
     mesh->remove_vertex_property(q);
 }
 
-Vec3 IsotropicRemesher::findNearestPoint(SurfaceMesh& original_mesh, const Vec3& _point, SurfaceMesh::Face& _fh, Scalar& /*=*/ _dbest) {
-    auto orig_points = original_mesh.vertex_property<Vec3>( VPOINT );
-
-    Vec3 p_best(nan(), nan(), nan());
-    Scalar d_best = inf();
-    SurfaceMesh::Face fh_best;
-
-    // exhaustive search
-    for(SurfaceMesh::Face f: original_mesh.faces()) {
-        SurfaceMesh::Vertex_around_face_circulator cfv_it = original_mesh.vertices(f);
-
-        // Assume triangular
-        const Vec3& pt0 = orig_points[     *cfv_it];
-        const Vec3& pt1 = orig_points[ *(++cfv_it)];
-        const Vec3& pt2 = orig_points[ *(++cfv_it)];
-
-        Vec3 ptn = _point;
-
-        //SurfaceMesh::Scalar d = distPointTriangleSquared( _point, pt0, pt1, pt2, ptn );
-        Scalar d = ClosestPointTriangle( _point, pt0, pt1, pt2, ptn );
-
-        if( d < d_best) {
-            d_best = d;
-            p_best = ptn;
-
-            fh_best = f;
-        }
-    }
-
-    // return face
-    _fh = fh_best;
-
-    // return distance
-    _dbest = sqrt(d_best);
-
-    return p_best;
+Vec3 IsotropicRemesher::findNearestPoint(const Vec3& _point, SurfaceMesh::Face& _fh, Scalar& /*=*/ _dbest) {
+    // hierarchical search on the original surface (replaces the exhaustive loop over its faces)
+    return surface.closest_point(_point, &_fh, &_dbest);
 }
 
 void IsotropicRemesher::projectToSurface() {
@@ -520,34 +608,60 @@ void IsotropicRemesher::projectToSurface() {
     for(SurfaceMesh::Vertex v: mesh->vertices())
         points[v] = searcher.closest_point(points[v]);
 #else
-    SurfaceMesh::Vertex_iterator v_it;
-    SurfaceMesh::Vertex_iterator v_end = mesh->vertices_end();
-    for (v_it = mesh->vertices_begin(); v_it != v_end; ++v_it) {
-        if (isBoundary(*v_it)) continue;
-        if ( isFeature(*v_it)) continue;
+    // queries are independent and only read the mesh, each thread moves its own vertices
+    parallel_for(0, mesh->vertices_size(), [this](int i) {
+        SurfaceMesh::Vertex v(i);
+        if (mesh->is_deleted(v)) return;
+        if (isBoundary(v)) return;
+        if ( isFeature(v)) return;
 
-        Vec3 p = points[*v_it];
+        Vec3 p = points[v];
 
         SurfaceMesh::Face fhNear;
         Scalar distance;
 
-        Vec3 pNear = findNearestPoint(copy, p, fhNear, distance);
+        Vec3 pNear = findNearestPoint(p, fhNear, distance);
 
-        points[*v_it] = pNear;
-    }
+        points[v] = pNear;
+    }, 256, num_threads);
 #endif
 }
 
+/// milliseconds elapsed since \c start
+static inline double elapsed_ms(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
 void IsotropicRemesher::execute(){
     *myout << __FUNCTION__ << std::endl;
+    timings = Timings();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#ifndef WITH_CGAL
+    ///--- Snapshot of the input surface for projectToSurface()
+    if(reproject_to_surface)
+        surface.build(*mesh);
+#endif
     phase_analyze();
+    timings.analyze = elapsed_ms(start);
     phase_remesh();
+
+    *myout << "---------------------------------------------" << std::endl;
+    *myout << "Timings [ms]:"
+           << " analyze " << timings.analyze
+           << " split " << timings.split
+           << " collapse " << timings.collapse
+           << " flip " << timings.flip
+           << " relax " << timings.relax
+           << " project " << timings.project << std::endl;
 }
 
 void IsotropicRemesher::phase_analyze(){
     // Conver to radians
     Scalar TH = deg_to_rad(sharp_feature_deg);
 
+    ///--- Dihedral angles need face normals
+    mesh->update_face_normals();
+
     ///--- Identify feature edges
     for(SurfaceMesh::Edge e: mesh->edges()) {
         Scalar dihedral = calc_dihedral_angle(*mesh, mesh->halfedge(e,0));
@@ -585,13 +699,30 @@ void IsotropicRemesher::phase_remesh(){
         *myout << "---------------------------------------------" << std::endl;
         *myout << "Iteration: " << (i+1) << "/" << num_iterations <<
                   " on mesh with #vertices: " << mesh->n_vertices() << std::endl;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
         splitLongEdges(high);
+        timings.split += elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
         collapseShortEdges(low, high, keep_short_edges);
+        timings.collapse += elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
         equalizeValences();
+        timings.flip += elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
         tangentialRelaxation();
-        if(reproject_to_surface)
+        timings.relax += elapsed_ms(start);
+
+        if(reproject_to_surface) {
+            start = std::chrono::steady_clock::now();
             projectToSurface();
+            timings.project += elapsed_ms(start);
+        }
     }
+
+    mesh->garbage_collection();
 }
 
 //=============================================================================
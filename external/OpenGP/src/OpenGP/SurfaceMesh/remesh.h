@@ -15,6 +15,8 @@
 #include <OpenGP/types.h>
 #include <OpenGP/NullStream.h>
 #include <OpenGP/SurfaceMesh/SurfaceMesh.h>
+#include <OpenGP/SurfaceMesh/AABBTree.h>
+#include <OpenGP/SurfaceMesh/Adjacency.h>
 
 #ifdef WITH_CGAL
     #include <OpenGP/SurfaceMesh/Eigen.h>
@@ -44,16 +46,14 @@ private:
     SurfaceMesh::Vertex_property<Vec3> points;
     SurfaceMesh::Edge_property<bool> efeature;
     SurfaceMesh* mesh = NULL;
-    SurfaceMesh copy;
+    AABBTree surface; ///< original surface, see reproject_to_surface
+    SurfaceMeshAdjacency adjacency; ///< one-rings for tangentialRelaxation, rebuilt only after the connectivity changed
 public:
     IsotropicRemesher(SurfaceMesh& _mesh){
         this->mesh = &_mesh;
         efeature = mesh->edge_property<bool>("e:feature", false);
         points = mesh->vertex_property<Vec3>(VPOINT);
 
-        if(reproject_to_surface)
-            copy = *mesh; ///< deep copy
-
 #ifdef WITH_CGAL
         VerticesMatrixMap vertices = vertices_matrix(*mesh);
         TrianglesMatrix faces = faces_matrix(*mesh);
@@ -91,8 +91,24 @@ public:
     /// After tangentially relaxing vertices, should I reproject vertices on the tangent space
     /// defined by vertex + vertex normal?
     bool reproject_on_tanget = true;
-    /// After tangentially relaxing vertices, should I project on the original surface (slow, query an AABB search tree)
+    /// After tangentially relaxing vertices, should I project on the original surface (queries an AABB search tree)
     bool reproject_to_surface = false;
+    /// How many threads should the parallel phases use? (0: one per hardware thread)
+    /// The output does not depend on this value.
+    unsigned int num_threads = 0;
+/// @}
+
+/// @{ statistics
+public:
+    /// Wall-clock time (ms) spent in each phase, accumulated over the iterations of execute()
+    struct Timings{
+        double analyze = 0;
+        double split = 0;
+        double collapse = 0;
+        double flip = 0;
+        double relax = 0;
+        double project = 0;
+    } timings;
 /// @}
 
 #ifdef WITH_CGAL
@@ -110,7 +126,7 @@ private:
     int targetValence(const SurfaceMesh::Vertex &_vh);
     bool isBoundary(const SurfaceMesh::Vertex &_vh);
     bool isFeature(const SurfaceMesh::Vertex &_vh);
-    Vec3 findNearestPoint(SurfaceMesh& orginal_mesh, const Vec3& _point, SurfaceMesh::Face& _fh, Scalar & _dbest);
+    Vec3 findNearestPoint(const Vec3& _point, SurfaceMesh::Face& _fh, Scalar & _dbest);
 /// @} utilities
 };
 
@@ -0,0 +1,97 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Read-only view of a whole file. The file is memory mapped where the
+/// platform supports it (POSIX), otherwise it is read into memory in a
+/// single fread. Either way the content is accessed as one contiguous
+/// [data(), data()+size()) range which is NOT null terminated.
+///
+/// Usage:
+///
+///   MappedFile file;
+///   if (!file.open("mesh.obj")) return false;
+///   const char* begin = file.data();
+///   const char* end = begin + file.size();
+class MappedFile{
+public:
+    MappedFile() : _data(NULL), _size(0), _mapped(false){}
+    ~MappedFile(){ close(); }
+
+    bool open(const std::string& filename){
+        close();
+#ifndef _WIN32
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+        _size = (size_t) st.st_size;
+        if (_size > 0) {
+            void* ptr = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                madvise(ptr, _size, MADV_SEQUENTIAL);
+                _data = (const char*) ptr;
+                _mapped = true;
+            }
+        }
+        ::close(fd);
+        if (_mapped || _size == 0) return true;
+#endif
+        ///--- fallback: slurp the file
+        FILE* in = fopen(filename.c_str(), "rb");
+        if (!in) return false;
+        fseek(in, 0, SEEK_END);
+        long n = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        _buffer.resize(n > 0 ? n : 0);
+        size_t n_read = _buffer.empty() ? 0 : fread(&_buffer[0], 1, _buffer.size(), in);
+        fclose(in);
+        _buffer.resize(n_read);
+        _data = _buffer.empty() ? NULL : &_buffer[0];
+        _size = _buffer.size();
+        return true;
+    }
+
+    void close(){
+#ifndef _WIN32
+        if (_mapped) munmap((void*) _data, _size);
+#endif
+        std::vector<char>().swap(_buffer);
+        _data = NULL;
+        _size = 0;
+        _mapped = false;
+    }
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool is_mapped() const { return _mapped; }
+
+private:
+    MappedFile(const MappedFile&); ///< non-copyable
+    MappedFile& operator=(const MappedFile&);
+
+    const char* _data;
+    size_t _size;
+    bool _mapped;
+    std::vector<char> _buffer;
+};
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
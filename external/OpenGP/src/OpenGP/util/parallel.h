@@ -0,0 +1,64 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Number of worker threads used by the parallel helpers (at least 1)
+inline unsigned int parallel_num_threads(){
+    unsigned int n = std::thread::hardware_concurrency();
+    return (n == 0) ? 1 : n;
+}
+
+/// Splits [begin,end) into (at most) one contiguous chunk per thread and
+/// calls f(chunk_begin, chunk_end, thread_id) on each of them. The split
+/// only depends on the range and on the number of threads, so per-thread
+/// buffers indexed by thread_id can be reduced in a deterministic order.
+///
+/// Usage:
+///
+///   parallel_for_chunks(0, n, [&](int b, int e, int tid){
+///       for(int i=b; i<e; ++i) ...
+///   });
+///
+/// @note ranges smaller than \c grain are executed on the calling thread
+template <class Function>
+void parallel_for_chunks(int begin, int end, Function f, int grain=1024, unsigned int n_threads=0){
+    const int n = end - begin;
+    if (n <= 0) return;
+    if (n_threads == 0) n_threads = parallel_num_threads();
+    n_threads = std::min<unsigned int>(n_threads, (n + grain - 1) / std::max(grain, 1));
+    if (n_threads <= 1) { f(begin, end, 0); return; }
+
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads - 1);
+    const int chunk = (n + n_threads - 1) / n_threads;
+    for (unsigned int t = 1; t < n_threads; ++t) {
+        const int b = begin + t * chunk;
+        const int e = std::min(end, b + chunk);
+        if (b >= e) break;
+        workers.push_back(std::thread(f, b, e, (int) t));
+    }
+    f(begin, std::min(end, begin + chunk), 0); ///< calling thread takes the first chunk
+    for (std::thread& w : workers) w.join();
+}
+
+/// Calls f(i) for every i in [begin,end), distributing contiguous chunks over threads.
+/// @see parallel_for_chunks
+template <class Function>
+void parallel_for(int begin, int end, Function f, int grain=1024, unsigned int n_threads=0){
+    parallel_for_chunks(begin, end, [&f](int b, int e, int){
+        for (int i = b; i < e; ++i) f(i);
+    }, grain, n_threads);
+}
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
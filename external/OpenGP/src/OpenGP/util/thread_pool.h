@@ -0,0 +1,105 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <OpenGP/util/parallel.h>
+
+//=============================================================================
+namespace OpenGP {
+//=============================================================================
+
+/// Fixed set of worker threads executing jobs in submission order. Unlike
+/// parallel_for the workers persist, so long running programs can hand out
+/// work (e.g. streaming) without creating threads every time.
+///
+/// Usage:
+///
+///   ThreadPool pool;
+///   pool.submit([](){ ... });
+///   pool.wait(); ///< all submitted jobs are done
+///
+/// @note jobs must not throw, the destructor waits for the queued jobs
+class ThreadPool{
+public:
+    explicit ThreadPool(unsigned int n_threads = 0) : _busy(0), _stop(false){
+        if (n_threads == 0) n_threads = parallel_num_threads();
+        for (unsigned int t = 0; t < n_threads; ++t)
+            _workers.push_back(std::thread([this](){ run(); }));
+    }
+
+    ~ThreadPool(){
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (std::thread& w : _workers) w.join();
+    }
+
+    /// queues \c job, it runs on one of the workers
+    void submit(std::function<void()> job){
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobs.push_back(std::move(job));
+        }
+        _wake.notify_one();
+    }
+
+    /// blocks until the queue is empty and no job is running
+    void wait(){
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idle.wait(lock, [this](){ return _jobs.empty() && _busy == 0; });
+    }
+
+    /// jobs queued or running
+    size_t pending(){
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _jobs.size() + _busy;
+    }
+
+    unsigned int size() const { return (unsigned int) _workers.size(); }
+
+private:
+    void run(){
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [this](){ return _stop || !_jobs.empty(); });
+                if (_jobs.empty()) return; ///< stopping and nothing left
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+                ++_busy;
+            }
+            job();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                --_busy;
+                if (_jobs.empty() && _busy == 0) _idle.notify_all();
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+private:
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()> > _jobs;
+    std::mutex _mutex;
+    std::condition_variable _wake;   ///< signals workers: new job or stop
+    std::condition_variable _idle;   ///< signals wait(): everything done
+    unsigned int _busy;
+    bool _stop;
+};
+
+//=============================================================================
+} // namespace OpenGP
+//=============================================================================
@@ -0,0 +1,85 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <OpenGP/SurfaceMesh/SurfaceMesh.h>
+#include <OpenGP/SurfaceMesh/Subdivision/Loop.h>
+
+using namespace OpenGP;
+
+/// Regression tests of the surface mesh algorithms, run by ctest. No window or
+/// GL context.
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+/// closed octahedron, 6 vertices and 8 faces
+static SurfaceMesh octahedron() {
+    SurfaceMesh mesh;
+    const SurfaceMesh::Vertex v[6] = {
+        mesh.add_vertex(Vec3( 1, 0, 0)), mesh.add_vertex(Vec3(-1, 0, 0)),
+        mesh.add_vertex(Vec3( 0, 1, 0)), mesh.add_vertex(Vec3( 0,-1, 0)),
+        mesh.add_vertex(Vec3( 0, 0, 1)), mesh.add_vertex(Vec3( 0, 0,-1))};
+    mesh.add_triangle(v[0], v[2], v[4]);
+    mesh.add_triangle(v[2], v[1], v[4]);
+    mesh.add_triangle(v[1], v[3], v[4]);
+    mesh.add_triangle(v[3], v[0], v[4]);
+    mesh.add_triangle(v[2], v[0], v[5]);
+    mesh.add_triangle(v[1], v[2], v[5]);
+    mesh.add_triangle(v[3], v[1], v[5]);
+    mesh.add_triangle(v[0], v[3], v[5]);
+    return mesh;
+}
+
+/// the normals of a mesh are derived data: Loop subdivision takes the fast path
+/// on a mesh that has them and recomputes them, with the same points as the
+/// incremental path
+static void test_loop_with_normals() {
+    SurfaceMesh mesh = octahedron();
+    mesh.update_face_normals();
+    mesh.update_vertex_normals();
+    check(SurfaceMeshSubdivideLoop::has_fast_path(mesh), "Loop takes the fast path on a mesh with normals");
+
+    ///--- any other face property sends the reference down the incremental path
+    SurfaceMesh reference = octahedron();
+    reference.add_face_property<int>("f:tag");
+    check(!SurfaceMeshSubdivideLoop::has_fast_path(reference), "Loop takes the incremental path with a face property");
+
+    ///--- vertices keep their index and edge e becomes vertex n_vertices()+e on both paths
+    SurfaceMeshSubdivideLoop::exec(mesh, 1);
+    SurfaceMeshSubdivideLoop::exec(reference, 1);
+    check(mesh.n_vertices() == reference.n_vertices() && mesh.n_faces() == reference.n_faces(), "both paths refine alike");
+    if (mesh.n_vertices() != reference.n_vertices()) return;
+
+    Scalar points_error = 0;
+    for (SurfaceMesh::Vertex v : mesh.vertices())
+        points_error = std::max(points_error, (mesh.position(v) - reference.position(v)).norm());
+    check(points_error < 1e-5, "both paths compute the same points");
+
+    check(SurfaceMeshSubdivideLoop::has_fast_path(mesh), "the subdivided mesh still takes the fast path");
+    SurfaceMeshSubdivideLoop::exec(mesh, 1);
+
+    SurfaceMesh::Face_property<Vec3> fnormal = mesh.get_face_property<Vec3>("f:normal");
+    SurfaceMesh::Vertex_property<Vec3> vnormal = mesh.get_vertex_property<Vec3>("v:normal");
+    check(fnormal && vnormal, "the normals are kept");
+    if (!fnormal || !vnormal) return;
+    Scalar face_error = 0, vertex_error = 0;
+    for (SurfaceMesh::Face f : mesh.faces())
+        face_error = std::max(face_error, (fnormal[f] - mesh.compute_face_normal(f)).norm());
+    for (SurfaceMesh::Vertex v : mesh.vertices())
+        vertex_error = std::max(vertex_error, (vnormal[v] - mesh.compute_vertex_normal(v)).norm());
+    check(face_error < 1e-5, "face normals are recomputed");
+    check(vertex_error < 1e-5, "vertex normals are recomputed");
+}
+
+int main() {
+    test_loop_with_normals();
+    if (failures == 0) std::printf("all tests passed\n");
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
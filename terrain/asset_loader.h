@@ -0,0 +1,88 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "OpenGP/util/thread_pool.h"
+
+using namespace OpenGP;
+
+/// Loads assets concurrently. Every asset is a job in two parts: the \c work
+/// (decoding, generating, ...) runs on a pool of worker threads, the \c finish
+/// (GL uploads) runs on the thread calling poll(), i.e. on the GL context, as
+/// soon as the work is done. Startup then takes about as long as the slowest
+/// asset instead of the sum of all of them, and the window keeps responding
+/// while the assets arrive.
+///
+/// Usage:
+///
+///   AssetLoader loader;
+///   loader.add("skybox", [&](){ decode }, [&](){ upload });
+///   ...
+///   every frame: if (!loader.poll()) { draw a loading screen; return; }
+class AssetLoader {
+public:
+    typedef std::function<void()> Job;
+    /// Called on the GL thread after every finished asset with (done, total, name)
+    typedef std::function<void(int, int, const std::string&)> Progress;
+
+    explicit AssetLoader(unsigned int n_threads = 0) : _done(0), _pool(n_threads) {}
+
+    void set_progress(Progress progress) { _progress = progress; }
+
+    /// Queues \c work on the workers, then \c finish (if any) on the next poll()
+    void add(const std::string& name, Job work, Job finish = Job()) {
+        const size_t index = _assets.size();
+        _assets.push_back(Asset());
+        _assets.back().name = name;
+        _assets.back().finish = finish;
+        _pool.submit([this, index, work](){
+            work();
+            std::unique_lock<std::mutex> lock(_mutex);
+            _ready.push_back(index);
+        });
+    }
+
+    /// Runs the finish part of the assets whose work is done, true once everything is loaded
+    bool poll() {
+        std::vector<size_t> ready;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            ready.swap(_ready);
+        }
+        for (size_t index : ready) {
+            if (_assets[index].finish) _assets[index].finish();
+            ++_done;
+            if (_progress) _progress(_done, total(), _assets[index].name);
+        }
+        return done();
+    }
+
+    /// Blocks until everything is loaded
+    void wait() {
+        _pool.wait();
+        poll();
+    }
+
+    bool done() const { return _done == total(); }
+    int n_done() const { return _done; }
+    int total() const { return (int) _assets.size(); }
+
+private:
+    struct Asset {
+        std::string name;
+        Job finish;
+    };
+
+    AssetLoader(const AssetLoader&);
+    AssetLoader& operator=(const AssetLoader&);
+
+private:
+    std::vector<Asset> _assets;     ///< only touched by the GL thread
+    int _done;
+    Progress _progress;
+    std::mutex _mutex;              ///< guards _ready
+    std::vector<size_t> _ready;     ///< work done, finish pending
+    ThreadPool _pool;               ///< last: joined before the members its jobs use
+};
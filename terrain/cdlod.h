@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "OpenGP/types.h"
+#include "culling.h"
+
+using namespace OpenGP;
+
+/// A square of terrain drawn with one instance of the shared grid mesh
+struct TerrainPatch {
+    float x, y;         ///< world position of the corner
+    float size;         ///< world size of a side
+    int level;          ///< LOD level, 0 is the finest
+    float zmin, zmax;   ///< displaced height range
+    float distance;     ///< from the camera to the bounding box
+};
+
+/// Position of node (i,j) at \c depth of a quadtree stored level by level, root first
+inline int quadtree_index(int depth, int i, int j) {
+    return ((1 << (2*depth)) - 1)/3 + j*(1 << depth) + i;
+}
+
+/// Min/max of every node of a quadtree of \c levels over a (resolution+1)^2
+/// heightmap, in quadtree_index order; nodes include their border samples
+inline void quadtree_bounds(const float* heights, int resolution, int levels, std::vector<float>& min, std::vector<float>& max) {
+    const int n = resolution + 1;
+    const int leaves = 1 << (levels - 1);
+    min.resize(quadtree_index(levels, 0, 0));
+    max.resize(min.size());
+    for (int j = 0; j < leaves; ++j) {
+        for (int i = 0; i < leaves; ++i) {
+            float lo = heights[(j*resolution/leaves)*n + i*resolution/leaves], hi = lo;
+            for (int y = j*resolution/leaves; y <= (j+1)*resolution/leaves; ++y) {
+                for (int x = i*resolution/leaves; x <= (i+1)*resolution/leaves; ++x) {
+                    lo = std::min(lo, heights[y*n + x]);
+                    hi = std::max(hi, heights[y*n + x]);
+                }
+            }
+            min[quadtree_index(levels-1, i, j)] = lo;
+            max[quadtree_index(levels-1, i, j)] = hi;
+        }
+    }
+    for (int depth = levels - 2; depth >= 0; --depth) {
+        for (int j = 0; j < (1 << depth); ++j) {
+            for (int i = 0; i < (1 << depth); ++i) {
+                const int c = quadtree_index(depth+1, 2*i, 2*j);
+                const int d = c + (1 << (depth+1));
+                min[quadtree_index(depth, i, j)] = std::min(std::min(min[c], min[c+1]), std::min(min[d], min[d+1]));
+                max[quadtree_index(depth, i, j)] = std::max(std::max(max[c], max[c+1]), std::max(max[d], max[d+1]));
+            }
+        }
+    }
+}
+
+/// Continuous distance-dependent level of detail (CDLOD, Strugar 2009). Each
+/// tile is the root of a quadtree, a node is split while the camera is closer
+/// than the range of the next finer level. Every node is drawn with the same
+/// grid of grid x grid quads, so a patch at level l has 2^l times coarser quads
+/// than a leaf. Beyond the range of a whole tile the levels continue with the
+/// grid subsampled by 2, 4, ... (stride()), so the triangle count depends on
+/// the distance to the camera rather than on how much terrain is in view.
+/// Towards the end of its range a patch morphs into the next coarser level in
+/// the vertex shader (odd grid vertices slide onto their even neighbours), so
+/// neither popping nor cracks appear.
+class TerrainLOD {
+public:
+    struct Settings {
+        int grid;           ///< quads per patch side (the shared mesh has grid+1 vertices per side)
+        int levels;         ///< quadtree depth, a root (tile) patch is at level levels-1
+        int coarse_levels;  ///< levels above a tile, drawn with a subsampled grid
+        float leaf_range;   ///< distance up to which leaves are drawn, doubles at every level
+        float morph_ratio;  ///< fraction of each range over which patches morph
+        float height_scale; ///< displacement per height unit, as in terrain_vshader.glsl
+        float min_height;   ///< the displacement is clamped below (water level)
+        Settings() : grid(32), levels(4), coarse_levels(3), leaf_range(0.25f), morph_ratio(0.3f), height_scale(0.4f), min_height(-0.4f) {}
+    };
+
+    explicit TerrainLOD(const Settings& settings = Settings()) : _settings(settings) {}
+
+    const Settings& settings() const { return _settings; }
+
+    /// Level of a whole tile drawn with the full grid
+    int tile_level() const { return _settings.levels - 1; }
+
+    /// Coarsest level, drawn however far the tile is
+    int max_level() const { return _settings.levels - 1 + _settings.coarse_levels; }
+
+    /// Grid vertices skipped by the patches of \c level (1 up to the tile level)
+    int stride(int level) const { return 1 << std::max(0, level - tile_level()); }
+
+    /// Distance up to which patches of \c level are drawn
+    float range(int level) const {
+        if (level >= max_level()) return std::numeric_limits<float>::max();
+        return _settings.leaf_range * float(1 << level);
+    }
+
+    /// Distances between which a patch of \c level morphs into the coarser level
+    void morph(int level, float& start, float& end) const {
+        if (level >= max_level()) { end = std::numeric_limits<float>::max(); start = end / 2; return; }
+        end = range(level);
+        const float previous = (level == 0) ? 0.0f : range(level - 1);
+        start = end - (end - previous) * _settings.morph_ratio;
+    }
+
+    /// Appends the patches covering the tile [x,x+size)^2 as seen from \c camera.
+    /// \c min / \c max are the quadtree_bounds of its heights (levels deep); nodes
+    /// outside \c frustum (if given) are skipped and counted in stats->frustum_culled.
+    void select(float x, float y, float size, const float* min, const float* max, const Vec3& camera,
+                const Frustum* frustum, std::vector<TerrainPatch>& patches, CullingStats* stats = NULL) const {
+        Node tile = {x, y, size, 0, 0, 0, min, max};
+
+        ///--- far tiles are drawn whole, with a subsampled grid
+        int level = max_level();
+        while (level > tile_level() && distance(tile, camera) <= range(level - 1)) --level;
+        select(tile, std::min(level, tile_level()), level, camera, frustum, patches, stats);
+    }
+
+    /// Triangles drawn for \c patch
+    size_t triangles(const TerrainPatch& patch) const {
+        const size_t quads = _settings.grid / stride(patch.level);
+        return 2 * quads * quads;
+    }
+
+private:
+    /// quadtree node: square, position in the tile quadtree, bounds of the tile
+    struct Node {
+        float x, y, size;
+        int depth, i, j;
+        const float* min;
+        const float* max;
+
+        Node child(int di, int dj) const {
+            Node c = {x + di*size/2, y + dj*size/2, size/2, depth + 1, 2*i + di, 2*j + dj, min, max};
+            return c;
+        }
+        float zmin(const Settings& s) const { return std::max(min[quadtree_index(depth, i, j)] * s.height_scale, s.min_height); }
+        float zmax(const Settings& s) const { return std::max(max[quadtree_index(depth, i, j)] * s.height_scale, s.min_height); }
+    };
+
+    /// \c level of the node in the quadtree, \c draw_level of its patch (coarser for whole far tiles)
+    void select(const Node& node, int level, int draw_level, const Vec3& camera,
+                const Frustum* frustum, std::vector<TerrainPatch>& patches, CullingStats* stats) const {
+        const float zmin = node.zmin(_settings), zmax = node.zmax(_settings);
+        if (frustum && !frustum->intersects(Vec3(node.x, node.y, zmin), Vec3(node.x + node.size, node.y + node.size, zmax))) {
+            if (stats) ++stats->frustum_culled;
+            return;
+        }
+
+        ///--- a child out of its own range is still drawn at its level: it is then
+        ///    fully morphed, i.e. as coarse as its parent, and matches its neighbours
+        const float d = distance(node, camera);
+        if (draw_level > tile_level() || level == 0 || d > range(level - 1)) {
+            TerrainPatch patch = {node.x, node.y, node.size, draw_level, zmin, zmax, d};
+            patches.push_back(patch);
+            return;
+        }
+        select(node.child(0, 0), level - 1, level - 1, camera, frustum, patches, stats);
+        select(node.child(1, 0), level - 1, level - 1, camera, frustum, patches, stats);
+        select(node.child(0, 1), level - 1, level - 1, camera, frustum, patches, stats);
+        select(node.child(1, 1), level - 1, level - 1, camera, frustum, patches, stats);
+    }
+
+    /// distance from p to the bounding box of the node
+    float distance(const Node& node, const Vec3& p) const {
+        const float dx = std::max(0.0f, std::max(node.x - p.x(), p.x() - (node.x + node.size)));
+        const float dy = std::max(0.0f, std::max(node.y - p.y(), p.y() - (node.y + node.size)));
+        const float dz = std::max(0.0f, std::max(node.zmin(_settings) - p.z(), p.z() - node.zmax(_settings)));
+        return std::sqrt(dx*dx + dy*dy + dz*dz);
+    }
+
+private:
+    Settings _settings;
+};
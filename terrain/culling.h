@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <vector>
+#include "OpenGP/types.h"
+
+using namespace OpenGP;
+
+/// Per-frame terrain counters
+struct CullingStats {
+    int drawn;              ///< patches submitted
+    int frustum_culled;     ///< quadtree nodes outside the view frustum (whole subtrees)
+    int horizon_culled;     ///< patches hidden behind nearer terrain
+    size_t triangles;       ///< triangles submitted
+    CullingStats() : drawn(0), frustum_culled(0), horizon_culled(0), triangles(0) {}
+};
+
+/// The six planes of the view frustum of a projection*view matrix (Gribb and
+/// Hartmann), each plane a*x + b*y + c*z + d >= 0 on the inside
+class Frustum {
+public:
+    explicit Frustum(const Mat4x4& PV) {
+        for (int k = 0; k < 3; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                _planes[2*k][c]   = PV(3, c) + PV(k, c);
+                _planes[2*k+1][c] = PV(3, c) - PV(k, c);
+            }
+        }
+    }
+
+    /// false if the box [min,max] is certainly outside (conservative)
+    bool intersects(const Vec3& min, const Vec3& max) const {
+        for (int p = 0; p < 6; ++p) {
+            const float* plane = _planes[p];
+            ///--- corner of the box farthest along the plane normal
+            float d = plane[3];
+            for (int k = 0; k < 3; ++k) d += plane[k] * ((plane[k] > 0) ? max[k] : min[k]);
+            if (d < 0) return false;
+        }
+        return true;
+    }
+
+private:
+    float _planes[6][4];
+};
+
+/// Horizon occlusion for a heightfield seen from above. For every azimuth
+/// bucket around the camera it keeps the elevation angle below which rays are
+/// known to hit nearer terrain. A box [x0,x1]x[y0,y1]x[zmin,zmax] of terrain is
+/// solid below zmin, so a ray is blocked if it is below zmin anywhere over the
+/// footprint: above the camera that is certain below the angle of zmin at the
+/// farthest distance, below the camera only below the angle of zmin where the
+/// ray leaves the footprint (the shortest exit distance within the bucket).
+/// Boxes are submitted by increasing distance and only occluders that end
+/// before the tested box begins are used, which keeps the test exact (never
+/// culls anything visible) in any camera orientation.
+class HorizonCuller {
+public:
+    explicit HorizonCuller(const Vec3& camera, int n_buckets = 1024)
+        : _camera(camera), _horizon(n_buckets, -float(M_PI)/2), _cos(n_buckets+1), _sin(n_buckets+1) {
+        for (int b = 0; b <= n_buckets; ++b) {
+            const float azimuth = -float(M_PI) + b * 2*float(M_PI) / n_buckets;
+            _cos[b] = std::cos(azimuth);
+            _sin[b] = std::sin(azimuth);
+        }
+    }
+
+    /// true if the box is hidden by the boxes submitted before, else the box
+    /// becomes an occluder for the following ones
+    bool occluded(const Vec3& min, const Vec3& max) {
+        Footprint f = footprint(min, max);
+
+        ///--- occluders that end before this box starts
+        while (!_pending.empty() && _pending.top().far <= f.near) {
+            add(_pending.top());
+            _pending.pop();
+        }
+
+        if (f.near > 0) {
+            const float dz = max.z() - _camera.z();
+            const float elevation = std::atan2(dz, (dz >= 0) ? f.near : f.far);
+            bool hidden = true;
+            const int n = (int) _horizon.size();
+            const int first = bucket(f.begin), last = bucket(f.end);
+            for (int b = first; hidden; b = (b + 1) % n) {
+                hidden = _horizon[b] > elevation;
+                if (b == last) break;
+            }
+            if (hidden) return true;
+        }
+
+        f.dz = min.z() - _camera.z();
+        _pending.push(f);
+        return false;
+    }
+
+private:
+    struct Footprint {
+        float near, far;        ///< horizontal distance range from the camera
+        float begin, end;       ///< azimuth range (begin may exceed end across -pi)
+        bool all_around;        ///< the camera is above the footprint
+        float x0, x1, y0, y1;   ///< the footprint
+        float dz;               ///< zmin relative to the camera
+        bool operator<(const Footprint& other) const { return far > other.far; } ///< nearest on top
+    };
+
+    Footprint footprint(const Vec3& min, const Vec3& max) const {
+        Footprint f;
+        const float cx = _camera.x(), cy = _camera.y();
+        const float dx = std::max(0.0f, std::max(min.x() - cx, cx - max.x()));
+        const float dy = std::max(0.0f, std::max(min.y() - cy, cy - max.y()));
+        f.near = std::sqrt(dx*dx + dy*dy);
+        f.far = 0;
+        f.all_around = (f.near == 0);
+        f.x0 = min.x(); f.x1 = max.x();
+        f.y0 = min.y(); f.y1 = max.y();
+        f.dz = 0;
+
+        ///--- azimuths of the corners relative to the center, the span is below pi
+        const float center = std::atan2(0.5f*(min.y() + max.y()) - cy, 0.5f*(min.x() + max.x()) - cx);
+        float lo = 0, hi = 0;
+        for (int k = 0; k < 4; ++k) {
+            const float x = ((k & 1) ? max.x() : min.x()) - cx;
+            const float y = ((k & 2) ? max.y() : min.y()) - cy;
+            f.far = std::max(f.far, std::sqrt(x*x + y*y));
+            float delta = std::atan2(y, x) - center;
+            if (delta > float(M_PI)) delta -= 2*float(M_PI);
+            if (delta < -float(M_PI)) delta += 2*float(M_PI);
+            lo = std::min(lo, delta);
+            hi = std::max(hi, delta);
+        }
+        f.begin = center + lo;
+        f.end = center + hi;
+        return f;
+    }
+
+    int bucket(float azimuth) const {
+        const int n = (int) _horizon.size();
+        const int b = (int) std::floor((azimuth + float(M_PI)) / (2*float(M_PI)) * n);
+        return ((b % n) + n) % n;
+    }
+
+    /// distance at which the ray of azimuth (cos, sin) leaves the footprint
+    float exit_distance(const Footprint& f, float c, float s) const {
+        float t = std::numeric_limits<float>::infinity();
+        if (c > 0) t = std::min(t, (f.x1 - _camera.x()) / c);
+        if (c < 0) t = std::min(t, (f.x0 - _camera.x()) / c);
+        if (s > 0) t = std::min(t, (f.y1 - _camera.y()) / s);
+        if (s < 0) t = std::min(t, (f.y0 - _camera.y()) / s);
+        return std::max(t, f.near);
+    }
+
+    /// elevation below which the rays of bucket b (in [0,n)) are blocked by f
+    float elevation(const Footprint& f, int b) const {
+        if (f.dz >= 0) return std::atan2(f.dz, f.far);
+        ///--- the exit distance is monotonic between the axis directions
+        float d = std::min(exit_distance(f, _cos[b], _sin[b]), exit_distance(f, _cos[b+1], _sin[b+1]));
+        const float width = 2*float(M_PI) / _horizon.size();
+        const float begin = -float(M_PI) + b * width, end = begin + width;
+        for (int k = -1; k <= 1; ++k) {
+            const float axis = k * float(M_PI)/2;
+            if (axis > begin && axis < end) d = std::min(d, exit_distance(f, std::cos(axis), std::sin(axis)));
+        }
+        return std::atan2(f.dz, d);
+    }
+
+    /// raises the horizon over the buckets entirely covered by the footprint
+    void add(const Footprint& f) {
+        const int n = (int) _horizon.size();
+        if (f.all_around) {
+            for (int b = 0; b < n; ++b) _horizon[b] = std::max(_horizon[b], elevation(f, b));
+            return;
+        }
+        const float width = 2*float(M_PI) / n;
+        const int first = (int) std::ceil((f.begin + float(M_PI)) / width);
+        const int last = (int) std::floor((f.end + float(M_PI)) / width) - 1;
+        for (int b = first; b <= last; ++b) {
+            const int wrapped = ((b % n) + n) % n;
+            _horizon[wrapped] = std::max(_horizon[wrapped], elevation(f, wrapped));
+        }
+    }
+
+private:
+    Vec3 _camera;
+    std::vector<float> _horizon;                ///< elevation angle per azimuth bucket
+    std::vector<float> _cos, _sin;              ///< directions of the bucket boundaries
+    std::priority_queue<Footprint> _pending;    ///< occluders not usable yet, by far distance
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "OpenGP/util/parallel.h"
+#include "noise.h"
+
+using namespace OpenGP;
+
+/// Parameters of erode(), in heightmap units and cells
+struct ErosionSettings {
+    int iterations;         ///< budget, 0 disables erosion
+    float rain;             ///< water added to every cell per iteration
+    float pipe;             ///< flux gained per unit of height difference (g*A*dt/l of the pipe model)
+    float capacity;         ///< sediment carried per unit of slope and speed
+    float dissolving;       ///< fraction of the missing capacity eroded per iteration
+    float deposition;       ///< fraction of the excess sediment deposited per iteration
+    float evaporation;      ///< fraction of the water evaporated per iteration
+    float talus;            ///< height difference between neighbours above which material slides
+    float thermal;          ///< fraction of the excess difference that slides per iteration
+    ErosionSettings() : iterations(8), rain(0.01f), pipe(0.5f), capacity(8.0f), dissolving(0.5f), deposition(0.3f),
+                        evaporation(0.05f), talus(0.008f), thermal(0.1f) {}
+};
+
+/// Called after every iteration with (iteration, iterations), return false to stop early
+typedef std::function<bool(int, int)> ErosionProgress;
+
+/// Cells an erosion pass reads around each cell, per iteration (one per
+/// stage of erode()). After k iterations a cell depends only on the initial
+/// heights within erosion_halo: a region eroded with that many more cells on
+/// every side is identical, bit for bit, to the same region of an eroded larger
+/// grid, so tiles can be eroded separately and still match at their borders.
+inline int erosion_halo(const ErosionSettings& settings) {
+    return 5 * settings.iterations;
+}
+
+/// Hydraulic and thermal erosion of the width x height grid \c heights (row j
+/// at j*width), in place. Hydraulic erosion follows the virtual pipes model of
+/// Mei et al. (2007): rain fills the cells, water flows to lower neighbours
+/// through pipes, dissolves terrain where it can carry more sediment than it
+/// does (fast and steep) and deposits it elsewhere, and the sediment moves with
+/// the water. Thermal erosion then lets material slide down slopes steeper than
+/// \c talus.
+///
+/// Every stage writes its own buffer from the previous stage's buffers and
+/// only reads the direct neighbours of each cell. Each stage is split into
+/// bands of rows that run in parallel; a band sees the border rows of its
+/// neighbours as the previous stage left them (the halo exchange happens
+/// through the shared grid). The result does not depend on the number of
+/// threads.
+inline void erode(float* heights, int width, int height, const ErosionSettings& settings,
+                  const ErosionProgress& progress = ErosionProgress(), unsigned int n_threads = 0) {
+    const size_t n = size_t(width) * height;
+    std::vector<float> b(heights, heights + n), b_next(n);         ///< terrain
+    std::vector<float> d(n, 0.0f);                                  ///< water
+    std::vector<float> s(n, 0.0f), s_next(n);                       ///< suspended sediment
+    std::vector<float> fl(n, 0.0f), fr(n, 0.0f), fb(n, 0.0f), ft(n, 0.0f); ///< outflow to left, right, bottom, top
+    std::vector<float> u(n, 0.0f), v(n, 0.0f);                      ///< water velocity, cells per iteration
+    const int grain = 16;
+
+    ///--- neighbours clamped at the border
+    auto left = [](int i) { return (i > 0) ? i - 1 : i; };
+    auto right = [width](int i) { return (i < width - 1) ? i + 1 : i; };
+    auto below = [](int j) { return (j > 0) ? j - 1 : j; };
+    auto above = [height](int j) { return (j < height - 1) ? j + 1 : j; };
+
+    for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+
+        ///--- 1. rain, then outflow through the pipes (reads b and d of the neighbours)
+        parallel_for(0, height, [&](int j) {
+            const float* b_row = &b[j*width];
+            const float* d_row = &d[j*width];
+            const float* b_below = &b[below(j)*width];
+            const float* d_below = &d[below(j)*width];
+            const float* b_above = &b[above(j)*width];
+            const float* d_above = &d[above(j)*width];
+            for (int i = 0; i < width; ++i) {
+                const size_t c = j*width + i;
+                const float water = d_row[i] + settings.rain;
+                const float level = b_row[i] + water;
+                float l = std::max(0.0f, fl[c] + settings.pipe * (level - b_row[left(i)] - d_row[left(i)] - settings.rain));
+                float r = std::max(0.0f, fr[c] + settings.pipe * (level - b_row[right(i)] - d_row[right(i)] - settings.rain));
+                float bo = std::max(0.0f, fb[c] + settings.pipe * (level - b_below[i] - d_below[i] - settings.rain));
+                float t = std::max(0.0f, ft[c] + settings.pipe * (level - b_above[i] - d_above[i] - settings.rain));
+                ///--- no more water leaves than there is
+                const float total = l + r + bo + t;
+                if (total > water) {
+                    const float k = water / total;
+                    l *= k; r *= k; bo *= k; t *= k;
+                }
+                ///--- nothing flows out of the grid
+                if (i == 0) l = 0;
+                if (i == width - 1) r = 0;
+                if (j == 0) bo = 0;
+                if (j == height - 1) t = 0;
+                fl[c] = l; fr[c] = r; fb[c] = bo; ft[c] = t;
+            }
+        }, grain, n_threads);
+
+        ///--- 2. water and velocity from the fluxes (reads the fluxes of the neighbours)
+        parallel_for(0, height, [&](int j) {
+            for (int i = 0; i < width; ++i) {
+                const size_t c = j*width + i;
+                const size_t cl = j*width + left(i), cr = j*width + right(i);
+                const size_t cb = below(j)*width + i, ca = above(j)*width + i;
+                const float in_l = (i > 0) ? fr[cl] : 0.0f, in_r = (i < width - 1) ? fl[cr] : 0.0f;
+                const float in_b = (j > 0) ? ft[cb] : 0.0f, in_a = (j < height - 1) ? fb[ca] : 0.0f;
+                const float before = d[c] + settings.rain;
+                const float after = std::max(0.0f, before + in_l + in_r + in_b + in_a - fl[c] - fr[c] - fb[c] - ft[c]);
+                const float mean = 0.5f * (before + after);
+                ///--- flow through the cell over its water depth, at most a cell per iteration
+                float vx = 0, vy = 0;
+                if (mean > 1e-6f) {
+                    vx = 0.5f * (in_l - fl[c] + fr[c] - in_r) / mean;
+                    vy = 0.5f * (in_b - fb[c] + ft[c] - in_a) / mean;
+                }
+                u[c] = std::max(-1.0f, std::min(1.0f, vx));
+                v[c] = std::max(-1.0f, std::min(1.0f, vy));
+                d[c] = after;
+            }
+        }, grain, n_threads);
+
+        ///--- 3. erosion and deposition (reads b of the neighbours for the slope)
+        parallel_for(0, height, [&](int j) {
+            const float* b_row = &b[j*width];
+            const float* b_below = &b[below(j)*width];
+            const float* b_above = &b[above(j)*width];
+            for (int i = 0; i < width; ++i) {
+                const size_t c = j*width + i;
+                const float gx = 0.5f * (b_row[right(i)] - b_row[left(i)]);
+                const float gy = 0.5f * (b_above[i] - b_below[i]);
+                const float sine = std::sqrt((gx*gx + gy*gy) / (1.0f + gx*gx + gy*gy));
+                const float speed = std::sqrt(u[c]*u[c] + v[c]*v[c]);
+                const float capacity = settings.capacity * std::max(sine, 1e-3f) * speed * std::min(d[c], 1.0f);
+                float terrain = b_row[i], sediment = s[c];
+                if (capacity > sediment) {
+                    const float eroded = settings.dissolving * (capacity - sediment);
+                    terrain -= eroded;
+                    sediment += eroded;
+                } else {
+                    const float deposited = settings.deposition * (sediment - capacity);
+                    terrain += deposited;
+                    sediment -= deposited;
+                }
+                b_next[c] = terrain;
+                s[c] = sediment;
+            }
+        }, grain, n_threads);
+        b.swap(b_next);
+
+        ///--- 4. sediment carried by the water (semi-Lagrangian: fetched from upstream,
+        ///    at most a cell away), then evaporation
+        parallel_for(0, height, [&](int j) {
+            for (int i = 0; i < width; ++i) {
+                const size_t c = j*width + i;
+                ///--- relative to the cell, so the result does not depend on where the grid starts
+                const float ox = std::floor(-u[c]), oy = std::floor(-v[c]);
+                const float tx = -u[c] - ox, ty = -v[c] - oy;
+                const int x0 = std::min(std::max(i + (int) ox, 0), width - 1), x1 = std::min(std::max(i + (int) ox + 1, 0), width - 1);
+                const int y0 = std::min(std::max(j + (int) oy, 0), height - 1), y1 = std::min(std::max(j + (int) oy + 1, 0), height - 1);
+                const float s0 = s[y0*width + x0] + tx * (s[y0*width + x1] - s[y0*width + x0]);
+                const float s1 = s[y1*width + x0] + tx * (s[y1*width + x1] - s[y1*width + x0]);
+                s_next[c] = s0 + ty * (s1 - s0);
+                d[c] *= 1.0f - settings.evaporation;
+            }
+        }, grain, n_threads);
+        s.swap(s_next);
+
+        ///--- 5. thermal erosion, pairwise between the 4 neighbours so that material is conserved
+        parallel_for(0, height, [&](int j) {
+            const float* b_row = &b[j*width];
+            const float* b_below = &b[below(j)*width];
+            const float* b_above = &b[above(j)*width];
+            for (int i = 0; i < width; ++i) {
+                const float h = b_row[i];
+                const float neighbours[4] = {b_row[left(i)], b_row[right(i)], b_below[i], b_above[i]};
+                float delta = 0;
+                for (int k = 0; k < 4; ++k) {
+                    const float difference = neighbours[k] - h;
+                    const float excess = std::abs(difference) - settings.talus;
+                    if (excess > 0) delta += (difference > 0 ? 0.5f : -0.5f) * settings.thermal * excess;
+                }
+                b_next[j*width + i] = h + delta;
+            }
+        }, grain, n_threads);
+        b.swap(b_next);
+
+        if (progress && !progress(iteration + 1, settings.iterations)) break;
+    }
+
+    ///--- sediment still in suspension settles where it is
+    for (size_t c = 0; c < n; ++c) heights[c] = b[c] + s[c];
+}
+
+/// fBm of the pixels [x0,x0+width) x [y0,y0+height) as fBm2D, eroded. The grid
+/// is generated and eroded with erosion_halo() more pixels on every side, so
+/// any region matches the same pixels of any other one.
+inline void eroded_fBm2D(float* data, int x0, int y0, int width, int height, const FBmSettings& noise,
+                         const ErosionSettings& erosion, unsigned int n_threads = 0) {
+    if (erosion.iterations == 0) {
+        fBm2D(data, x0, y0, width, height, noise, 0, 0, n_threads);
+        return;
+    }
+    const int halo = erosion_halo(erosion);
+    const int w = width + 2*halo, h = height + 2*halo;
+    std::vector<float> grid(size_t(w) * h);
+    fBm2D(grid.data(), x0 - halo, y0 - halo, w, h, noise, 0, 0, n_threads);
+    erode(grid.data(), w, h, erosion, ErosionProgress(), n_threads);
+    for (int j = 0; j < height; ++j)
+        std::copy(&grid[size_t(j + halo)*w + halo], &grid[size_t(j + halo)*w + halo] + width, data + size_t(j)*width);
+}
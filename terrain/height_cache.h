@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include "OpenGP/util/mapped_file.h"
+#include "noise.h"
+#include "erosion.h"
+
+#ifdef _WIN32
+    #include <direct.h>
+#endif
+
+using namespace OpenGP;
+
+/// Generated tiles kept on disk, one file per tile named after a hash of
+/// everything the data depends on (fBm and erosion settings, resolution, sample spacing),
+/// so changing any parameter simply misses the old files. A file holds the
+/// heights and the normal_map of a tile as raw floats, aligned so that they are
+/// used in place from the mapping: later runs map the file and upload straight
+/// from it (R32FTexture::upload_raw) without generating or copying anything.
+///
+/// Layout: "HGT1", key (8 bytes), x, y, n (int32), padding to 32 bytes, then
+/// n*n heights and 4*n*n normals (xyz, height).
+///
+/// load() and store() may be called from any thread.
+class HeightCache {
+public:
+    /// \c directory is created if needed, an empty one disables the cache
+    explicit HeightCache(const std::string& directory = "") : _directory(directory) {
+        if (_directory.empty()) return;
+#ifdef _WIN32
+        _mkdir(_directory.c_str());
+#else
+        mkdir(_directory.c_str(), 0755);
+#endif
+    }
+
+    bool enabled() const { return !_directory.empty(); }
+
+    /// Identifies the tiles of (resolution+1)^2 samples \c spacing apart generated with \c settings
+    static uint64_t key(const FBmSettings& settings, const ErosionSettings& erosion, int resolution, float spacing) {
+        uint64_t h = 1469598103934665603ull; ///< FNV-1a
+        auto mix = [&h](const void* data, size_t size) {
+            for (size_t i = 0; i < size; ++i) { h ^= ((const unsigned char*) data)[i]; h *= 1099511628211ull; }
+        };
+        mix(&settings.seed, sizeof(settings.seed));
+        mix(&settings.period, sizeof(settings.period));
+        mix(&settings.H, sizeof(settings.H));
+        mix(&settings.lacunarity, sizeof(settings.lacunarity));
+        mix(&settings.offset, sizeof(settings.offset));
+        mix(&settings.octaves, sizeof(settings.octaves));
+        mix(&erosion.iterations, sizeof(erosion.iterations));
+        if (erosion.iterations > 0) {
+            const float parameters[] = {erosion.rain, erosion.pipe, erosion.capacity, erosion.dissolving,
+                                        erosion.deposition, erosion.evaporation, erosion.talus, erosion.thermal};
+            mix(parameters, sizeof(parameters));
+        }
+        mix(&resolution, sizeof(resolution));
+        mix(&spacing, sizeof(spacing));
+        return h;
+    }
+
+    /// Maps tile (x,y) of n x n samples, NULL if not cached (or truncated)
+    std::unique_ptr<MappedFile> load(uint64_t key, int x, int y, int n) const {
+        std::unique_ptr<MappedFile> file(new MappedFile());
+        if (!enabled() || !file->open(filename(key, x, y))) return std::unique_ptr<MappedFile>();
+        int32_t header[3];
+        if (file->size() != file_size(n) || memcmp(file->data(), "HGT1", 4) != 0
+            || memcmp(file->data() + 4, &key, 8) != 0) return std::unique_ptr<MappedFile>();
+        memcpy(header, file->data() + 12, sizeof(header));
+        if (header[0] != x || header[1] != y || header[2] != n) return std::unique_ptr<MappedFile>();
+        return file;
+    }
+
+    /// Writes tile (x,y), through a temporary file so that concurrent readers
+    /// never see a partial one
+    bool store(uint64_t key, int x, int y, int n, const float* heights, const float* normals) const {
+        if (!enabled()) return false;
+        std::ostringstream temp;
+        temp << filename(key, x, y) << "." << std::this_thread::get_id() << ".tmp";
+        FILE* out = fopen(temp.str().c_str(), "wb");
+        if (!out) return false;
+        char header[HEADER_SIZE] = {'H', 'G', 'T', '1'};
+        const int32_t position[3] = {x, y, n};
+        memcpy(header + 4, &key, 8);
+        memcpy(header + 12, position, sizeof(position));
+        const size_t samples = size_t(n) * n;
+        bool ok = fwrite(header, HEADER_SIZE, 1, out) == 1
+               && fwrite(heights, sizeof(float), samples, out) == samples
+               && fwrite(normals, sizeof(float), 4*samples, out) == 4*samples;
+        ok = (fclose(out) == 0) && ok;
+        if (ok) {
+            remove(filename(key, x, y).c_str()); ///< rename does not replace on every platform
+            ok = rename(temp.str().c_str(), filename(key, x, y).c_str()) == 0;
+        }
+        if (!ok) remove(temp.str().c_str());
+        return ok;
+    }
+
+    /// Views into a file returned by load()
+    static const float* heights(const MappedFile& file) { return (const float*) (file.data() + HEADER_SIZE); }
+    static const float* normals(const MappedFile& file, int n) { return heights(file) + size_t(n) * n; }
+
+    static size_t file_size(int n) { return HEADER_SIZE + 5 * size_t(n) * n * sizeof(float); }
+
+private:
+    enum { HEADER_SIZE = 32 };
+
+    std::string filename(uint64_t key, int x, int y) const {
+        std::ostringstream name;
+        name << _directory << "/" << std::hex << key << std::dec << "_" << x << "_" << y << ".height";
+        return name.str();
+    }
+
+private:
+    std::string _directory;
+};
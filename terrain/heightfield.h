@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "OpenGP/types.h"
+#include "OpenGP/util/parallel.h"
+#include "noise.h"
+#include "erosion.h"
+
+using namespace OpenGP;
+
+/// CPU copy of a rectangle of the terrain for collision, camera placement and
+/// object placement. Sample (i,j) sits at world (x0+i, y0+j)*spacing, like the
+/// samples of the streamed tiles, and is displaced as in terrain_vshader.glsl
+/// (max(h*height_scale, min_height)); the surface is the bilinear interpolation
+/// of the displaced samples. Outside the rectangle the border is extended.
+///
+/// Ray casts descend a min/max pyramid over the cells (level k bounds blocks
+/// of 2^k x 2^k cells), so a ray only visits the cells near the surface.
+///
+/// Usage:
+///
+///   Heightfield ground = Heightfield::fBm(noise, erosion, x0, y0, width, height, spacing);
+///   float z = ground.height(x, y);
+///   ground.heights(&points[0], points.size(), &z[0]);  ///< thousands at once
+///   float t; if (ground.intersect(origin, direction, max_t, t)) { hit at origin + t*direction }
+class Heightfield {
+public:
+    struct Settings {
+        float height_scale;     ///< displacement per height unit, as in terrain_vshader.glsl
+        float min_height;       ///< the displacement is clamped below (water level)
+        Settings() : height_scale(0.4f), min_height(-0.4f) {}
+    };
+
+    /// \c heights is width x height samples (row j at j*width), (x0,y0) the index of the first one
+    Heightfield(std::vector<float> heights, int width, int height, int x0, int y0, float spacing,
+                const Settings& settings = Settings())
+        : _width(width), _height(height), _x0(x0), _y0(y0), _spacing(spacing), _settings(settings) {
+        _z.swap(heights);
+        for (float& z : _z) z = std::max(z * settings.height_scale, settings.min_height);
+        build_pyramid();
+    }
+
+    /// Samples [x0,x0+width) x [y0,y0+height) of the (eroded) fBm heightfield, as the streamed tiles
+    static Heightfield fBm(const FBmSettings& noise, const ErosionSettings& erosion, int x0, int y0, int width, int height,
+                           float spacing, const Settings& settings = Settings(), unsigned int n_threads = 0) {
+        std::vector<float> heights(size_t(width) * height);
+        eroded_fBm2D(heights.data(), x0, y0, width, height, noise, erosion, n_threads);
+        return Heightfield(std::move(heights), width, height, x0, y0, spacing, settings);
+    }
+
+    /// World rectangle covered by the samples
+    Vec3 min() const { return Vec3(_x0*_spacing, _y0*_spacing, _pyramid.back().min[0]); }
+    Vec3 max() const { return Vec3((_x0 + _width - 1)*_spacing, (_y0 + _height - 1)*_spacing, _pyramid.back().max[0]); }
+
+    /// Surface height at world (x,y)
+    float height(float x, float y) const {
+        int i, j;
+        float u, v;
+        locate(x, y, i, j, u, v);
+        const float* z = &_z[j*_width + i];
+        return lerp(lerp(z[0], z[1], u), lerp(z[_width], z[_width+1], u), v);
+    }
+
+    /// Surface normal at world (x,y), of the bilinear patch
+    Vec3 normal(float x, float y) const {
+        int i, j;
+        float u, v;
+        locate(x, y, i, j, u, v);
+        const float* z = &_z[j*_width + i];
+        const float dzdx = lerp(z[1] - z[0], z[_width+1] - z[_width], v) / _spacing;
+        const float dzdy = lerp(z[_width] - z[0], z[_width+1] - z[1], u) / _spacing;
+        return Vec3(-dzdx, -dzdy, 1).normalized();
+    }
+
+    /// Heights at \c count world positions, in parallel
+    void heights(const Vec2* positions, size_t count, float* out, unsigned int n_threads = 0) const {
+        batch(count, [&](size_t k){ out[k] = height(positions[k].x(), positions[k].y()); }, n_threads);
+    }
+
+    /// Normals at \c count world positions, in parallel
+    void normals(const Vec2* positions, size_t count, Vec3* out, unsigned int n_threads = 0) const {
+        batch(count, [&](size_t k){ out[k] = normal(positions[k].x(), positions[k].y()); }, n_threads);
+    }
+
+    /// First intersection of origin + t*direction (0 <= t <= max_t) with the
+    /// surface over the covered rectangle, exact for the bilinear patches
+    bool intersect(const Vec3& origin, const Vec3& direction, float max_t, float& t) const {
+        ///--- starting below the surface counts as a hit at 0
+        const Vec3 lo = min(), hi = max();
+        if (origin.x() >= lo.x() && origin.x() <= hi.x() && origin.y() >= lo.y() && origin.y() <= hi.y()
+            && origin.z() < height(origin.x(), origin.y())) { t = 0; return true; }
+
+        struct Node { int level, i, j; float t0, t1; };
+        Node stack[4 * 32];             ///< at most 3 pending siblings per level
+        int top = 0;
+        const int root = (int) _pyramid.size() - 1;
+        float t0, t1;
+        if (!box(root, 0, 0, origin, direction, 0, max_t, t0, t1)) return false;
+        stack[top++] = {root, 0, 0, t0, t1};
+        while (top > 0) {
+            const Node node = stack[--top];
+            if (node.level == 0) {
+                if (cell(node.i, node.j, origin, direction, node.t0, node.t1, t)) return true;
+                continue;
+            }
+            ///--- children hit by the ray, pushed farthest first so the nearest is visited first
+            Node children[4];
+            int n = 0;
+            for (int c = 0; c < 4; ++c) {
+                const int i = 2*node.i + (c & 1), j = 2*node.j + (c >> 1);
+                if (box(node.level - 1, i, j, origin, direction, node.t0, node.t1, t0, t1))
+                    children[n++] = {node.level - 1, i, j, t0, t1};
+            }
+            std::sort(children, children + n, [](const Node& a, const Node& b){ return a.t0 > b.t0; });
+            for (int c = 0; c < n; ++c) stack[top++] = children[c];
+        }
+        return false;
+    }
+
+private:
+    struct Level {
+        int width, height;              ///< blocks
+        std::vector<float> min, max;
+    };
+
+    static float lerp(float a, float b, float t) { return a + t*(b - a); }
+
+    template <class Function>
+    static void batch(size_t count, const Function& f, unsigned int n_threads) {
+        const int blocks = (int) ((count + 255) / 256);
+        parallel_for(0, blocks, [&](int b) {
+            for (size_t k = size_t(b)*256; k < std::min(count, size_t(b + 1)*256); ++k) f(k);
+        }, 4, n_threads);
+    }
+
+    /// cell (i,j) containing world (x,y) and the position (u,v) in it, clamped to the rectangle
+    void locate(float x, float y, int& i, int& j, float& u, float& v) const {
+        const float fx = std::min(std::max(x / _spacing - _x0, 0.0f), float(_width - 1));
+        const float fy = std::min(std::max(y / _spacing - _y0, 0.0f), float(_height - 1));
+        i = std::min((int) fx, _width - 2);
+        j = std::min((int) fy, _height - 2);
+        u = fx - i;
+        v = fy - j;
+    }
+
+    /// level 0 bounds the 4 samples of every cell, each level above 2x2 blocks of the one below
+    void build_pyramid() {
+        Level level;
+        level.width = _width - 1;
+        level.height = _height - 1;
+        level.min.resize(size_t(level.width) * level.height);
+        level.max.resize(level.min.size());
+        for (int j = 0; j < level.height; ++j) {
+            for (int i = 0; i < level.width; ++i) {
+                const float* z = &_z[j*_width + i];
+                level.min[j*level.width + i] = std::min(std::min(z[0], z[1]), std::min(z[_width], z[_width+1]));
+                level.max[j*level.width + i] = std::max(std::max(z[0], z[1]), std::max(z[_width], z[_width+1]));
+            }
+        }
+        _pyramid.push_back(std::move(level));
+        while (_pyramid.back().width > 1 || _pyramid.back().height > 1) {
+            const Level& below = _pyramid.back();
+            Level above;
+            above.width = (below.width + 1) / 2;
+            above.height = (below.height + 1) / 2;
+            above.min.assign(size_t(above.width) * above.height, std::numeric_limits<float>::max());
+            above.max.assign(above.min.size(), -std::numeric_limits<float>::max());
+            for (int j = 0; j < below.height; ++j) {
+                for (int i = 0; i < below.width; ++i) {
+                    float& lo = above.min[(j/2)*above.width + i/2];
+                    float& hi = above.max[(j/2)*above.width + i/2];
+                    lo = std::min(lo, below.min[j*below.width + i]);
+                    hi = std::max(hi, below.max[j*below.width + i]);
+                }
+            }
+            _pyramid.push_back(std::move(above));
+        }
+    }
+
+    /// clips [t0,t1] to the bounding box of block (i,j) of \c level, false if missed or outside the pyramid
+    bool box(int level, int i, int j, const Vec3& origin, const Vec3& direction, float t0, float t1,
+             float& enter, float& exit) const {
+        const Level& l = _pyramid[level];
+        if (i >= l.width || j >= l.height) return false;
+        const int cells = 1 << level;
+        const float lo[3] = {(_x0 + i*cells)*_spacing, (_y0 + j*cells)*_spacing, l.min[j*l.width + i]};
+        const float hi[3] = {(_x0 + std::min((i+1)*cells, _width-1))*_spacing,
+                             (_y0 + std::min((j+1)*cells, _height-1))*_spacing, l.max[j*l.width + i]};
+        enter = t0;
+        exit = t1;
+        for (int k = 0; k < 3; ++k) {
+            if (direction[k] == 0) {
+                if (origin[k] < lo[k] || origin[k] > hi[k]) return false;
+                continue;
+            }
+            float a = (lo[k] - origin[k]) / direction[k], b = (hi[k] - origin[k]) / direction[k];
+            if (a > b) std::swap(a, b);
+            enter = std::max(enter, a);
+            exit = std::min(exit, b);
+        }
+        return enter <= exit;
+    }
+
+    /// ray against the bilinear patch of cell (i,j) for t in [t0,t1]: the height
+    /// along the ray minus the patch is a quadratic in t. It is solved from the
+    /// entry point t0, near the cell, which keeps grazing rays accurate.
+    bool cell(int i, int j, const Vec3& origin, const Vec3& direction, float t0, float t1, float& t) const {
+        const float* z = &_z[j*_width + i];
+        const float a = z[0], b = z[1] - z[0], c = z[_width] - z[0], d = z[_width+1] - z[_width] - z[1] + z[0];
+        const Vec3 entry = origin + t0 * direction;
+        ///--- (u,v) = (pu + du*s, pv + dv*s) with s = t - t0
+        const float pu = entry.x() / _spacing - _x0 - i, du = direction.x() / _spacing;
+        const float pv = entry.y() / _spacing - _y0 - j, dv = direction.y() / _spacing;
+        ///--- f(s) = entry.z + direction.z*s - (a + b*u + c*v + d*u*v) = A*s^2 + B*s + C
+        const float A = -d*du*dv;
+        const float B = direction.z() - b*du - c*dv - d*(pu*dv + pv*du);
+        const float C = entry.z() - a - b*pu - c*pv - d*pu*pv;
+        if (C <= 0) { t = t0; return true; } ///< entering below the patch (within rounding)
+        float roots[2];
+        int n = 0;
+        if (std::abs(A) < 1e-12f) {
+            if (B != 0) roots[n++] = -C / B;
+        } else {
+            const float discriminant = B*B - 4*A*C;
+            if (discriminant < 0) return false;
+            const float s = std::sqrt(discriminant);
+            ///--- numerically stable form
+            const float q = -0.5f * (B + (B >= 0 ? s : -s));
+            roots[n++] = q / A;
+            if (q != 0) roots[n++] = C / q;
+            if (n == 2 && roots[1] < roots[0]) std::swap(roots[0], roots[1]);
+        }
+        for (int k = 0; k < n; ++k) {
+            if (roots[k] >= 0 && roots[k] <= t1 - t0) {
+                t = t0 + roots[k];
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    int _width, _height;            ///< samples
+    int _x0, _y0;                   ///< index of the first sample
+    float _spacing;                 ///< world distance between samples
+    Settings _settings;
+    std::vector<float> _z;          ///< displaced heights
+    std::vector<Level> _pyramid;    ///< min/max of the cells, finest first
+};
@@ -1,8 +1,14 @@
 #include <OpenGP/GL/Application.h>
 #include "OpenGP/GL/Eigen.h"
+#include <sstream>
 
 #include "loadTexture.h"
-#include "noise.h"
+#include "noise_texture.h"
+#include "tile_streamer.h"
+#include "cdlod.h"
+#include "materials.h"
+#include "heightfield.h"
+#include "asset_loader.h"
 
 using namespace OpenGP;
 const int width=1280, height=720;
@@ -36,8 +42,15 @@ GLuint skyboxTexture;
 
 std::unique_ptr<Shader> terrainShader;
 std::unique_ptr<GPUMesh> terrainMesh;
-std::unique_ptr<R32FTexture> heightTexture;
-std::map<std::string, std::unique_ptr<RGBA8Texture>> terrainTextures;
+std::vector<std::pair<int, int>> terrainMeshStrides; // (first, count) of the strips of each grid stride
+std::unique_ptr<TerrainStreamer> terrain;
+std::unique_ptr<TerrainLOD> terrainLOD;
+std::unique_ptr<Heightfield> ground; // CPU heights under the camera path
+const float groundClearance = 0.05f;
+std::unique_ptr<AssetLoader> loader; // textures and ground, loaded in the background
+bool horizonCulling = false; // H toggles it
+CullingStats cullingStats;
+std::unique_ptr<MaterialArray> terrainMaterials; // layers in the order of terrain_fshader.glsl
 
 Vec3 cameraPos;
 Vec3 cameraFront;
@@ -95,13 +108,40 @@ int main(int, char**){
 
 
     // Display callback
-    Window& window = app.create_window([&](Window&){
+    Window& window = app.create_window([&](Window& w){
+        ///--- Upload the assets loaded so far
+        const bool loaded = loader->poll();
+
+        ///--- Keep the camera above the ground
+        if (ground) cameraPos[2] = std::max(cameraPos.z(), ground->height(cameraPos.x(), cameraPos.y()) + groundClearance);
+
+        ///--- Stream the tiles around the camera and the ones it is heading to
+        std::vector<Vec3> lookahead;
+        lookahead.push_back(curvePoints[std::min<int>(camPosInd + 10*cameraSpeed, curvePoints.size()-1)]);
+        terrain->update(cameraPos, lookahead);
+
         glViewport(0,0,width,height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (!loaded) {
+            std::ostringstream title;
+            title << "Assignment 4 - loading " << loader->n_done() << "/" << loader->total();
+            w.set_title(title.str());
+            return;
+        }
 
         drawSkybox();
         glClear(GL_DEPTH_BUFFER_BIT);
         drawTerrain();
+
+        ///--- Terrain counters in the title bar, a few times per second
+        static int frame = 0;
+        if (++frame % 30 == 0) {
+            std::ostringstream title;
+            title << "Assignment 4 - " << cullingStats.drawn << " patches, " << cullingStats.triangles/1000 << "k triangles, culled: "
+                  << cullingStats.frustum_culled << " frustum, " << cullingStats.horizon_culled << " horizon"
+                  << (horizonCulling ? "" : " (off, H)");
+            w.set_title(title.str());
+        }
     });
     window.set_title("Assignment 4");
     window.set_size(width, height);
@@ -130,6 +170,9 @@ int main(int, char**){
     });
 
     window.add_listener<KeyEvent>([&](const KeyEvent &k){
+        if(k.key == GLFW_KEY_H && k.released){
+            horizonCulling = !horizonCulling;
+        }
         ///--- TODO: Implement WASD keys HINT: compare k.key to GLFW_KEY_W
         if(k.key == GLFW_KEY_W){
             //cameraPos += cameraSpeed * cameraFront; //forward
@@ -190,42 +233,75 @@ void init(){
     terrainShader->add_fshader_from_source(terrain_fshader);
     terrainShader->link();
 
-    ///--- Get height texture
-    heightTexture = std::unique_ptr<R32FTexture>(fBm2DTexture());
+    ///--- Height tiles are generated in the background as the camera moves
+    ///    (or read back from the tiles cached by previous runs)
+    TerrainStreamer::Settings terrainSettings;
+    terrainSettings.cache_directory = "terrain_cache";
+    terrain = std::unique_ptr<TerrainStreamer>(new TerrainStreamer(terrainSettings));
+    terrainLOD = std::unique_ptr<TerrainLOD>(new TerrainLOD());
+
+    ///--- Heights along the camera path stay on the CPU, at the resolution of the tiles
+    const float spacing = terrainSettings.tile_size / terrainSettings.resolution;
+    Vec2 pathMin = curvePoints[0].head<2>(), pathMax = pathMin;
+    for (const Vec3& p : curvePoints) {
+        pathMin = pathMin.cwiseMin(p.head<2>());
+        pathMax = pathMax.cwiseMax(p.head<2>());
+    }
+    const int margin = 8;
+    const int x0 = (int) std::floor(pathMin.x() / spacing) - margin, y0 = (int) std::floor(pathMin.y() / spacing) - margin;
+    const int x1 = (int) std::ceil(pathMax.x() / spacing) + margin, y1 = (int) std::ceil(pathMax.y() / spacing) + margin;
+
+    ///--- Everything below is decoded / generated concurrently on the loader's
+    ///    threads, the GL parts run in the display callback as the jobs finish
+    loader = std::unique_ptr<AssetLoader>(new AssetLoader());
+    static size_t skyboxBytes = 0;
+    loader->set_progress([](int done, int total, const std::string& name){
+        std::cout << "loaded " << name << " (" << done << "/" << total << ")" << std::endl;
+        if (done == total)
+            std::cout << "textures: materials " << terrainMaterials->bytes()/1024 << "KB, skybox " << skyboxBytes/1024 << "KB"
+                      << (terrainMaterials->compressed() ? " (DXT1)" : "") << std::endl;
+    });
+
+    std::shared_ptr<std::unique_ptr<Heightfield>> groundResult = std::make_shared<std::unique_ptr<Heightfield>>();
+    loader->add("ground", [=](){
+        groundResult->reset(new Heightfield(Heightfield::fBm(terrainSettings.noise, terrainSettings.erosion, x0, y0, x1 - x0 + 1, y1 - y0 + 1, spacing)));
+    }, [=](){
+        ground = std::move(*groundResult);
+    });
 
-    ///--- Load terrain and cubemap textures
+    ///--- Terrain and cubemap textures, block compressed when supported
+    ///    (cooked by the driver on the first run, then read from the caches)
+    const bool compressed = useCompression(true);
     const std::string list[] = {"grass", "rock", "sand", "snow", "water"};
-    for (int i=0 ; i < 5 ; ++i) {
-        loadTexture(terrainTextures[list[i]], (list[i]+".png").c_str());
-        terrainTextures[list[i]]->bind();
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    }
+    std::vector<std::string> materialFiles;
+    for (int i=0 ; i < 5 ; ++i) materialFiles.push_back(list[i]+".png");
+    terrainMaterials = std::unique_ptr<MaterialArray>(new MaterialArray());
+    std::shared_ptr<TextureSource> materialSource = std::make_shared<TextureSource>();
+    loader->add("materials", [=](){
+        decodeMaterials(materialFiles, "materials.cache", compressed, *materialSource);
+    }, [=](){
+        terrainMaterials->upload(*materialSource);
+        *materialSource = TextureSource();
+    });
 
     const std::string skyList[] = {"miramar_ft", "miramar_bk", "miramar_dn", "miramar_up", "miramar_rt", "miramar_lf"};
-    glGenTextures(1, &skyboxTexture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-    int tex_wh = 1024;
-    for(int i=0; i < 6; ++i) {
-        std::vector<unsigned char> image;
-        loadTexture(image, (skyList[i]+".png").c_str());
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, GL_RGBA, tex_wh, tex_wh, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    std::vector<std::string> skyFiles;
+    for (int i=0 ; i < 6 ; ++i) skyFiles.push_back(skyList[i]+".png");
+    std::shared_ptr<TextureSource> skySource = std::make_shared<TextureSource>();
+    loader->add("skybox", [=](){
+        decodeCubemap(skyFiles, "skybox.cache", compressed, *skySource);
+    }, [=](){
+        skyboxTexture = uploadCubemap(*skySource, &skyboxBytes);
+        *skySource = TextureSource();
+    });
 }
 
 void genTerrainMesh() {
     /// Create a flat (z=0) mesh for the terrain with given dimensions, using triangle strips
+    /// The grid spans [0,1]^2 and is drawn once per LOD patch, scaled and offset in the vertex shader
     terrainMesh = std::unique_ptr<GPUMesh>(new GPUMesh());
-    int n_width = 256; // Grid resolution
-    int n_height = 256;
+    int n_width = terrainLOD->settings().grid + 1; // Grid resolution
+    int n_height = terrainLOD->settings().grid + 1;
     float f_width = 5.0f; // Grid width, centered at 0,0
     float f_height = 5.0f;
 
@@ -237,23 +313,29 @@ void genTerrainMesh() {
     for(int j=0; j<n_height; ++j) {
         for(int i=0; i<n_width; ++i) {
             /// TODO: calculate vertex positions, texture indices done for you
-            points.push_back(Vec3(i/(float)n_width, j/(float)n_height, 0.0f)); //points.push_back(Vec3(0, 0, 0.0f));
+            points.push_back(Vec3(i/(float)(n_width-1), j/(float)(n_height-1), 0.0f)); //points.push_back(Vec3(0, 0, 0.0f));
             texCoords.push_back( Vec2( i/(float)(n_width-1), j/(float)(n_height-1)) );
         }
     }
 
-    ///--- Element indices using triangle strips
-    for(int j=0; j<n_height-1; ++j) {
-        ///--- The two vertices at the base of each strip
-        indices.push_back(j*n_width);
-        indices.push_back((j+1)*n_width);
-        for(int i=1; i<n_width; ++i) {
-            /// TODO: push_back next two vertices HINT: Each one will generate a new triangle
-            indices.push_back(j*n_width+i);
-            indices.push_back((j+1)*n_width+i);
+    ///--- Element indices using triangle strips, one set per LOD stride (every vertex,
+    ///    every other vertex, ...) all sharing the same vertices
+    terrainMeshStrides.clear();
+    for(int s=1; s<=terrainLOD->stride(terrainLOD->max_level()); s*=2) {
+        const int first = indices.size();
+        for(int j=0; j<n_height-1; j+=s) {
+            ///--- The two vertices at the base of each strip
+            indices.push_back(j*n_width);
+            indices.push_back((j+s)*n_width);
+            for(int i=s; i<n_width; i+=s) {
+                /// TODO: push_back next two vertices HINT: Each one will generate a new triangle
+                indices.push_back(j*n_width+i);
+                indices.push_back((j+s)*n_width+i);
+            }
+            ///--- A new strip will begin when this index is reached
+            indices.push_back(resPrim);
         }
-        ///--- A new strip will begin when this index is reached
-        indices.push_back(resPrim);
+        terrainMeshStrides.push_back(std::make_pair(first, (int) indices.size() - first));
     }
 
     terrainMesh->set_vbo<Vec3>("vposition", points);
@@ -321,18 +403,15 @@ void drawTerrain() {
 
     terrainShader->set_uniform("viewPos", cameraPos);
 
-    // Bind textures
-    int i = 0;
-    for( std::map<std::string, std::unique_ptr<RGBA8Texture>>::iterator it = terrainTextures.begin(); it != terrainTextures.end(); ++it ) {
-        glActiveTexture(GL_TEXTURE1+i);
-        (it->second)->bind();
-        terrainShader->set_uniform(it->first.c_str(), 1+i);
-        ++i;
-    }
+    // Bind textures: all the materials at once
+    glActiveTexture(GL_TEXTURE1);
+    terrainMaterials->bind();
+    terrainShader->set_uniform("materials", 1);
     /// TODO: Bind height texture to GL_TEXTURE0 and set uniform noiseTex
-    glActiveTexture(GL_TEXTURE0);
-    heightTexture->bind();
+    /// (and the normal texture of the tile to the unit after the materials)
+    const int normalUnit = 2;
     terrainShader->set_uniform("noiseTex", 0);
+    terrainShader->set_uniform("normalTex", normalUnit);
 
     // Draw terrain using triangle strips
     glEnable(GL_DEPTH_TEST);
@@ -341,9 +420,65 @@ void drawTerrain() {
     terrainMesh->set_mode(GL_TRIANGLE_STRIP);
     glEnable(GL_PRIMITIVE_RESTART);
     glPrimitiveRestartIndex(resPrim);
-    /// TODO: Uncomment line below once this function is implemented
-    terrainMesh->draw();
 
-    heightTexture->unbind();
+    ///--- LOD patches of every resident tile, quadtree nodes outside the view frustum are skipped
+    const float tileSize = terrain->settings().tile_size;
+    const float gridSize = (float) terrainLOD->settings().grid;
+    const Frustum frustum(P*V);
+    cullingStats = CullingStats();
+    std::vector<TerrainPatch> patches;
+    std::vector<std::pair<float, std::pair<const TerrainTile*, TerrainPatch>>> visiblePatches;
+    for (const TerrainTile* tile : terrain->visible()) {
+        patches.clear();
+        terrainLOD->select(tile->x*tileSize, tile->y*tileSize, tileSize, tile->min_heights.data(), tile->max_heights.data(),
+                           cameraPos, &frustum, patches, &cullingStats);
+        for (const TerrainPatch& patch : patches) {
+            const float dx = std::max(0.0f, std::max(patch.x - cameraPos.x(), cameraPos.x() - (patch.x + patch.size)));
+            const float dy = std::max(0.0f, std::max(patch.y - cameraPos.y(), cameraPos.y() - (patch.y + patch.size)));
+            visiblePatches.push_back(std::make_pair(dx*dx + dy*dy, std::make_pair(tile, patch)));
+        }
+    }
+
+    ///--- Front to back (by horizontal distance): early depth rejection, and the order the horizon needs
+    std::sort(visiblePatches.begin(), visiblePatches.end(),
+              [](const std::pair<float, std::pair<const TerrainTile*, TerrainPatch>>& a,
+                 const std::pair<float, std::pair<const TerrainTile*, TerrainPatch>>& b){ return a.first < b.first; });
+
+    HorizonCuller horizon(cameraPos);
+    const TerrainTile* boundTile = NULL;
+    for (const auto& item : visiblePatches) {
+        const TerrainTile* tile = item.second.first;
+        const TerrainPatch& patch = item.second.second;
+        if (horizonCulling && horizon.occluded(Vec3(patch.x, patch.y, patch.zmin), Vec3(patch.x + patch.size, patch.y + patch.size, patch.zmax))) {
+            ++cullingStats.horizon_culled;
+            continue;
+        }
+        if (tile != boundTile) {
+            glActiveTexture(GL_TEXTURE0 + normalUnit);
+            tile->normal_texture->bind();
+            glActiveTexture(GL_TEXTURE0);
+            tile->texture->bind();
+            terrainShader->set_uniform("tile", Vec3(tile->x*tileSize, tile->y*tileSize, tileSize));
+            boundTile = tile;
+        }
+
+        ///--- One draw of the grid per patch
+        float morphStart, morphEnd;
+        terrainLOD->morph(patch.level, morphStart, morphEnd);
+        const int stride = terrainLOD->stride(patch.level);
+        const std::pair<int, int>& strips = terrainMeshStrides[std::max(0, patch.level - terrainLOD->tile_level())];
+        terrainShader->set_uniform("node", Vec3(patch.x, patch.y, patch.size));
+        terrainShader->set_uniform("morph", Vec3(morphStart, morphEnd, gridSize/stride));
+        terrainMesh->draw(strips.second, strips.first);
+        ++cullingStats.drawn;
+        cullingStats.triangles += terrainLOD->triangles(patch);
+    }
+
+    glActiveTexture(GL_TEXTURE0 + normalUnit);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    terrainMaterials->unbind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
     terrainShader->unbind();
 }
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include "OpenGP/GL/Application.h"
+#include "OpenGP/util/mapped_file.h"
+#include "OpenGP/util/parallel.h"
+#include "loadTexture.h"
+
+using namespace OpenGP;
+
+/// Decoded RGBA8 image, bottom row first as OpenGL expects
+struct RGBA8Image {
+    unsigned width, height;
+    std::vector<unsigned char> pixels;
+};
+
+inline bool decodeImage(const std::string& filename, RGBA8Image& image) {
+    unsigned error = lodepng::decode(image.pixels, image.width, image.height, filename.c_str());
+    if (error) {
+        std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+        return false;
+    }
+    const size_t row = 4 * image.width;
+    std::vector<unsigned char> tmp(row);
+    for (unsigned i = 0; i < image.height/2; ++i) {
+        memcpy(&tmp[0], &image.pixels[i*row], row);
+        memcpy(&image.pixels[i*row], &image.pixels[(image.height-1-i)*row], row);
+        memcpy(&image.pixels[(image.height-1-i)*row], &tmp[0], row);
+    }
+    return true;
+}
+
+/// Bilinear resampling (texel centers to texel centers)
+inline RGBA8Image resizeImage(const RGBA8Image& image, unsigned width, unsigned height) {
+    RGBA8Image result;
+    result.width = width;
+    result.height = height;
+    result.pixels.resize(4 * width * height);
+    for (unsigned j = 0; j < height; ++j) {
+        const float y = std::max(0.0f, (j + 0.5f) * image.height / height - 0.5f);
+        const unsigned y0 = std::min((unsigned) y, image.height - 1), y1 = std::min(y0 + 1, image.height - 1);
+        for (unsigned i = 0; i < width; ++i) {
+            const float x = std::max(0.0f, (i + 0.5f) * image.width / width - 0.5f);
+            const unsigned x0 = std::min((unsigned) x, image.width - 1), x1 = std::min(x0 + 1, image.width - 1);
+            const float fx = x - x0, fy = y - y0;
+            for (int c = 0; c < 4; ++c) {
+                const float top = image.pixels[4*(y0*image.width + x0) + c] * (1-fx) + image.pixels[4*(y0*image.width + x1) + c] * fx;
+                const float bottom = image.pixels[4*(y1*image.width + x0) + c] * (1-fx) + image.pixels[4*(y1*image.width + x1) + c] * fx;
+                result.pixels[4*(j*width + i) + c] = (unsigned char) (top * (1-fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return result;
+}
+
+/// Next mipmap level (2x2 box filter)
+inline RGBA8Image halveImage(const RGBA8Image& image) {
+    RGBA8Image result;
+    result.width = std::max(1u, image.width / 2);
+    result.height = std::max(1u, image.height / 2);
+    result.pixels.resize(4 * result.width * result.height);
+    for (unsigned j = 0; j < result.height; ++j) {
+        const unsigned y0 = std::min(2*j, image.height - 1), y1 = std::min(2*j + 1, image.height - 1);
+        for (unsigned i = 0; i < result.width; ++i) {
+            const unsigned x0 = std::min(2*i, image.width - 1), x1 = std::min(2*i + 1, image.width - 1);
+            for (int c = 0; c < 4; ++c) {
+                const unsigned sum = image.pixels[4*(y0*image.width + x0) + c] + image.pixels[4*(y0*image.width + x1) + c]
+                                   + image.pixels[4*(y1*image.width + x0) + c] + image.pixels[4*(y1*image.width + x1) + c];
+                result.pixels[4*(j*result.width + i) + c] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+/// Identifies a set of source files by their names, sizes and modification times
+inline uint64_t sourceKey(const std::vector<std::string>& files, uint64_t salt) {
+    uint64_t h = 1469598103934665603ull ^ salt; ///< FNV-1a
+    auto mix = [&h](const void* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) { h ^= ((const unsigned char*) data)[i]; h *= 1099511628211ull; }
+    };
+    for (const std::string& file : files) {
+        mix(file.data(), file.size());
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0) {
+            const int64_t size = st.st_size, time = st.st_mtime;
+            mix(&size, sizeof(size));
+            mix(&time, sizeof(time));
+        }
+    }
+    return h;
+}
+
+/// Block-compressed images as cooked by the driver, stored in one file so the
+/// next runs skip the PNG decoding and the compression: the images are handed
+/// from the mapped file to glCompressedTexImage* without a copy.
+///
+/// Layout: "TXC1", key, GL format, width, height, layers, image count, then
+/// for every image its byte size followed by the data.
+class TextureCache {
+public:
+    /// maps \c filename, false if missing or cooked from other sources (\c key)
+    bool open(const std::string& filename, uint64_t key) {
+        _images.clear();
+        if (!_file.open(filename) || _file.size() < 36 || memcmp(_file.data(), "TXC1", 4) != 0) return false;
+        const char* p = _file.data() + 4;
+        uint64_t file_key;
+        uint32_t header[5];
+        memcpy(&file_key, p, 8);
+        memcpy(header, p + 8, sizeof(header));
+        if (file_key != key) return false;
+        _format = header[0];
+        _width = header[1];
+        _height = header[2];
+        _layers = header[3];
+        p += 8 + sizeof(header);
+        for (uint32_t i = 0; i < header[4]; ++i) {
+            uint32_t size;
+            if (p + 4 > _file.data() + _file.size()) return false;
+            memcpy(&size, p, 4);
+            if (p + 4 + size > _file.data() + _file.size()) return false;
+            _images.push_back(std::make_pair(p + 4, size));
+            p += 4 + size;
+        }
+        return true;
+    }
+
+    static bool write(const std::string& filename, uint64_t key, GLenum format, unsigned width, unsigned height,
+                      unsigned layers, const std::vector<std::vector<char>>& images) {
+        FILE* out = fopen(filename.c_str(), "wb");
+        if (!out) return false;
+        const uint32_t header[5] = {(uint32_t) format, width, height, layers, (uint32_t) images.size()};
+        bool ok = fwrite("TXC1", 1, 4, out) == 4 && fwrite(&key, 8, 1, out) == 1 && fwrite(header, sizeof(header), 1, out) == 1;
+        for (size_t i = 0; ok && i < images.size(); ++i) {
+            const uint32_t size = (uint32_t) images[i].size();
+            ok = fwrite(&size, 4, 1, out) == 1 && (size == 0 || fwrite(&images[i][0], size, 1, out) == 1);
+        }
+        ok = (fclose(out) == 0) && ok;
+        if (!ok) remove(filename.c_str());
+        return ok;
+    }
+
+    GLenum format() const { return _format; }
+    unsigned width() const { return _width; }
+    unsigned height() const { return _height; }
+    unsigned layers() const { return _layers; }
+    size_t n_images() const { return _images.size(); }
+    const char* image(size_t i) const { return _images[i].first; }
+    GLsizei image_size(size_t i) const { return _images[i].second; }
+
+private:
+    MappedFile _file;
+    GLenum _format;
+    unsigned _width, _height, _layers;
+    std::vector<std::pair<const char*, GLsizei>> _images;
+};
+
+/// Reads back the compressed \c level of the bound texture (or cube map face) \c target
+inline void readCompressedImage(GLenum target, int level, std::vector<char>& data) {
+    GLint size = 0;
+    glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    data.resize(size);
+    if (size > 0) glGetCompressedTexImage(target, level, &data[0]);
+}
+
+/// CPU half of loading a texture, done on any thread: either the images cooked
+/// in a valid TextureCache, or the RGBA8 images decoded from the sources. The
+/// GL half (MaterialArray::upload, uploadCubemap) consumes it on the GL thread.
+struct TextureSource {
+    std::string cache;                      ///< where the cooked images are written, none if empty
+    uint64_t key;                           ///< of the source files
+    GLenum format;                          ///< internal format
+    unsigned width, height;                 ///< of the first image
+    int layers;
+    std::unique_ptr<TextureCache> cached;   ///< when valid, used instead of \c images
+    std::vector<std::vector<unsigned char>> images; ///< per mip level (all layers) or per cube face
+    TextureSource() : key(0), format(0), width(0), height(0), layers(0) {}
+};
+
+/// Texture compression to use, S3TC if \c compress and the driver supports it (GL thread)
+inline bool useCompression(bool compress) {
+    return compress && GLEW_EXT_texture_compression_s3tc;
+}
+
+/// Decodes the layers of a MaterialArray (one per file, resized to the largest
+/// of them) and their mipmaps, or maps them from \c cache. Layers are decoded
+/// in parallel; no GL calls, so it can run on a worker thread.
+inline bool decodeMaterials(const std::vector<std::string>& files, const std::string& cache, bool compressed,
+                            TextureSource& source, unsigned int n_threads = 0) {
+    source.cache = cache;
+    source.format = compressed ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8;
+    source.key = sourceKey(files, source.format);
+    source.layers = (int) files.size();
+
+    ///--- cooked on a previous run
+    std::unique_ptr<TextureCache> cached(new TextureCache());
+    if (compressed && !cache.empty() && cached->open(cache, source.key) && cached->layers() == (unsigned) source.layers) {
+        source.width = cached->width();
+        source.height = cached->height();
+        source.cached = std::move(cached);
+        return true;
+    }
+
+    ///--- decode, bring every layer to the same size
+    std::vector<RGBA8Image> images(files.size());
+    std::vector<char> decoded(files.size());
+    parallel_for(0, (int) files.size(), [&](int i) { decoded[i] = decodeImage(files[i], images[i]); }, 1, n_threads);
+    if (std::count(decoded.begin(), decoded.end(), 0) > 0) return false;
+    unsigned width = 1, height = 1;
+    for (const RGBA8Image& image : images) {
+        width = std::max(width, image.width);
+        height = std::max(height, image.height);
+    }
+    source.width = width;
+    source.height = height;
+
+    ///--- all levels, the layers of each level one after the other
+    parallel_for(0, (int) images.size(), [&](int i) {
+        if (images[i].width != width || images[i].height != height) images[i] = resizeImage(images[i], width, height);
+    }, 1, n_threads);
+    for (;;) {
+        source.images.push_back(std::vector<unsigned char>());
+        for (const RGBA8Image& image : images) source.images.back().insert(source.images.back().end(), image.pixels.begin(), image.pixels.end());
+        if (images[0].width == 1 && images[0].height == 1) break;
+        parallel_for(0, (int) images.size(), [&](int i) { images[i] = halveImage(images[i]); }, 1, n_threads);
+    }
+    return true;
+}
+
+/// The terrain materials as the layers of one mipmapped GL_TEXTURE_2D_ARRAY:
+/// a single bind per frame, and a single sampler selecting the layer by index.
+/// With compression (S3TC DXT1, when the driver supports it) the layers take
+/// 8x less memory than RGBA8; the driver compresses them on the first run and
+/// the result is kept in a TextureCache for the following ones.
+class MaterialArray {
+public:
+    MaterialArray() : _id(0), _bytes(0), _compressed(false) {}
+    ~MaterialArray() { if (_id) glDeleteTextures(1, &_id); }
+
+    /// One layer per file (in order), resized to the largest of them
+    bool load(const std::vector<std::string>& files, const std::string& cache = "", bool compress = true) {
+        TextureSource source;
+        return decodeMaterials(files, cache, useCompression(compress), source) && upload(source);
+    }
+
+    /// GL half of load(), \c source from decodeMaterials
+    bool upload(const TextureSource& source) {
+        _compressed = (source.format != GL_RGBA8);
+        const GLsizei layers = source.layers;
+
+        if (!_id) glGenTextures(1, &_id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, _id);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        _bytes = 0;
+
+        ///--- cooked on a previous run
+        if (source.cached) {
+            const TextureCache& cached = *source.cached;
+            for (size_t level = 0; level < cached.n_images(); ++level) {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, cached.format(), std::max(1u, cached.width() >> level),
+                                       std::max(1u, cached.height() >> level), layers, 0, cached.image_size(level), cached.image(level));
+                _bytes += cached.image_size(level);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint) cached.n_images() - 1);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            return true;
+        }
+
+        ///--- all levels, the driver compresses them if asked to
+        const int levels = (int) source.images.size();
+        for (int level = 0; level < levels; ++level) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, source.format, std::max(1u, source.width >> level), std::max(1u, source.height >> level),
+                         layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &source.images[level][0]);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        ///--- memory, and the cooked images for the next run
+        std::vector<std::vector<char>> cooked(_compressed ? levels : 0);
+        for (int level = 0; level < levels; ++level) {
+            if (_compressed) {
+                readCompressedImage(GL_TEXTURE_2D_ARRAY, level, cooked[level]);
+                _bytes += cooked[level].size();
+            } else {
+                _bytes += source.images[level].size();
+            }
+        }
+        if (_compressed && !source.cache.empty())
+            TextureCache::write(source.cache, source.key, source.format, source.width, source.height, layers, cooked);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return true;
+    }
+
+    void bind() const { glBindTexture(GL_TEXTURE_2D_ARRAY, _id); }
+    void unbind() const { glBindTexture(GL_TEXTURE_2D_ARRAY, 0); }
+
+    GLuint id() const { return _id; }
+    size_t bytes() const { return _bytes; }           ///< texture memory, all levels
+    bool compressed() const { return _compressed; }
+
+private:
+    MaterialArray(const MaterialArray&);
+    MaterialArray& operator=(const MaterialArray&);
+
+private:
+    GLuint _id;
+    size_t _bytes;
+    bool _compressed;
+};
+
+/// Decodes the six faces (+x, -x, +y, -y, +z, -z) of a cube map in parallel,
+/// or maps them from \c cache. No GL calls, as decodeMaterials.
+inline bool decodeCubemap(const std::vector<std::string>& files, const std::string& cache, bool compressed,
+                          TextureSource& source, unsigned int n_threads = 0) {
+    source.cache = cache;
+    source.format = compressed ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA;
+    source.key = sourceKey(files, source.format);
+    source.layers = 1;
+
+    std::unique_ptr<TextureCache> cached(new TextureCache());
+    if (compressed && !cache.empty() && cached->open(cache, source.key) && cached->n_images() == 6) {
+        source.width = cached->width();
+        source.height = cached->height();
+        source.cached = std::move(cached);
+        return true;
+    }
+
+    std::vector<RGBA8Image> faces(6);
+    parallel_for(0, std::min(6, (int) files.size()), [&](int i) { decodeImage(files[i], faces[i]); }, 1, n_threads);
+    for (RGBA8Image& face : faces) {
+        if (face.pixels.empty()) return false;
+        source.width = face.width;
+        source.height = face.height;
+        source.images.push_back(std::vector<unsigned char>());
+        source.images.back().swap(face.pixels);
+    }
+    return true;
+}
+
+/// GL half of loadCubemap(), \c source from decodeCubemap
+inline GLuint uploadCubemap(const TextureSource& source, size_t* bytes = NULL) {
+    const bool compressed = (source.format != GL_RGBA);
+    size_t total = 0;
+
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+
+    if (source.cached) {
+        const TextureCache& cached = *source.cached;
+        for (int i = 0; i < 6; ++i) {
+            glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, cached.format(), cached.width(), cached.height(), 0,
+                                   cached.image_size(i), cached.image(i));
+            total += cached.image_size(i);
+        }
+    } else {
+        std::vector<std::vector<char>> cooked(compressed ? 6 : 0);
+        for (int i = 0; i < (int) source.images.size(); ++i) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, source.format, source.width, source.height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, &source.images[i][0]);
+            if (compressed) {
+                readCompressedImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, cooked[i]);
+                total += cooked[i].size();
+            } else {
+                total += source.images[i].size();
+            }
+        }
+        if (compressed && !source.cache.empty())
+            TextureCache::write(source.cache, source.key, source.format, source.width, source.height, 1, cooked);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    if (bytes) *bytes = total;
+    return id;
+}
+
+/// Cube map from six faces (+x, -x, +y, -y, +z, -z), compressed and cached as a
+/// MaterialArray. Returns the texture, \c bytes receives its memory.
+inline GLuint loadCubemap(const std::vector<std::string>& files, const std::string& cache = "", bool compress = true, size_t* bytes = NULL) {
+    TextureSource source;
+    decodeCubemap(files, cache, useCompression(compress), source);
+    return uploadCubemap(source, bytes);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "OpenGP/GL/Application.h"
+#include "noise.h"
+
+using namespace OpenGP;
+
+/// Generates a heightmap using fractional brownian motion
+R32FTexture* fBm2DTexture(uint32_t seed=0) {
+    const int width = 512;
+    const int height = 512;
+    float *noise_data = fBm2D(width, height, seed);
+
+    R32FTexture* _tex = new R32FTexture();
+    _tex->upload_raw(width, height, noise_data);
+
+    delete[] noise_data;
+
+    return _tex;
+}
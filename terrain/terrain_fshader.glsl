@@ -1,12 +1,15 @@
 R"(
 #version 330 core
-uniform sampler2D noiseTex;
+// Surface normal (xyz) and height (w), precomputed with the height tile
+uniform sampler2D normalTex;
 
-uniform sampler2D grass;
-uniform sampler2D rock;
-uniform sampler2D sand;
-uniform sampler2D snow;
-uniform sampler2D water;
+// Material textures, one layer each
+uniform sampler2DArray materials;
+const float GRASS = 0.0;
+const float ROCK = 1.0;
+const float SAND = 2.0;
+const float SNOW = 3.0;
+const float WATER = 4.0;
 
 // The camera position
 uniform vec3 viewPos;
@@ -23,21 +26,9 @@ void main() {
     vec3 lightDir = normalize(vec3(1,1,1));
     vec4 lightColor = vec4(1,1,1,1);
 
-    // Texture size in pixels
-    ivec2 size = textureSize(noiseTex, 0);
-
-    /// TODO: Calculate surface normal N
-    /// HINT: Use textureOffset(,,) to read height at uv + pixelwise offset
-    /// HINT: Account for texture x,y dimensions in world space coordinates (default f_width=f_height=5)
-    /*vec3 A = vec3( 0 );
-    vec3 B = vec3( 0 );
-    vec3 C = vec3( 0 );
-    vec3 D = vec3( 0 );*/
-    vec3 A = vec3( uv.x + 1.0/size.x, uv.y, textureOffset(noiseTex, uv, ivec2(1,0)) );
-    vec3 B = vec3( uv.x - 1.0/size.x, uv.y, textureOffset(noiseTex, uv, ivec2(-1,0)) );
-    vec3 C = vec3( uv.x, uv.y + 1.0/size.y, textureOffset(noiseTex, uv, ivec2(0,1)) );
-    vec3 D = vec3( uv.x, uv.y - 1.0/size.y, textureOffset(noiseTex, uv, ivec2(0,-1)) );
-    vec3 N = normalize( cross(normalize(A-B), normalize(C-D)) );
+    // Surface normal N and height h, one fetch (filtering shortens N slightly)
+    vec4 surface = texture(normalTex, uv);
+    vec3 N = normalize(surface.xyz);
 
     /// TODO: Texture according to height and slope
     /// HINT: Read noiseTex for height at uv
@@ -47,23 +38,23 @@ void main() {
 
     float med_slope = 0.7f;
 
-    float h =  texture(noiseTex, uv).r;
+    float h =  surface.w;
     float slope = 1.0f - N.z;
     if(h<=low_height){
-        color = texture(water,uv).rgba;//water
+        color = texture(materials,vec3(fragPos.xy,WATER)).rgba;//water
         N= vec3(0,0,1);
     }else if (h<med_height && h>low_height && slope <med_slope){
-        color = texture(sand,uv).rgba;//sand
+        color = texture(materials,vec3(fragPos.xy,SAND)).rgba;//sand
     }else if (h<med_height && h>=low_height && slope >=med_slope){
-        color = texture(grass,uv).rgba;//grass
+        color = texture(materials,vec3(fragPos.xy,GRASS)).rgba;//grass
     }else if (h<high_height && h>=med_height && slope <med_slope){
-        color = texture(grass,uv).rgba;//grass
+        color = texture(materials,vec3(fragPos.xy,GRASS)).rgba;//grass
     }else if (h<high_height && h>=med_height && slope >=med_slope){
-        color = texture(rock,uv).rgba;//rock
+        color = texture(materials,vec3(fragPos.xy,ROCK)).rgba;//rock
     }else if (h>=high_height && slope >=med_slope){
-        color = texture(rock,uv).rgba;//rock
+        color = texture(materials,vec3(fragPos.xy,ROCK)).rgba;//rock
     }else if (h>=high_height && slope <med_slope){
-        color = texture(snow,uv).rgba;//snow
+        color = texture(materials,vec3(fragPos.xy,SNOW)).rgba;//snow
     }
     /// TODO: Calculate ambient, diffuse, and specular lighting
     /// HINT: max(,) dot(,) reflect(,) normalize()
@@ -8,19 +8,41 @@ in vec2 vtexcoord;
 uniform mat4 M;
 uniform mat4 V;
 uniform mat4 P;
+uniform vec3 viewPos;
+// Tile being drawn: xy world position of its corner, z its world size
+uniform vec3 tile;
+// LOD patch being drawn: xy world position of its corner, z its world size
+uniform vec3 node;
+// Morph of the patch level: between distances x and y, z quads per grid side
+uniform vec3 morph;
 
 out vec2 uv;
 out vec3 fragPos;
 
+// Height texture coordinates of a world position, texel centers on the tile corners
+vec2 tileUV(vec2 position) {
+    vec2 size = vec2(textureSize(noiseTex, 0));
+    return ((position - tile.xy)/tile.z*(size-1.0) + 0.5)/size;
+}
+
 void main() {
+    vec2 grid = vposition.xy;
+    vec2 position = node.xy + grid*node.z;
+
+    // Morph towards the coarser level: odd grid vertices slide onto their even neighbours
+    float distanceToCamera = distance(viewPos, vec3(position, texture(noiseTex, tileUV(position)).r*0.4));
+    float k = clamp((distanceToCamera - morph.x)/(morph.y - morph.x), 0.0, 1.0);
+    vec2 odd = fract(grid*morph.z*0.5)*2.0/morph.z;
+    position -= odd*node.z*k;
+    uv = tileUV(position);
+
     /// TODO: Get height h at uv
-    float h =  texture(noiseTex, vtexcoord).r*0.4;
+    float h =  texture(noiseTex, uv).r*0.4;
     if (h <-0.4f){
             h = -0.4f;
     }
 
-    uv = vtexcoord;
-    fragPos = vposition.xyz + vec3(0,0,h);  //Apply displacement to vposition
-    gl_Position = P*V*M*vec4(vposition.x, vposition.y, vposition.z + h, 1.0); //multiply model, then view, then projection
+    fragPos = vec3(position, vposition.z + h);  //Apply displacement to vposition
+    gl_Position = P*V*M*vec4(fragPos, 1.0); //multiply model, then view, then projection
 }
 )"
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "OpenGP/types.h"
+#include "OpenGP/util/parallel.h"
+#include "noise.h"
+#include "erosion.h"
+
+using namespace OpenGP;
+
+/// Surface normals (xyz) and heights (w) of the n x n interior of a (n+2) x (n+2)
+/// heightmap (row stride n+2) with samples \c spacing apart, 4 floats per sample
+/// in \c normals. Same central differences as the fragment shader used to take.
+inline void normal_map(const float* heights, int n, float spacing, float* normals, unsigned int n_threads = 0) {
+    const int stride = n + 2;
+    parallel_for(0, n, [&](int j) {
+        const float* row = heights + (j+1)*stride + 1;
+        float* out = normals + 4*j*n;
+        for (int i = 0; i < n; ++i) {
+            Vec3 dx = Vec3(2*spacing, 0, row[i+1] - row[i-1]).normalized();
+            Vec3 dy = Vec3(0, 2*spacing, row[i+stride] - row[i-stride]).normalized();
+            Vec3 normal = dx.cross(dy).normalized();
+            out[4*i+0] = normal.x();
+            out[4*i+1] = normal.y();
+            out[4*i+2] = normal.z();
+            out[4*i+3] = row[i];
+        }
+    }, 8, n_threads);
+}
+
+/// Heights and normal_map of tile (x,y) of the eroded fBm heightfield, i.e. its
+/// (resolution+1)^2 samples starting at sample (x,y)*resolution, \c spacing
+/// apart. The heights are generated with one more sample around the tile so
+/// that the normals match across tiles, those 4*(n+1) samples are returned in
+/// \c border: the first and last rows of the halo, then the first and last
+/// sample of each row in between. Shared by the TerrainStreamer and the
+/// headless bake tool, which therefore produce the same tiles.
+inline void generate_tile(const FBmSettings& noise, const ErosionSettings& erosion, int x, int y, int resolution,
+                          float spacing, std::vector<float>& heights, std::vector<float>& normals,
+                          std::vector<float>& border, unsigned int n_threads = 0) {
+    const int n = resolution + 1;
+    std::vector<float> halo((n+2) * (n+2));
+    eroded_fBm2D(halo.data(), x*resolution - 1, y*resolution - 1, n+2, n+2, noise, erosion, n_threads);
+    normals.resize(4 * n * n);
+    normal_map(halo.data(), n, spacing, normals.data(), n_threads);
+    heights.resize(n * n);
+    for (int j = 0; j < n; ++j)
+        std::copy(&halo[(j+1)*(n+2) + 1], &halo[(j+1)*(n+2) + 1] + n, &heights[j*n]);
+    border.resize(4 * (n+1));
+    std::copy(&halo[0], &halo[n+2], &border[0]);
+    std::copy(&halo[(n+1)*(n+2)], &halo[(n+2)*(n+2)], &border[n+2]);
+    for (int j = 0; j < n; ++j) {
+        border[2*(n+2) + 2*j] = halo[(j+1)*(n+2)];
+        border[2*(n+2) + 2*j + 1] = halo[(j+1)*(n+2) + n+1];
+    }
+}
+
+inline void generate_tile(const FBmSettings& noise, const ErosionSettings& erosion, int x, int y, int resolution,
+                          float spacing, std::vector<float>& heights, std::vector<float>& normals, unsigned int n_threads = 0) {
+    std::vector<float> border;
+    generate_tile(noise, erosion, x, y, resolution, spacing, heights, normals, border, n_threads);
+}
+
+/// normal_map of a tile of n x n \c heights from them and the \c border of
+/// generate_tile, the same normals as generate_tile without generating anything
+inline void tile_normals(const float* heights, const float* border, int n, float spacing,
+                         std::vector<float>& normals, unsigned int n_threads = 0) {
+    std::vector<float> halo((n+2) * (n+2));
+    std::copy(border, border + n+2, &halo[0]);
+    std::copy(border + n+2, border + 2*(n+2), &halo[(n+1)*(n+2)]);
+    for (int j = 0; j < n; ++j) {
+        halo[(j+1)*(n+2)] = border[2*(n+2) + 2*j];
+        std::copy(heights + j*n, heights + (j+1)*n, &halo[(j+1)*(n+2) + 1]);
+        halo[(j+1)*(n+2) + n+1] = border[2*(n+2) + 2*j + 1];
+    }
+    normals.resize(4 * n * n);
+    normal_map(halo.data(), n, spacing, normals.data(), n_threads);
+}
@@ -0,0 +1,354 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "OpenGP/GL/Application.h"
+#include "OpenGP/util/thread_pool.h"
+#include "noise.h"
+#include "erosion.h"
+#include "cdlod.h"
+#include "tile_generator.h"
+#include "height_cache.h"
+
+using namespace OpenGP;
+
+/// One square chunk of the (unbounded) fBm heightfield. Tile (x,y) covers
+/// [x,x+1)*tile_size x [y,y+1)*tile_size in world space with (resolution+1)^2
+/// height samples, the last row/column is shared with the next tile. The vertex
+/// shader displaces the grid with \c texture, the fragment shader shades with
+/// \c normal_texture (normal and height, computed by the worker: from scratch
+/// the first time, only from the resident heights after a texture eviction).
+struct TerrainTile {
+    int x, y;
+    std::vector<float> heights;             ///< CPU copy, empty until generated or once evicted
+    std::vector<float> border;              ///< the samples around the heights (generate_tile), kept with them
+    std::vector<float> normals;             ///< normal_map, only kept until uploaded
+    std::unique_ptr<MappedFile> cached;     ///< both of the above mapped from the HeightCache instead
+    std::unique_ptr<R32FTexture> texture;   ///< GPU copies, NULL until uploaded or once evicted
+    std::unique_ptr<RGBA16FTexture> normal_texture;
+    std::vector<float> min_heights;         ///< quadtree_bounds of the heights, a few hundred bytes
+    std::vector<float> max_heights;         ///< kept as long as the tile, empty until generated
+    std::shared_ptr<std::atomic<bool>> request; ///< pending generation, set to true to cancel it
+    unsigned int last_used;                 ///< frame in which the tile was last wanted
+    std::list<uint64_t>::iterator lru;      ///< position in the LRU list
+
+    bool has_heights() const { return cached || !heights.empty(); }
+    /// normals available for (re)upload
+    bool has_normals() const { return cached || !normals.empty(); }
+    const float* height_data() const { return cached ? HeightCache::heights(*cached) : heights.data(); }
+    const float* normal_data(int n) const { return cached ? HeightCache::normals(*cached, n) : normals.data(); }
+};
+
+/// Keeps the tiles around the camera resident. Missing tiles are generated by
+/// a pool of worker threads, at most a few finished tiles are uploaded per
+/// frame, and the least recently used CPU and GPU copies are dropped whenever
+/// their budget is exceeded. Only the neighbourhood of the camera is ever in
+/// memory, however far it travels. With a cache directory generated tiles are
+/// also written to a HeightCache, and later runs map them instead of
+/// generating them again.
+///
+/// Usage (every frame, on the GL thread):
+///
+///   streamer.update(cameraPos);
+///   for (const TerrainTile* tile : streamer.visible()) { bind tile->texture, draw }
+class TerrainStreamer {
+public:
+    struct Settings {
+        int resolution;         ///< height samples per tile side (plus the shared border)
+        float tile_size;        ///< world units per tile side
+        float view_radius;      ///< tiles closer than this to the camera are drawn
+        size_t cpu_budget;      ///< bytes of heights (and normals waiting for upload or mapped) kept in memory
+        size_t gpu_budget;      ///< bytes of height and normal textures kept on the GPU
+        int uploads_per_frame;  ///< texture uploads done by one update()
+        int bounds_levels;      ///< depth of the min/max quadtree (TerrainLOD::Settings::levels)
+        FBmSettings noise;
+        ErosionSettings erosion;     ///< applied to every tile (with a halo, so tiles still match)
+        std::string cache_directory; ///< HeightCache of the tiles, none if empty
+        Settings() : resolution(256), tile_size(0.5f), view_radius(4.0f),
+                     cpu_budget(128u<<20), gpu_budget(192u<<20), uploads_per_frame(2), bounds_levels(4) {}
+    };
+
+    explicit TerrainStreamer(const Settings& settings = Settings(), unsigned int n_threads = 0)
+        : _settings(settings), _frame(0), _cpu_bytes(0), _gpu_bytes(0), _cache(settings.cache_directory),
+          _cache_key(HeightCache::key(settings.noise, settings.erosion, settings.resolution, settings.tile_size / settings.resolution)),
+          _pool(n_threads) {}
+
+    ~TerrainStreamer() {
+        ///--- queued jobs become no-ops, the pool then joins quickly
+        for (auto& it : _tiles)
+            if (it.second.request) *it.second.request = true;
+    }
+
+    const Settings& settings() const { return _settings; }
+
+    /// Requests the tiles around \c camera (and around the \c lookahead positions,
+    /// e.g. where the camera goes next), uploads finished tiles and enforces the budgets.
+    void update(const Vec3& camera, const std::vector<Vec3>& lookahead = std::vector<Vec3>()) {
+        ++_frame;
+
+        ///--- wanted tiles, nearest first so they are generated and uploaded first
+        std::vector<TerrainTile*> wanted = touch(camera);
+        _visible.clear();
+        for (TerrainTile* tile : wanted) _visible.push_back(tile);
+        for (const Vec3& p : lookahead) {
+            std::vector<TerrainTile*> ahead = touch(p);
+            wanted.insert(wanted.end(), ahead.begin(), ahead.end());
+        }
+        for (TerrainTile* tile : wanted)
+            if (!tile->texture && !tile->has_normals() && !tile->request) generate(*tile);
+
+        collect();
+
+        ///--- incremental upload, a bounded amount of work per frame
+        int uploads = 0;
+        for (TerrainTile* tile : wanted) {
+            if (uploads == _settings.uploads_per_frame) break;
+            if (tile->texture || !tile->has_normals()) continue;
+            const int n = _settings.resolution + 1;
+            tile->texture = std::unique_ptr<R32FTexture>(new R32FTexture());
+            tile->texture->upload_raw(n, n, tile->height_data());
+            tile->normal_texture = std::unique_ptr<RGBA16FTexture>(new RGBA16FTexture());
+            tile->normal_texture->upload_raw(n, n, tile->normal_data(n));
+            if (!tile->normals.empty()) {
+                std::vector<float>().swap(tile->normals);
+                _cpu_bytes -= normals_bytes();
+            }
+            _gpu_bytes += gpu_tile_bytes();
+            ++uploads;
+        }
+
+        evict();
+
+        ///--- only uploaded tiles can be drawn
+        _visible.erase(std::remove_if(_visible.begin(), _visible.end(),
+                                      [](const TerrainTile* tile){ return !tile->texture; }), _visible.end());
+    }
+
+    /// Uploaded tiles within view_radius of the camera, nearest first
+    const std::vector<const TerrainTile*>& visible() const { return _visible; }
+
+    size_t n_tiles() const { return _tiles.size(); }
+    size_t cpu_bytes() const { return _cpu_bytes; }
+    size_t gpu_bytes() const { return _gpu_bytes; }
+
+private:
+    static uint64_t key(int x, int y) { return (uint64_t(uint32_t(x)) << 32) | uint32_t(y); }
+
+    /// the heights and their border
+    size_t heights_bytes() const {
+        const size_t n = _settings.resolution + 1;
+        return (n + 2) * (n + 2) * sizeof(float);
+    }
+
+    size_t normals_bytes() const {
+        const size_t n = _settings.resolution + 1;
+        return 4 * n * n * sizeof(float);
+    }
+
+    /// a mapped HeightCache file, heights and normals
+    size_t cached_bytes() const { return HeightCache::file_size(_settings.resolution + 1); }
+
+    /// R32F heights and RGBA16F normals
+    size_t gpu_tile_bytes() const {
+        const size_t n = _settings.resolution + 1;
+        return n * n * (4 + 8);
+    }
+
+    /// tiles within view_radius of \c p (created if needed), marked as used in this frame
+    std::vector<TerrainTile*> touch(const Vec3& p) {
+        const float size = _settings.tile_size;
+        const float radius = _settings.view_radius;
+        std::vector<std::pair<float, TerrainTile*>> tiles;
+        for (int y = (int) std::floor((p.y() - radius) / size); y <= (int) std::floor((p.y() + radius) / size); ++y) {
+            for (int x = (int) std::floor((p.x() - radius) / size); x <= (int) std::floor((p.x() + radius) / size); ++x) {
+                ///--- distance from p to the closest point of the tile
+                const float dx = std::max(0.0f, std::max(x*size - p.x(), p.x() - (x+1)*size));
+                const float dy = std::max(0.0f, std::max(y*size - p.y(), p.y() - (y+1)*size));
+                const float distance = std::sqrt(dx*dx + dy*dy);
+                if (distance > radius) continue;
+
+                auto it = _tiles.find(key(x, y));
+                if (it == _tiles.end()) {
+                    it = _tiles.emplace(key(x, y), TerrainTile()).first;
+                    TerrainTile& tile = it->second;
+                    tile.x = x;
+                    tile.y = y;
+                    tile.lru = _lru.insert(_lru.begin(), key(x, y));
+                }
+                TerrainTile& tile = it->second;
+                tile.last_used = _frame;
+                _lru.splice(_lru.begin(), _lru, tile.lru);
+                tiles.push_back(std::make_pair(distance, &tile));
+            }
+        }
+        std::stable_sort(tiles.begin(), tiles.end(),
+                         [](const std::pair<float, TerrainTile*>& a, const std::pair<float, TerrainTile*>& b){ return a.first < b.first; });
+        std::vector<TerrainTile*> result;
+        for (auto& t : tiles) result.push_back(t.second);
+        return result;
+    }
+
+    /// queues the generation of \c tile on the worker threads, only of its normals
+    /// if its heights are still resident (its textures were evicted)
+    void generate(TerrainTile& tile) {
+        std::shared_ptr<std::atomic<bool>> request = std::make_shared<std::atomic<bool>>(false);
+        tile.request = request;
+        const int x = tile.x, y = tile.y;
+        const int resolution = _settings.resolution;
+        if (!tile.heights.empty()) {
+            const float spacing = _settings.tile_size / resolution;
+            ///--- copied, the tile may be released while the job runs
+            std::shared_ptr<std::vector<float>> heights = std::make_shared<std::vector<float>>(tile.heights);
+            heights->insert(heights->end(), tile.border.begin(), tile.border.end());
+            _pool.submit([this, request, x, y, resolution, spacing, heights](){
+                if (*request) return;
+                Generated result;
+                result.x = x;
+                result.y = y;
+                result.request = request;
+                const int n = resolution + 1;
+                tile_normals(heights->data(), heights->data() + n*n, n, spacing, result.normals, 1);
+                std::unique_lock<std::mutex> lock(_mutex);
+                _finished.push_back(std::move(result));
+            });
+            return;
+        }
+        const int bounds_levels = _settings.bounds_levels;
+        const float tile_size = _settings.tile_size;
+        const FBmSettings noise = _settings.noise;
+        const ErosionSettings erosion = _settings.erosion;
+        _pool.submit([this, request, x, y, resolution, bounds_levels, tile_size, noise, erosion](){
+            if (*request) return;
+            Generated result;
+            result.x = x;
+            result.y = y;
+            result.request = request;
+            const int n = resolution + 1;
+
+            ///--- cached by a previous run: only the bounds are computed, which
+            ///    also brings the mapped heights into memory off the GL thread
+            result.cached = _cache.load(_cache_key, x, y, n);
+            if (result.cached) {
+                quadtree_bounds(HeightCache::heights(*result.cached), resolution, bounds_levels, result.min_heights, result.max_heights);
+                std::unique_lock<std::mutex> lock(_mutex);
+                _finished.push_back(std::move(result));
+                return;
+            }
+
+            ///--- one thread per tile, the pool already keeps every core busy
+            generate_tile(noise, erosion, x, y, resolution, tile_size / resolution, result.heights, result.normals, result.border, 1);
+            quadtree_bounds(result.heights.data(), resolution, bounds_levels, result.min_heights, result.max_heights);
+            _cache.store(_cache_key, x, y, n, result.heights.data(), result.normals.data());
+            std::unique_lock<std::mutex> lock(_mutex);
+            _finished.push_back(std::move(result));
+        });
+    }
+
+    /// moves the tiles finished by the workers to their (still wanted) entries
+    void collect() {
+        std::vector<Generated> finished;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            finished.swap(_finished);
+        }
+        for (Generated& result : finished) {
+            auto it = _tiles.find(key(result.x, result.y));
+            if (it == _tiles.end() || it->second.request != result.request) continue; ///< evicted meanwhile
+            TerrainTile& tile = it->second;
+            if (result.cached) {
+                release(tile);
+                tile.cached = std::move(result.cached);
+                _cpu_bytes += cached_bytes();
+            } else if (result.heights.empty()) {
+                tile.normals.swap(result.normals); ///< recomputed from the resident heights
+                _cpu_bytes += normals_bytes();
+                tile.request.reset();
+                continue;
+            } else {
+                if (tile.heights.empty()) _cpu_bytes += heights_bytes();
+                tile.heights.swap(result.heights);
+                tile.border.swap(result.border);
+                tile.normals.swap(result.normals);
+                _cpu_bytes += normals_bytes();
+            }
+            tile.min_heights.swap(result.min_heights);
+            tile.max_heights.swap(result.max_heights);
+            tile.request.reset();
+        }
+    }
+
+    /// drops the least recently used copies until both budgets are met, never
+    /// touching the tiles of the current frame; pending tiles that are no longer
+    /// wanted are cancelled and entries without any data are removed
+    void evict() {
+        auto it = _lru.end();
+        while (it != _lru.begin()) {
+            --it;
+            TerrainTile& tile = _tiles[*it];
+            if (tile.last_used == _frame) break; ///< the rest of the list is in use
+            if (tile.request) {
+                *tile.request = true;
+                tile.request.reset();
+            }
+            if (tile.texture && _gpu_bytes > _settings.gpu_budget) {
+                tile.texture.reset();
+                tile.normal_texture.reset();
+                _gpu_bytes -= gpu_tile_bytes();
+            }
+            if (tile.has_heights() && _cpu_bytes > _settings.cpu_budget) release(tile);
+            if (!tile.texture && !tile.has_heights()) {
+                const uint64_t k = *it;
+                it = _lru.erase(it);
+                _tiles.erase(k);
+            }
+        }
+    }
+
+    /// drops the CPU copies of \c tile
+    void release(TerrainTile& tile) {
+        if (tile.cached) {
+            tile.cached.reset();
+            _cpu_bytes -= cached_bytes();
+        }
+        if (!tile.heights.empty()) {
+            std::vector<float>().swap(tile.heights);
+            std::vector<float>().swap(tile.border);
+            _cpu_bytes -= heights_bytes();
+        }
+        if (!tile.normals.empty()) {
+            std::vector<float>().swap(tile.normals);
+            _cpu_bytes -= normals_bytes();
+        }
+    }
+
+    /// a generated tile, or only its normals when \c heights is empty
+    struct Generated {
+        int x, y;
+        std::vector<float> heights, border, normals;
+        std::unique_ptr<MappedFile> cached;     ///< instead of the three above
+        std::vector<float> min_heights, max_heights;
+        std::shared_ptr<std::atomic<bool>> request;
+    };
+
+private:
+    Settings _settings;
+    unsigned int _frame;
+    size_t _cpu_bytes;
+    size_t _gpu_bytes;
+    std::unordered_map<uint64_t, TerrainTile> _tiles;
+    std::list<uint64_t> _lru;                   ///< most recently used first
+    std::vector<const TerrainTile*> _visible;
+    std::mutex _mutex;                          ///< guards _finished
+    std::vector<Generated> _finished;
+    const HeightCache _cache;
+    const uint64_t _cache_key;
+    ThreadPool _pool;                           ///< last: joined before the members its jobs use
+};
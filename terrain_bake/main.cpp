@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include "OpenGP/util/thread_pool.h"
+#include <OpenGP/external/LodePNG/lodepng.cpp>
+#include "noise.h"
+#include "erosion.h"
+#include "tile_generator.h"
+#include "heightfield.h"
+
+#ifdef _WIN32
+    #include <direct.h>
+#endif
+
+using namespace OpenGP;
+
+/// Headless terrain baking: generates the tiles of the interactive app (same
+/// noise, erosion and normals, see generate_tile) without any window or GL
+/// context and writes them to a directory, for build servers.
+///
+/// Per tile (x,y), all (resolution+1)^2 samples, the last row/column shared with the next tile:
+///   heights_x_y.png   16-bit grey, height h stored as (h/range*0.5+0.5)*65535, north (+y) up
+///   heights_x_y.raw   float32 heights, row j (y ascending) at j*(resolution+1), native byte order
+///   normals_x_y.png   8-bit RGB normals, (n*0.5+0.5)*255, north up
+///   mesh_x_y.bin      displaced grids, one per level of detail, see write_mesh
+///
+/// Every file is written to a temporary name and renamed once complete, and
+/// tiles whose files all exist are skipped: an interrupted bake is resumed by
+/// running the same command again. world.txt records the settings, a bake into
+/// a directory holding another world's tiles is refused.
+///
+/// Tiles are generated in parallel, one per worker thread; a worker only holds
+/// the buffers of its current tile, so memory does not grow with the world.
+struct BakeSettings {
+    std::string directory;
+    int x0, y0, x1, y1;         ///< tiles [x0,x1) x [y0,y1)
+    int resolution;             ///< samples per tile side (plus the shared border)
+    float tile_size;            ///< world units per tile side
+    float range;                ///< heights in [-range,range] span the 16-bit PNG values
+    int mesh_levels;            ///< level k samples every 2^k-th height
+    bool png, raw, normals, mesh;
+    unsigned int n_threads;
+    FBmSettings noise;
+    ErosionSettings erosion;
+    Heightfield::Settings displacement; ///< of the mesh vertices, as in terrain_vshader.glsl
+    BakeSettings() : directory("baked"), x0(0), y0(0), x1(4), y1(4), resolution(256), tile_size(0.5f), range(2.0f),
+                     mesh_levels(4), png(true), raw(true), normals(true), mesh(true), n_threads(0) {}
+};
+
+static void make_directory(const std::string& directory) {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+static bool exists(const std::string& filename) {
+    struct stat info;
+    return stat(filename.c_str(), &info) == 0;
+}
+
+static std::string tile_file(const BakeSettings& settings, const char* name, int x, int y, const char* extension) {
+    std::ostringstream filename;
+    filename << settings.directory << "/" << name << "_" << x << "_" << y << "." << extension;
+    return filename.str();
+}
+
+/// Writes \c size bytes to \c filename through a temporary file, so that a
+/// file which exists is always complete
+static bool write_file(const std::string& filename, const void* data, size_t size) {
+    const std::string temp = filename + ".tmp";
+    FILE* out = fopen(temp.c_str(), "wb");
+    if (!out) return false;
+    bool ok = fwrite(data, 1, size, out) == size;
+    ok = (fclose(out) == 0) && ok;
+    if (ok) {
+        remove(filename.c_str()); ///< rename does not replace on every platform
+        ok = rename(temp.c_str(), filename.c_str()) == 0;
+    }
+    if (!ok) remove(temp.c_str());
+    return ok;
+}
+
+static bool write_png(const std::string& filename, const std::vector<unsigned char>& pixels, int n, LodePNGColorType type, int bits) {
+    std::vector<unsigned char> png;
+    if (lodepng::encode(png, pixels, n, n, type, bits) != 0) return false;
+    return write_file(filename, png.data(), png.size());
+}
+
+/// 16-bit big endian grey, rows flipped so that +y is up in the image
+static bool write_height_png(const std::string& filename, const std::vector<float>& heights, int n, float range) {
+    std::vector<unsigned char> pixels(2 * heights.size());
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            const float h = std::min(std::max(heights[j*n + i] / range * 0.5f + 0.5f, 0.0f), 1.0f);
+            const unsigned int value = (unsigned int) (h * 65535.0f + 0.5f);
+            const size_t pixel = size_t(n - 1 - j) * n + i;
+            pixels[2*pixel + 0] = (unsigned char) (value >> 8);
+            pixels[2*pixel + 1] = (unsigned char) (value & 0xff);
+        }
+    }
+    return write_png(filename, pixels, n, LCT_GREY, 16);
+}
+
+static bool write_normal_png(const std::string& filename, const std::vector<float>& normals, int n) {
+    std::vector<unsigned char> pixels(3 * size_t(n) * n);
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            const float* normal = &normals[4 * (size_t(j)*n + i)];
+            unsigned char* pixel = &pixels[3 * (size_t(n - 1 - j) * n + i)];
+            for (int k = 0; k < 3; ++k)
+                pixel[k] = (unsigned char) std::min(std::max((normal[k] * 0.5f + 0.5f) * 255.0f + 0.5f, 0.0f), 255.0f);
+        }
+    }
+    return write_png(filename, pixels, n, LCT_RGB, 8);
+}
+
+/// Layout, native byte order:
+///   "TMSH", version, x, y, resolution, levels (int32), tile_size, zmin, zmax (float32)
+///   per level k = 0..levels-1, the grid of every 2^k-th sample, m = resolution/2^k + 1 per side:
+///     vertex count m*m, index count 6*(m-1)^2 (uint32)
+///     vertices: world position and normal (6 float32), row j (y ascending) at j*m
+///     indices: two counter-clockwise triangles per cell (uint32)
+/// Neighbouring tiles of the same level share their border vertices exactly.
+static bool write_mesh(const std::string& filename, const BakeSettings& settings, int x, int y,
+                       const std::vector<float>& heights, const std::vector<float>& normals) {
+    const int n = settings.resolution + 1;
+    const float spacing = settings.tile_size / settings.resolution;
+    auto displace = [&](float h) { return std::max(h * settings.displacement.height_scale, settings.displacement.min_height); };
+    const auto bounds = std::minmax_element(heights.begin(), heights.end());
+
+    std::vector<char> data(36);
+    const int32_t header[5] = {1, x, y, settings.resolution, settings.mesh_levels};
+    const float range[3] = {settings.tile_size, displace(*bounds.first), displace(*bounds.second)};
+    memcpy(&data[0], "TMSH", 4);
+    memcpy(&data[4], header, sizeof(header));
+    memcpy(&data[24], range, sizeof(range));
+    auto append = [&data](const void* values, size_t size) {
+        data.insert(data.end(), (const char*) values, (const char*) values + size);
+    };
+
+    for (int level = 0; level < settings.mesh_levels; ++level) {
+        const int stride = 1 << level;
+        const int m = settings.resolution / stride + 1;
+        const uint32_t counts[2] = {uint32_t(m) * m, 6 * uint32_t(m - 1) * (m - 1)};
+        append(counts, sizeof(counts));
+        std::vector<float> vertices(6 * size_t(m) * m);
+        for (int j = 0; j < m; ++j) {
+            for (int i = 0; i < m; ++i) {
+                const size_t sample = size_t(j*stride) * n + i*stride;
+                float* vertex = &vertices[6 * (size_t(j)*m + i)];
+                vertex[0] = (x*settings.resolution + i*stride) * spacing;
+                vertex[1] = (y*settings.resolution + j*stride) * spacing;
+                vertex[2] = displace(heights[sample]);
+                std::copy(&normals[4*sample], &normals[4*sample] + 3, vertex + 3);
+            }
+        }
+        append(vertices.data(), vertices.size() * sizeof(float));
+        std::vector<uint32_t> indices;
+        indices.reserve(counts[1]);
+        for (int j = 0; j < m - 1; ++j) {
+            for (int i = 0; i < m - 1; ++i) {
+                const uint32_t a = j*m + i, b = a + 1, c = a + m, d = c + 1;
+                const uint32_t cell[6] = {a, b, d, a, d, c};
+                indices.insert(indices.end(), cell, cell + 6);
+            }
+        }
+        append(indices.data(), indices.size() * sizeof(uint32_t));
+    }
+    return write_file(filename, data.data(), data.size());
+}
+
+/// Output files of tile (x,y) that were asked for
+static std::vector<std::string> tile_files(const BakeSettings& settings, int x, int y) {
+    std::vector<std::string> files;
+    if (settings.png) files.push_back(tile_file(settings, "heights", x, y, "png"));
+    if (settings.raw) files.push_back(tile_file(settings, "heights", x, y, "raw"));
+    if (settings.normals) files.push_back(tile_file(settings, "normals", x, y, "png"));
+    if (settings.mesh) files.push_back(tile_file(settings, "mesh", x, y, "bin"));
+    return files;
+}
+
+/// Generates tile (x,y) and writes its files, on the calling thread
+static bool bake_tile(const BakeSettings& settings, int x, int y) {
+    const int n = settings.resolution + 1;
+    std::vector<float> heights, normals;
+    generate_tile(settings.noise, settings.erosion, x, y, settings.resolution,
+                  settings.tile_size / settings.resolution, heights, normals, 1);
+    bool ok = true;
+    if (settings.png) ok = write_height_png(tile_file(settings, "heights", x, y, "png"), heights, n, settings.range) && ok;
+    if (settings.raw) ok = write_file(tile_file(settings, "heights", x, y, "raw"), heights.data(), heights.size() * sizeof(float)) && ok;
+    if (settings.normals) ok = write_normal_png(tile_file(settings, "normals", x, y, "png"), normals, n) && ok;
+    if (settings.mesh) ok = write_mesh(tile_file(settings, "mesh", x, y, "bin"), settings, x, y, heights, normals) && ok;
+    return ok;
+}
+
+/// Everything the tiles depend on, as written to world.txt
+static std::string describe(const BakeSettings& s) {
+    std::ostringstream text;
+    text << "resolution " << s.resolution << "\n" << "tile_size " << s.tile_size << "\n"
+         << "png_range " << s.range << "\n" << "mesh_levels " << s.mesh_levels << "\n"
+         << "height_scale " << s.displacement.height_scale << "\n" << "min_height " << s.displacement.min_height << "\n"
+         << "seed " << s.noise.seed << "\n" << "period " << s.noise.period << "\n" << "H " << s.noise.H << "\n"
+         << "lacunarity " << s.noise.lacunarity << "\n" << "offset " << s.noise.offset << "\n"
+         << "octaves " << s.noise.octaves << "\n" << "erosion_iterations " << s.erosion.iterations << "\n";
+    if (s.erosion.iterations > 0) {
+        text << "rain " << s.erosion.rain << "\n" << "pipe " << s.erosion.pipe << "\n" << "capacity " << s.erosion.capacity << "\n"
+             << "dissolving " << s.erosion.dissolving << "\n" << "deposition " << s.erosion.deposition << "\n"
+             << "evaporation " << s.erosion.evaporation << "\n" << "talus " << s.erosion.talus << "\n"
+             << "thermal " << s.erosion.thermal << "\n";
+    }
+    return text.str();
+}
+
+static void usage() {
+    std::cerr << "usage: terrain_bake [options]\n"
+                 "  --out DIR              output directory (baked)\n"
+                 "  --tiles X0 Y0 X1 Y1    bakes tiles [X0,X1) x [Y0,Y1) (0 0 4 4)\n"
+                 "  --resolution N         samples per tile side, a multiple of 2^(levels-1) (256)\n"
+                 "  --tile-size S          world units per tile side (0.5)\n"
+                 "  --seed S               noise seed (0)\n"
+                 "  --octaves N            fBm octaves (4)\n"
+                 "  --erosion N            erosion iterations, 0 disables erosion (8)\n"
+                 "  --levels N             mesh levels of detail (4)\n"
+                 "  --range R              heights in [-R,R] span the 16-bit PNG (2)\n"
+                 "  --formats LIST         any of png,raw,normals,mesh (all)\n"
+                 "  --threads N            worker threads, 0 for every core (0)\n";
+}
+
+/// Parses the command line into \c settings, false on invalid arguments
+static bool parse(int argc, char** argv, BakeSettings& settings) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        const int values = (option == "--tiles") ? 4 : 1;
+        if (i + values >= argc) return false;
+        char** value = argv + i + 1;
+        if (option == "--out") settings.directory = value[0];
+        else if (option == "--tiles") {
+            settings.x0 = atoi(value[0]); settings.y0 = atoi(value[1]);
+            settings.x1 = atoi(value[2]); settings.y1 = atoi(value[3]);
+        }
+        else if (option == "--resolution") settings.resolution = atoi(value[0]);
+        else if (option == "--tile-size") settings.tile_size = (float) atof(value[0]);
+        else if (option == "--seed") settings.noise.seed = (uint32_t) strtoul(value[0], NULL, 10);
+        else if (option == "--octaves") settings.noise.octaves = atoi(value[0]);
+        else if (option == "--erosion") settings.erosion.iterations = atoi(value[0]);
+        else if (option == "--levels") settings.mesh_levels = atoi(value[0]);
+        else if (option == "--range") settings.range = (float) atof(value[0]);
+        else if (option == "--threads") settings.n_threads = (unsigned int) atoi(value[0]);
+        else if (option == "--formats") {
+            const std::string formats = std::string(",") + value[0] + ",";
+            settings.png = formats.find(",png,") != std::string::npos;
+            settings.raw = formats.find(",raw,") != std::string::npos;
+            settings.normals = formats.find(",normals,") != std::string::npos;
+            settings.mesh = formats.find(",mesh,") != std::string::npos;
+        }
+        else return false;
+        i += values;
+    }
+    return settings.x0 < settings.x1 && settings.y0 < settings.y1 && settings.mesh_levels >= 1
+        && settings.resolution >= 1 && settings.resolution % (1 << (settings.mesh_levels - 1)) == 0
+        && settings.tile_size > 0 && settings.range > 0 && settings.erosion.iterations >= 0
+        && (settings.png || settings.raw || settings.normals || settings.mesh);
+}
+
+int main(int argc, char** argv) {
+    BakeSettings settings;
+    if (!parse(argc, argv, settings)) {
+        usage();
+        return 2;
+    }
+
+    ///--- the tiles already in the directory must come from the same settings
+    make_directory(settings.directory);
+    const std::string world = describe(settings);
+    const std::string world_file = settings.directory + "/world.txt";
+    if (exists(world_file)) {
+        std::ifstream in(world_file.c_str(), std::ios::binary);
+        std::stringstream previous;
+        previous << in.rdbuf();
+        if (previous.str() != world) {
+            std::cerr << world_file << " was baked with other settings, use another directory" << std::endl;
+            return 1;
+        }
+    } else if (!write_file(world_file, world.data(), world.size())) {
+        std::cerr << "cannot write to " << settings.directory << std::endl;
+        return 1;
+    }
+
+    ///--- tiles left from a previous run
+    std::vector<std::pair<int, int>> tiles;
+    for (int y = settings.y0; y < settings.y1; ++y) {
+        for (int x = settings.x0; x < settings.x1; ++x) {
+            const std::vector<std::string> files = tile_files(settings, x, y);
+            if (!std::all_of(files.begin(), files.end(), exists)) tiles.push_back(std::make_pair(x, y));
+        }
+    }
+    const int total = (settings.x1 - settings.x0) * (settings.y1 - settings.y0);
+    std::cout << tiles.size() << " of " << total << " tiles to bake" << std::endl;
+
+    ///--- every worker takes the next tile until none is left, so only the
+    ///    tiles in progress are ever in memory
+    ThreadPool pool(settings.n_threads);
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+    std::mutex output;
+    size_t done = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int worker = 0; worker < pool.size(); ++worker) {
+        pool.submit([&]() {
+            for (size_t k = next++; k < tiles.size(); k = next++) {
+                const bool ok = bake_tile(settings, tiles[k].first, tiles[k].second);
+                if (!ok) ++failed;
+                std::unique_lock<std::mutex> lock(output);
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "tile " << tiles[k].first << " " << tiles[k].second << (ok ? "" : " FAILED")
+                          << " (" << ++done << "/" << tiles.size() << ", " << seconds << "s)" << std::endl;
+            }
+        });
+    }
+    pool.wait();
+
+    if (failed > 0) {
+        std::cerr << failed << " tiles could not be written, run again to retry them" << std::endl;
+        return 1;
+    }
+    return 0;
+}
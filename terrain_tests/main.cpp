@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "culling.h"
+#include "noise.h"
+#include "tile_generator.h"
+
+using namespace OpenGP;
+
+/// Regression tests of the terrain culling, noise and tiles, run by ctest. No window or GL
+/// context: the tests only use the headers of the interactive app.
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+struct Box {
+    Vec3 min, max;
+    Box(const Vec3& min, const Vec3& max) : min(min), max(max) {}
+};
+
+/// true if the segment from a to b passes below zmin over the footprint of the box (exact)
+static bool blocks(const Box& box, const Vec3& a, const Vec3& b) {
+    float t0 = 0, t1 = 1;
+    for (int k = 0; k < 2; ++k) {
+        const float d = b[k] - a[k];
+        if (d == 0) {
+            if (a[k] < box.min[k] || a[k] > box.max[k]) return false;
+            continue;
+        }
+        float ta = (box.min[k] - a[k]) / d, tb = (box.max[k] - a[k]) / d;
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+    }
+    if (t0 > t1) return false;
+    ///--- the height is linear along the segment, lowest at an end of the clipped part
+    const float z = std::min(a.z() + t0*(b.z() - a.z()), a.z() + t1*(b.z() - a.z()));
+    return z < box.min.z();
+}
+
+/// true if some point of the top of boxes[i] is seen from the camera
+static bool visible(const std::vector<Box>& boxes, size_t i, const Vec3& camera) {
+    for (int u = 0; u <= 2; ++u) {
+        for (int v = 0; v <= 2; ++v) {
+            const Vec3 p(boxes[i].min.x() + 0.5f*u*(boxes[i].max.x() - boxes[i].min.x()),
+                         boxes[i].min.y() + 0.5f*v*(boxes[i].max.y() - boxes[i].min.y()),
+                         boxes[i].max.z());
+            bool hidden = false;
+            for (size_t j = 0; j < boxes.size() && !hidden; ++j)
+                hidden = (j != i) && blocks(boxes[j], camera, p);
+            if (!hidden) return true;
+        }
+    }
+    return false;
+}
+
+/// an occluder below the camera must not hide a patch its rays clear before leaving it
+static void test_occluder_below_camera() {
+    const Vec3 camera(0, 0, 1);
+    HorizonCuller horizon(camera);
+    check(!horizon.occluded(Vec3(1, 0, 0), Vec3(2, 1, 0)), "the first box is never occluded");
+
+    ///--- lake patch at distance 3 and azimuth 40 degrees: the ray to it leaves the
+    ///    occluder at z=0.22, above its zmin=0, but below the angle of zmin at its far corner
+    const float azimuth = 40 * float(M_PI) / 180;
+    const Vec3 center(3 * std::cos(azimuth), 3 * std::sin(azimuth), -0.5f);
+    const Vec3 half(0.05f, 0.05f, 0);
+    check(!horizon.occluded(center - half, center + half), "patch behind a lower occluder is visible");
+}
+
+/// the culler still hides patches behind nearer terrain, above and below the camera
+static void test_occluded_patches() {
+    const Vec3 camera(0, 0, 1);
+    {
+        HorizonCuller horizon(camera);
+        horizon.occluded(Vec3(1, -1, 5), Vec3(1.2f, 1, 10));
+        check(horizon.occluded(Vec3(3, -0.05f, 0), Vec3(3.1f, 0.05f, 0.5f)), "patch behind a wall is culled");
+    }
+    {
+        HorizonCuller horizon(camera);
+        horizon.occluded(Vec3(0.5f, -3, 0.9f), Vec3(3, 3, 0.95f));
+        check(horizon.occluded(Vec3(10, -0.05f, 0), Vec3(10.1f, 0.05f, 0.5f)), "patch behind a plateau is culled");
+    }
+}
+
+/// patches of random heightfields, submitted by increasing distance like the app
+/// does: every culled patch must be hidden by the others
+static void test_random_heightfields() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    int culled = 0, patches = 0;
+    for (int trial = 0; trial < 20; ++trial) {
+        const float fx = 0.2f + uniform(random), fy = 0.2f + uniform(random), amplitude = 3 * uniform(random);
+        std::vector<Box> boxes;
+        for (int i = -12; i < 12; ++i) {
+            for (int j = -12; j < 12; ++j) {
+                float zmin = 1e9f, zmax = -1e9f;
+                for (int k = 0; k <= 4; ++k) {
+                    for (int l = 0; l <= 4; ++l) {
+                        const float z = amplitude * std::sin(fx * (i + 0.25f*k)) * std::cos(fy * (j + 0.25f*l));
+                        zmin = std::min(zmin, z);
+                        zmax = std::max(zmax, z);
+                    }
+                }
+                boxes.push_back(Box(Vec3(i, j, zmin), Vec3(i + 1, j + 1, zmax)));
+            }
+        }
+        const Vec3 camera(24 * uniform(random) - 12, 24 * uniform(random) - 12, amplitude * (2 * uniform(random) - 0.5f));
+        std::sort(boxes.begin(), boxes.end(), [&](const Box& a, const Box& b) {
+            const float da = std::hypot(std::max(0.0f, std::max(a.min.x() - camera.x(), camera.x() - a.max.x())),
+                                        std::max(0.0f, std::max(a.min.y() - camera.y(), camera.y() - a.max.y())));
+            const float db = std::hypot(std::max(0.0f, std::max(b.min.x() - camera.x(), camera.x() - b.max.x())),
+                                        std::max(0.0f, std::max(b.min.y() - camera.y(), camera.y() - b.max.y())));
+            return da < db;
+        });
+
+        HorizonCuller horizon(camera);
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            ++patches;
+            if (!horizon.occluded(boxes[i].min, boxes[i].max)) continue;
+            ++culled;
+            check(!visible(boxes, i, camera), "culled patch is hidden by the others");
+        }
+    }
+    std::printf("random heightfields: %d of %d patches culled\n", culled, patches);
+    check(culled > 0, "random heightfields cull some patches");
+}
+
+/// the heightmap is bit-for-bit the same whatever the compiler flags (FMA
+/// contraction, vectorization) and the number of threads
+static void test_noise_golden_hash() {
+    const int n = 512;
+    FBmSettings settings;
+    settings.octaves = 7;
+    for (unsigned int n_threads = 1; n_threads <= 4; n_threads += 3) {
+        std::vector<float> heights(n*n);
+        fBm2D(&heights[0], 0, 0, n, n, settings, n, n, n_threads);
+        ///--- FNV-1a of the bits of the heights
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < heights.size(); ++i) {
+            uint32_t bits;
+            std::memcpy(&bits, &heights[i], sizeof(bits));
+            for (int b = 0; b < 4; ++b) {
+                hash ^= (bits >> (8*b)) & 0xffu;
+                hash *= 1099511628211ull;
+            }
+        }
+        if (hash != 0xb723bf58706e3c95ull)
+            std::printf("fBm2D hash %016llx with %u threads\n", (unsigned long long) hash, n_threads);
+        check(hash == 0xb723bf58706e3c95ull, "fBm2D matches the golden hash");
+    }
+}
+
+/// the normals of a tile recomputed from its heights and border, as the streamer
+/// does after evicting its textures, are the ones it was generated with
+static void test_tile_normals() {
+    FBmSettings noise;
+    ErosionSettings erosion;
+    const int resolution = 32, n = resolution + 1;
+    const float spacing = 0.5f / resolution;
+    for (int x = -1; x <= 0; ++x) {
+        std::vector<float> heights, normals, border, recomputed;
+        generate_tile(noise, erosion, x, 1, resolution, spacing, heights, normals, border);
+        tile_normals(heights.data(), border.data(), n, spacing, recomputed);
+        check(border.size() == size_t(4 * (n+1)), "the border holds the samples around the tile");
+        check(recomputed == normals, "normals recomputed from the heights and border");
+    }
+}
+
+int main() {
+    test_occluder_below_camera();
+    test_occluded_patches();
+    test_random_heightfields();
+    test_noise_golden_hash();
+    test_tile_normals();
+    if (failures == 0) std::printf("all tests passed\n");
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
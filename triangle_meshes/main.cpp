@@ -10,11 +10,13 @@
 #include <OpenGP/MLogger.h>
 #include <OpenGP/GL/Application.h>
 #include <OpenGP/GL/ImguiRenderer.h>
+#include <OpenGP/util/parallel.h>
 
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <math.h>
+#include <algorithm>
 #define _USE_MATH_DEFINES
 
 using namespace OpenGP;
@@ -177,178 +179,145 @@ void generateCubeMesh(string filename, Vec3 p, float length, bool addTexCoord){
     writeObj(cube,filename);
 }
 
+/// Tabulates sin/cos of (scale*i)/n for i in [0,n) so that the inner loops of the
+/// generators below only do multiply-adds (same expression as the scalar version)
+static void ringTable(int n, double scale, vector<double>& sinT, vector<double>& cosT){
+    sinT.resize(n);
+    cosT.resize(n);
+    for(int i = 0; i < n; i++){
+        sinT[i] = sin(scale*i/n);
+        cosT[i] = cos(scale*i/n);
+    }
+}
+
+/// next[i] = (i+1)%n, used to wrap rows around without branching
+static vector<int> nextTable(int n){
+    vector<int> next(n);
+    for(int i = 0; i < n; i++) next[i] = i+1;
+    next[n-1] = 0;
+    return next;
+}
+
+/// Rows are generated in parallel only when there is enough work per batch
+static int rowGrain(int rowLength){
+    return std::max(1, 4096/std::max(1, rowLength));
+}
+
 void generateSphereMesh(string filename, Vec3 c, float r, int n_lat, int n_long, bool addTexCoord){
     MeshObject sphere;
 
+    vector<double> sinLat, cosLat, sinLong, cosLong;
+    ringTable(n_lat, M_PI, sinLat, cosLat);
+    ringTable(n_long, 2*M_PI, sinLong, cosLong);
+    const vector<int> next = nextTable(n_long);
+
+    //vertices: 2 poles + (n_lat-1) rows, triangles: 2 caps + (n_lat-2) bands of quads
+    const int n_verts = 2 + (n_lat-1)*n_long;
+    const int n_tris = 2*n_long + 2*(n_lat-2)*n_long;
+    sphere.vertList.resize(n_verts);
+    sphere.indexList.resize(3*n_tris);
+
     //add pole vertices
-    Vec3 top = Vec3(c(0),c(1)+r, c(2));
-    Vec3 bottom = Vec3(c(0),c(1)-r, c(2));
-    sphere.vertList.push_back(top); //index 0
-    sphere.vertList.push_back(bottom); //index 1
+    sphere.vertList[0] = Vec3(c(0),c(1)+r, c(2)); //top
+    sphere.vertList[1] = Vec3(c(0),c(1)-r, c(2)); //bottom
 
     //add other vertices, ie intersections of longitudes and latitudes, top down
-    for(int p = 1; p < n_lat; p++){ //exclude the poles
+    parallel_for(1, n_lat, [&](int p){ //exclude the poles
+        Vec3* row = &sphere.vertList[2+(p-1)*n_long];
         for(int q = 0; q < n_long; q++){ //for each non pole latitude line, going to be n_long intersections
-            Vec3 v = Vec3(c(0) + r*sin(M_PI*p/n_lat)*cos(2*M_PI*q/n_long),
-                          c(1) + r*cos(M_PI*p/n_lat),
-                          c(2) + r*sin(M_PI*p/n_lat)*sin(2*M_PI*q/n_long));
-
-            sphere.vertList.push_back(v);
+            row[q] = Vec3(c(0) + r*sinLat[p]*cosLong[q],
+                          c(1) + r*cosLat[p],
+                          c(2) + r*sinLat[p]*sinLong[q]);
         }
-    }
+    }, rowGrain(n_long));
 
     //generate triangles connecting to the poles
-    //top
-    for(int q = 0; q < n_long; q++){
-        //first row (latitude) of vertices start at pos 2
-        sphere.indexList.push_back(2+q); //add 1st vertex
-        if(q < n_long-1){
-            //add 2nd vertex (to the right of 1st)
-            sphere.indexList.push_back(q+2+1);
-        }else{
-           //last vertex of row, so must wrap around
-            sphere.indexList.push_back(2);
-        }
-        sphere.indexList.push_back(0); //add top vertex
-    }
-    //bottom
+    unsigned int* idx = sphere.indexList.data();
+    const int last = n_verts-1; //last row (latitude) is walked right to left since upside down
     for(int q = 0; q < n_long; q++){
-        //last row (latitude) of vertices start at last vertex of row (since going left)
-        sphere.indexList.push_back(sphere.vertList.size()-1-q); //add 1st vertex
-        if(q < n_long-1){
-            //add 2nd vertex (to the left of 1st) - since upside down
-            sphere.indexList.push_back(sphere.vertList.size()-1-q-1);
-        }else{
-           //first vertex of row, so must wrap around to last
-            sphere.indexList.push_back(sphere.vertList.size()-1);
-        }
-        sphere.indexList.push_back(1); //bottom vertex
+        unsigned int* top = idx + 3*q;
+        top[0] = 2+q; //first row (latitude) of vertices start at pos 2
+        top[1] = 2+next[q]; //vertex to the right of 1st, wraps around
+        top[2] = 0; //top vertex
+
+        unsigned int* bottom = idx + 3*(n_long+q);
+        bottom[0] = last-q;
+        bottom[1] = last-next[q]; //vertex to the left of 1st, wraps around to last
+        bottom[2] = 1; //bottom vertex
     }
 
-    //generate other triangles
-    for(int p = 1; p < n_lat-1; p++){ //exclude the poles and 2nd last latitude
+    //generate other triangles, one band of quads per latitude row
+    parallel_for(1, n_lat-1, [&](int p){ //exclude the poles and 2nd last latitude
+        const int row0 = 2+(p-1)*n_long; //latitude p
+        const int row1 = 2+p*n_long; //latitude p+1
+        unsigned int* band = idx + 3*(2*n_long + 2*(p-1)*n_long);
         for(int q = 0; q < n_long; q++){
+            unsigned int* t = band + 6*q;
             //t1
-            sphere.indexList.push_back(2+(p-1)*n_long+q); // pq
-            if(q < n_long-1){
-                sphere.indexList.push_back(2+p*n_long+q+1); //p+1 q+1
-                sphere.indexList.push_back(2+(p-1)*n_long+q+1); // p q+1
-            }else{
-                //last one of row, wrap around
-                sphere.indexList.push_back(2+p*n_long);   //p+1 q+1
-                sphere.indexList.push_back(2+(p-1)*n_long); // p q+1
-            }
-
-
+            t[0] = row0+q; // pq
+            t[1] = row1+next[q]; //p+1 q+1
+            t[2] = row0+next[q]; // p q+1
             //t2
-            sphere.indexList.push_back(2+(p-1)*n_long+q); // pq
-            sphere.indexList.push_back(2+p*n_long+q); //p+1 q
-            if(q < n_long-1){
-                sphere.indexList.push_back(2+p*n_long+q+1); // p+1 q+1
-            }else{
-                //last one of row, wrap around
-                sphere.indexList.push_back(2+p*n_long); // p+1 q+1
-            }
+            t[3] = row0+q; // pq
+            t[4] = row1+q; //p+1 q
+            t[5] = row1+next[q]; // p+1 q+1
         }
-    }
+    }, rowGrain(n_long));
 
     if(addTexCoord){
-        for(Vec3 v: sphere.vertList){
+        sphere.tCoordList.resize(n_verts);
+        parallel_for(0, n_verts, [&](int i){
+            const Vec3& v = sphere.vertList[i];
             Vec3 d = Vec3(c(0)-v(0), c(1)-v(1),c(2)-v(2)).normalized(); //d is unit vector from v to center
 
             float u = 0.5 + atan2(d(2),d(0))/(2*M_PI);
-            float v = 0.5 - asin(d(1))/M_PI;
-            sphere.tCoordList.push_back(Vec2(u,v));
-        }
+            float w = 0.5 - asin(d(1))/M_PI;
+            sphere.tCoordList[i] = Vec2(u,w);
+        });
     }
     writeObj(sphere,filename);
 }
 
 void generateCylinderMesh(string filename, Vec3 c, float r, float h, int n_div, bool addTexCoord){
     MeshObject cylinder;
-    //determine center of cylinder caps
-    //Vec3 tc = Vec3(c(0), c(1)+h/2, c(2)); //top cap
-    //Vec3 bc = Vec3(c(0), c(1)-h/2, c(2));; //bottom cap
-    //cylinder.vertList.push_back(tc); //index 0
-    //cylinder.vertList.push_back(bc); //index 1
 
-    //generate points along the circumference of cylindrical caps
-    for(int p = 0; p < n_div; p++){ //points along circumference = n_div*2
-        Vec3 vtop = Vec3(c(0)+r*sin(2*M_PI*p/n_div),
-                         c(1)+h/2,
-                         c(2)+r*cos(2*M_PI*p/n_div)); //point along circumference of top cap
-        Vec3 vbottom = Vec3(c(0)+r*sin(2*M_PI*p/n_div),
-                            c(1)-h/2,
-                            c(2)+r*cos(2*M_PI*p/n_div)); //point along circumference of bottom cap
-
-        cylinder.vertList.push_back(vtop);
-        cylinder.vertList.push_back(vbottom);
-    }
+    vector<double> sinDiv, cosDiv;
+    ringTable(n_div, 2*M_PI, sinDiv, cosDiv);
+    const vector<int> next = nextTable(n_div);
 
-    //generate triangles //if want to include caps, add 2 to each of the push backs. ex first one is push_back(2+p*2)
-    for(int p = 0; p < n_div; p++){
-        //t1 upper side triangle
-        cylinder.indexList.push_back(p*2); //vtop p
-        cylinder.indexList.push_back(p*2+1); //vbottom p
-        if(p < n_div-1){
-            cylinder.indexList.push_back(p*2+2); //vtop p+1
-        }else{
-            //last one, must wrap around
-            cylinder.indexList.push_back(0); //vtop p+1
-        }
+    //points along circumference = n_div*2 (top/bottom interleaved), 2 side triangles per division
+    cylinder.vertList.resize(2*n_div);
+    cylinder.indexList.resize(6*n_div);
 
+    //generate points along the circumference of cylindrical caps
+    //(caps are not generated, their center vertices would go first and shift every index by 2)
+    parallel_for(0, n_div, [&](int p){
+        cylinder.vertList[2*p] = Vec3(c(0)+r*sinDiv[p],
+                                      c(1)+h/2,
+                                      c(2)+r*cosDiv[p]); //point along circumference of top cap
+        cylinder.vertList[2*p+1] = Vec3(c(0)+r*sinDiv[p],
+                                        c(1)-h/2,
+                                        c(2)+r*cosDiv[p]); //point along circumference of bottom cap
+
+        const int p1 = next[p]; //wraps around on the last division
+        unsigned int* t = &cylinder.indexList[6*p];
+        //t1 upper side triangle
+        t[0] = 2*p; //vtop p
+        t[1] = 2*p+1; //vbottom p
+        t[2] = 2*p1; //vtop p+1
         //t2 lower side triangle
-        cylinder.indexList.push_back(p*2+1); //vbottom p
-        if(p < n_div-1){
-            cylinder.indexList.push_back(p*2+1+2); //vbottom p+1
-            cylinder.indexList.push_back(p*2+2); //vtop p+1
-        }else{
-            //last one, must wrap around
-            cylinder.indexList.push_back(1); //vbottom p+1
-            cylinder.indexList.push_back(0); //vtop p+1
-        }
-        /*
-        //t3 top slice triangle
-        cylinder.indexList.push_back(2+p*2); //vtop p
-        if(p < n_div-1){
-            cylinder.indexList.push_back(2+p*2+2); //vtop p+1
-        }else{
-            //last one, must wrap around
-            cylinder.indexList.push_back(2); //vtop p+1
-        }
-        cylinder.indexList.push_back(0); //top center
-
-        //t4 bottom slice triangle
-        cylinder.indexList.push_back(2+p*2+1); //vbottom p
-        if(p < n_div-1){
-            cylinder.indexList.push_back(2+p*2+1+2); //vbottom p+1
-        }else{
-            //last one, must wrap around
-            cylinder.indexList.push_back(2+1); //vbottom p+1
-        }
-        cylinder.indexList.push_back(1); //bottom center*/
-    }
+        t[3] = 2*p+1; //vbottom p
+        t[4] = 2*p1+1; //vbottom p+1
+        t[5] = 2*p1; //vtop p+1
+    }, rowGrain(1));
 
     if(addTexCoord){
-        int i = 0;
-        for(Vec3 v: cylinder.vertList){
-            /*if(i == 0){
-                // top cap
-                cylinder.tCoordList.push_back(Vec2(0.25,0.75));
-            }else if(i == 1){
-                cylinder.tCoordList.push_back(Vec2(0.75,0.75));*/
-            if(i%2 == 0){
-                //top vertex
-                float u = (float) i/(float) n_div;
-                float v = 0.5;
-                cylinder.tCoordList.push_back(Vec2(u,v));
-            }else{
-                //bottom vertex
-                float u = (float) i/(float) n_div;
-                float v = 0.0;
-                cylinder.tCoordList.push_back(Vec2(u,v));
-            }
-            i++;
+        //top vertices (even) sit at v=0.5, bottom vertices (odd) at v=0
+        cylinder.tCoordList.resize(2*n_div);
+        for(int i = 0; i < 2*n_div; i++){
+            float u = (float) i/(float) n_div;
+            float v = (i%2 == 0) ? 0.5 : 0.0;
+            cylinder.tCoordList[i] = Vec2(u,v);
         }
     }
     writeObj(cylinder,filename);
@@ -359,78 +328,45 @@ void generateTorusMesh(string filename, Vec3 c, float bigR, float r, int n_cuts,
     //bigR = torus center to tube center radius
     //r = tube radius
 
-    //add other vertices, ie intersections of longitudes and latitudes, top down
-    for(int p = 0; p < n_cuts; p++){
-        Vec3 tubecenter = Vec3(c(0)+bigR*cos(2*M_PI*p/n_cuts),
+    vector<double> sinCut, cosCut, sinRing, cosRing;
+    ringTable(n_cuts, 2*M_PI, sinCut, cosCut);
+    ringTable(n_rings, 2*M_PI, sinRing, cosRing);
+    const vector<int> nextCut = nextTable(n_cuts);
+    const vector<int> nextRing = nextTable(n_rings);
+
+    const int n_verts = n_cuts*n_rings;
+    torus.vertList.resize(n_verts);
+    torus.indexList.resize(6*n_verts); //2 triangles per (cut, ring) pair
+    if(addTexCoord) torus.tCoordList.resize(n_verts);
+
+    //one cut (tube cross section) per row: vertices, triangles to the next cut and texcoords
+    parallel_for(0, n_cuts, [&](int p){
+        Vec3 tubecenter = Vec3(c(0)+bigR*cosCut[p],
                                c(1),
-                               c(2)+bigR*sin(2*M_PI*p/n_cuts));
+                               c(2)+bigR*sinCut[p]);
+        const int row0 = p*n_rings;
+        const int row1 = nextCut[p]*n_rings; //last cut wraps around
         for(int q = 0; q < n_rings; q++){ //for each cut, n_rings intersections
-            Vec3 v = Vec3(tubecenter(0)+r*cos(2*M_PI*q/n_rings)*cos(2*M_PI*p/n_cuts),
-                          tubecenter(1)+r*sin(2*M_PI*q/n_rings),
-                          tubecenter(2)+r*cos(2*M_PI*q/n_rings)*sin(2*M_PI*p/n_cuts));
-
-            torus.vertList.push_back(v);
-        }
-    }
+            torus.vertList[row0+q] = Vec3(tubecenter(0)+r*cosRing[q]*cosCut[p],
+                                          tubecenter(1)+r*sinRing[q],
+                                          tubecenter(2)+r*cosRing[q]*sinCut[p]);
 
-    //generate triangles
-    for(int p = 0; p < n_cuts; p++){
-        for(int q = 0; q < n_rings; q++){
+            const int q1 = nextRing[q]; //last ring wraps around
+            unsigned int* t = &torus.indexList[6*(row0+q)];
             //t1
-            torus.indexList.push_back(p*n_rings+q); // pq
-            if(q == n_rings-1 && p != n_cuts-1){
-                //last ring wrap around
-                torus.indexList.push_back(p*n_rings+0); //p q+1
-                torus.indexList.push_back((p+1)*n_rings+0); // p+1 q+1
-            }else if(p == n_cuts-1 && q != n_rings-1){
-                //last cut wrap around
-                torus.indexList.push_back(p*n_rings+(q+1)); //p q+1
-                torus.indexList.push_back((0)*n_rings+(q+1)); // p+1 q+1
-            }else if(q == n_rings-1 && p == n_cuts-1){
-                //last ring and last cut, wrap around
-                torus.indexList.push_back(p*n_rings+0); //p q+1
-                torus.indexList.push_back(0); // p+1 q+1
-            }else{
-                torus.indexList.push_back(p*n_rings+(q+1)); //p q+1
-                torus.indexList.push_back((p+1)*n_rings+(q+1)); // p+1 q+1
-            }
-
-
+            t[0] = row0+q; // pq
+            t[1] = row0+q1; //p q+1
+            t[2] = row1+q1; // p+1 q+1
             //t2
-            torus.indexList.push_back(p*n_rings+q); // pq
-            if(q == n_rings-1 && p != n_cuts-1){
-                //last ring wrap around
-                torus.indexList.push_back((p+1)*n_rings+0); // p+1 q+1
-                torus.indexList.push_back((p+1)*n_rings+q); //p+1 q
-            }else if(p == n_cuts-1 && q != n_rings-1){
-                //last cut wrap around
-                torus.indexList.push_back((0)*n_rings+(q+1)); // p+1 q+1
-                torus.indexList.push_back(0*n_rings+q); //p+1 q
-            }else if(q == n_rings-1 && p == n_cuts-1){
-                //last ring and last cut, wrap around
-                torus.indexList.push_back(0); // p+1 q+1
-                torus.indexList.push_back(0*n_rings+q); //p+1 q
-            }else{
-                torus.indexList.push_back((p+1)*n_rings+(q+1)); // p+1 q+1
-                torus.indexList.push_back((p+1)*n_rings+q); //p+1 q
-            }
-        }
-    }
+            t[3] = row0+q; // pq
+            t[4] = row1+q1; // p+1 q+1
+            t[5] = row1+q; //p+1 q
 
-    if(addTexCoord){
-        int ring = 0;
-        int cut = 0;
-        for(Vec3 v: torus.vertList){
-            if(ring == n_rings){
-                ring = 0;
-                cut++;
-            }
-            float u = (float) cut / (float) n_cuts;
-            float v = (float) ring/(float) n_rings;
-            torus.tCoordList.push_back(Vec2(u,v));
-            ring++;
+            if(addTexCoord)
+                torus.tCoordList[row0+q] = Vec2((float) p/(float) n_cuts, (float) q/(float) n_rings);
         }
-    }
+    }, rowGrain(n_rings));
+
     writeObj(torus,filename);
 }
 